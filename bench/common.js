@@ -0,0 +1,92 @@
+/*
+ Helpers shared by the benchmarks: command line, timing, and running against a private cupsd (see cupsd.js)
+ or an already running server.
+ */
+var fs = require("fs"),
+    path = require("path"),
+    cupsd = require("./cupsd");
+
+/// --some-option value pairs into a copy of defaults (someOption), numbers stay numbers
+function parseArgs(argv, defaults)
+{
+    var args = {};
+    Object.keys(defaults).forEach(function(key){ args[key] = defaults[key]; });
+    for(var i = 0; i < argv.length; i += 2) {
+        var key = argv[i].replace(/^--/, '').replace(/-([a-z])/g, function(m, c){ return c.toUpperCase(); });
+        if(!(key in args)) {
+            throw new Error('unknown option ' + argv[i]);
+        }
+        args[key] = (typeof args[key] === 'number') ? Number(argv[i + 1]) : argv[i + 1];
+    }
+    return args;
+}
+
+function now()
+{
+    var t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+}
+
+/// median duration in ms of fn over `iterations` runs, after a warm up. fn may return its own duration
+function measure(iterations, fn)
+{
+    var durations = [];
+    fn();
+    for(var i = 0; i < iterations; ++i) {
+        var start = now(),
+            duration = fn();
+        durations.push((typeof duration === 'number') ? duration : now() - start);
+    }
+    durations.sort(function(a, b){ return a - b; });
+    return durations[Math.floor(durations.length / 2)];
+}
+
+/** Run a benchmark and write its results as JSON to args.out
+ * @param args parsed arguments, args.server set benchmarks that server instead of starting cupsd
+ * @param cupsdOptions options of cupsd.start
+ * @param run function(args, server) returning a Promise of the results, server is null with args.server
+ */
+function main(args, cupsdOptions, run)
+{
+    function finish(server, err, results){
+        if(server) {
+            server.stop();
+        }
+        if(err) {
+            console.error(err.stack || err);
+            process.exit(1);
+        }
+        var json = JSON.stringify(results, null, 2);
+        fs.writeFileSync(path.resolve(args.out), json + '\n');
+        console.log(json);
+    }
+
+    function runWith(server){
+        var promise;
+        try {
+            promise = run(args, server);
+        } catch(e) {
+            return finish(server, e);
+        }
+        promise.then(function(results){
+            finish(server, null, results);
+        }, function(err){
+            finish(server, err);
+        });
+    }
+
+    if(args.server) {
+        return runWith(null);
+    }
+    cupsd.start(cupsdOptions, function(err, server){
+        if(err) {
+            return finish(null, err);
+        }
+        runWith(server);
+    });
+}
+
+module.exports.parseArgs = parseArgs;
+module.exports.now = now;
+module.exports.measure = measure;
+module.exports.main = main;
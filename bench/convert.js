@@ -0,0 +1,103 @@
+/*
+ Micro-benchmark of the conversion of jobs into JS objects.
+
+ use: npm run bench:convert -- [--queues N] [--jobs J] [--iterations I] [--server host:port] [--out results.json]
+
+ J held jobs are spread over N queues of a private cupsd (see cupsd.js). The jobs are fetched with
+ getPrinters({jobs: 'lazy'}), then only their conversion is timed by the first read of printer.jobs: the Get-Jobs
+ round trip is not included. It is timed with the internalized keys and record templates, and again with plain
+ objects and new strings as before them (setRecordKeysEnabled(false)); both are reported per job with the speedup.
+ getPrinters() durations of each jobs mode are reported too. Results are written as JSON to --out
+ (default bench-convert.json).
+ */
+var fs = require("fs"),
+    path = require("path"),
+    common = require("./common");
+
+/// native binding, the one lib/printer.js loads
+function loadBinding()
+{
+    var binding_path = path.resolve(__dirname, '../lib/node_printer.node');
+    if(!fs.existsSync(binding_path)) {
+        binding_path = path.resolve(__dirname, '../lib/node_printer_' + process.platform + '_' + process.arch + '.node');
+    }
+    return require(binding_path);
+}
+
+/// queue held jobs, 16 at once
+function holdJobs(printer, printers, count)
+{
+    var sent = 0;
+    function next(){
+        if(sent >= count) {
+            return Promise.resolve();
+        }
+        var name = printers[sent++ % printers.length];
+        return printer.printDirect({data: 'held job\n', printer: name, type: 'RAW', docname: 'held',
+                                    options: {'job-hold-until': 'indefinite'}}).then(next);
+    }
+    var workers = [];
+    for(var i = 0; i < 16; ++i) {
+        workers.push(next());
+    }
+    return Promise.all(workers);
+}
+
+/// median ms to convert the jobs of all printers, fetched beforehand
+function measureConversion(printer, iterations)
+{
+    return common.measure(iterations, function(){
+        var printers = printer.getPrinters({jobs: 'lazy'}),
+            start = common.now();
+        printers.forEach(function(p){
+            return p.jobs;
+        });
+        return common.now() - start;
+    });
+}
+
+function run(args, server)
+{
+    if(server || args.server) {
+        // libcups reads the server address on first use
+        process.env.CUPS_SERVER = server ? server.address : args.server;
+    }
+    var printer = require("../"),
+        binding = loadBinding(),
+        printers = server ? server.printers : printer.getPrinters({jobs: 'none'}).map(function(p){ return p.name; });
+
+    return holdJobs(printer, printers, server ? args.jobs : 0).then(function(){
+        var jobs = printer.getPrinters().reduce(function(total, p){ return total + (p.jobs ? p.jobs.length : 0); }, 0),
+            getPrintersMs = {
+                eager: common.measure(args.iterations, function(){ printer.getPrinters({jobs: 'eager'}); }),
+                lazy: common.measure(args.iterations, function(){ printer.getPrinters({jobs: 'lazy'}); }),
+                none: common.measure(args.iterations, function(){ printer.getPrinters({jobs: 'none'}); })
+            },
+            templates = measureConversion(printer, args.iterations),
+            plain;
+        binding.setRecordKeysEnabled(false);
+        try {
+            plain = measureConversion(printer, args.iterations);
+        } finally {
+            binding.setRecordKeysEnabled(true);
+        }
+        return {
+            date: new Date().toISOString(),
+            node: process.version,
+            version: require("../package.json").version,
+            printers: printers.length,
+            jobs: jobs,
+            iterations: args.iterations,
+            getPrintersMs: getPrintersMs,
+            conversionMs: {templates: templates, plain: plain},
+            perJobUs: {
+                templates: jobs ? templates * 1000 / jobs : 0,
+                plain: jobs ? plain * 1000 / jobs : 0
+            },
+            speedup: templates ? plain / templates : 0
+        };
+    });
+}
+
+var args = common.parseArgs(process.argv.slice(2), {queues: 4, jobs: 5000, iterations: 50, server: null, out: 'bench-convert.json'});
+common.main(args, {queues: args.queues, heldJobs: 0}, run);
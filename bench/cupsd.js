@@ -0,0 +1,155 @@
+/*
+ Private CUPS scheduler for benchmarks: runs cupsd as the current user in a temporary directory,
+ listening on 127.0.0.1, with queues printing to /dev/null.
+ */
+var child_process = require("child_process"),
+    fs = require("fs"),
+    os = require("os"),
+    path = require("path"),
+    net = require("net");
+
+/// find a free TCP port on 127.0.0.1
+function freePort(callback)
+{
+    var server = net.createServer();
+    server.listen(0, '127.0.0.1', function(){
+        var port = server.address().port;
+        server.close(function(){
+            callback(port);
+        });
+    });
+}
+
+function findProgram(name, dirs)
+{
+    var pathDirs = (process.env.PATH || '').split(path.delimiter).concat(dirs || []);
+    for(var i = 0; i < pathDirs.length; ++i) {
+        var candidate = path.join(pathDirs[i], name);
+        if(fs.existsSync(candidate)) {
+            return candidate;
+        }
+    }
+    return null;
+}
+
+function writeConfig(root, port, maxJobs)
+{
+    var user = os.userInfo(),
+        group = child_process.execFileSync('id', ['-gn']).toString().trim(),
+        dirs = ['spool', 'spool/tmp', 'cache', 'state', 'log', 'ppd'];
+    dirs.forEach(function(dir){
+        fs.mkdirSync(path.join(root, dir), {recursive: true});
+    });
+
+    fs.writeFileSync(path.join(root, 'cupsd.conf'), [
+        'Listen 127.0.0.1:' + port,
+        'LogLevel warn',
+        'Browsing Off',
+        'DefaultAuthType None',
+        // completed jobs stay queryable for the getJob benchmark, as many as the run creates
+        'MaxJobs ' + maxJobs,
+        'PreserveJobHistory On',
+        '<Location />',
+        '  Order allow,deny',
+        '  Allow all',
+        '</Location>',
+        '<Policy default>',
+        '  <Limit All>',
+        '    Order deny,allow',
+        '  </Limit>',
+        '</Policy>',
+        ''
+    ].join('\n'));
+
+    fs.writeFileSync(path.join(root, 'cups-files.conf'), [
+        'User ' + user.username,
+        'Group ' + group,
+        'SystemGroup ' + group,
+        'FileDevice Yes',
+        'ServerRoot ' + root,
+        'RequestRoot ' + path.join(root, 'spool'),
+        'TempDir ' + path.join(root, 'spool/tmp'),
+        'CacheDir ' + path.join(root, 'cache'),
+        'StateDir ' + path.join(root, 'state'),
+        'AccessLog ' + path.join(root, 'log/access_log'),
+        'ErrorLog ' + path.join(root, 'log/error_log'),
+        'PageLog ' + path.join(root, 'log/page_log'),
+        'PidFile ' + path.join(root, 'cupsd.pid'),
+        ''
+    ].join('\n'));
+}
+
+/// wait for the scheduler to accept connections
+function waitReady(port, timeout, callback)
+{
+    var deadline = Date.now() + timeout;
+    (function attempt(){
+        var socket = net.connect(port, '127.0.0.1');
+        socket.on('connect', function(){
+            socket.destroy();
+            callback(null);
+        });
+        socket.on('error', function(){
+            if(Date.now() > deadline) {
+                return callback(new Error('cupsd did not start on port ' + port));
+            }
+            setTimeout(attempt, 100);
+        });
+    })();
+}
+
+/** Start a private cupsd and create its queues
+ * @param {Object} options
+ *  - queues: number of queues, named bench0..benchN-1
+ *  - heldJobs: held jobs queued on each printer, so job lists are not empty
+ *  - jobs: jobs printed by the benchmark, kept in the job history
+ * @param {Function} callback(err, server) server: {address, printers, stop()}
+ */
+function start(options, callback)
+{
+    var cupsd = findProgram('cupsd', ['/usr/sbin', '/usr/local/sbin']),
+        lpadmin = findProgram('lpadmin', ['/usr/sbin', '/usr/local/sbin']),
+        lp = findProgram('lp', ['/usr/bin', '/usr/local/bin']);
+    if(!cupsd || !lpadmin || !lp) {
+        return callback(new Error('cupsd, lpadmin and lp are required, or use --server to benchmark a running server'));
+    }
+
+    var root = fs.mkdtempSync(path.join(os.tmpdir(), 'node-printer-bench-'));
+    freePort(function(port){
+        writeConfig(root, port, options.queues * options.heldJobs + (options.jobs || 0) + 100);
+        var daemon = child_process.spawn(cupsd, ['-f', '-c', path.join(root, 'cupsd.conf'), '-s', path.join(root, 'cups-files.conf')],
+                                         {stdio: 'ignore'});
+        var address = '127.0.0.1:' + port,
+            printers = [];
+
+        function stop(){
+            daemon.kill();
+            fs.rmSync(root, {recursive: true, force: true});
+        }
+
+        waitReady(port, 10000, function(err){
+            if(err) {
+                stop();
+                return callback(err);
+            }
+            var heldFile = path.join(root, 'held.txt');
+            fs.writeFileSync(heldFile, 'held job\n');
+            try {
+                for(var i = 0; i < options.queues; ++i) {
+                    var name = 'bench' + i;
+                    child_process.execFileSync(lpadmin, ['-h', address, '-p', name, '-E', '-v', 'file:///dev/null'], {stdio: 'ignore'});
+                    for(var j = 0; j < options.heldJobs; ++j) {
+                        child_process.execFileSync(lp, ['-h', address, '-d', name, '-H', 'hold', '-t', 'held ' + j, heldFile], {stdio: 'ignore'});
+                    }
+                    printers.push(name);
+                }
+            } catch(e) {
+                stop();
+                return callback(e);
+            }
+            callback(null, {address: address, printers: printers, stop: stop});
+        });
+    });
+}
+
+module.exports.start = start;
@@ -0,0 +1,147 @@
+/*
+ End-to-end benchmark against a private CUPS scheduler (see cupsd.js).
+
+ use: npm run bench -- [--queues N] [--held-jobs M] [--jobs J] [--size BYTES] [--concurrency C]
+                       [--samples S] [--server host:port] [--out results.json]
+
+ --server benchmarks an already running server instead of starting cupsd; its printers are used.
+ Results are printed and written as JSON to --out (default bench-results.json).
+ */
+var os = require("os"),
+    common = require("./common"),
+    now = common.now;
+
+function percentile(sorted, p)
+{
+    if(!sorted.length) {
+        return 0;
+    }
+    return sorted[Math.min(sorted.length - 1, Math.floor(p / 100 * sorted.length))];
+}
+
+function summary(latencies)
+{
+    var sorted = latencies.slice().sort(function(a, b){ return a - b; }),
+        total = sorted.reduce(function(a, b){ return a + b; }, 0);
+    return {
+        samples: sorted.length,
+        mean: sorted.length ? total / sorted.length : 0,
+        p50: percentile(sorted, 50),
+        p99: percentile(sorted, 99),
+        max: sorted.length ? sorted[sorted.length - 1] : 0
+    };
+}
+
+/// latency in ms of a synchronous call, `samples` times
+function measureSync(samples, fn)
+{
+    var latencies = [];
+    for(var i = 0; i < samples; ++i) {
+        var start = now();
+        fn(i);
+        latencies.push(now() - start);
+    }
+    return summary(latencies);
+}
+
+/// send `jobs` printDirect jobs, `concurrency` at once, spread over the printers
+function measurePrintDirect(printer, printers, args)
+{
+    var data = Buffer.alloc(args.size, 'x'),
+        latencies = [],
+        jobIds = [],
+        sent = 0,
+        start = now();
+
+    function next(){
+        if(sent >= args.jobs) {
+            return Promise.resolve();
+        }
+        var name = printers[sent % printers.length],
+            jobStart = now();
+        ++sent;
+        return printer.printDirect({data: data, printer: name, type: 'RAW', docname: 'bench'}).then(function(jobId){
+            latencies.push(now() - jobStart);
+            jobIds.push({printer: name, id: jobId});
+            return next();
+        });
+    }
+
+    var workers = [];
+    for(var i = 0; i < Math.max(1, args.concurrency); ++i) {
+        workers.push(next());
+    }
+    return Promise.all(workers).then(function(){
+        var seconds = (now() - start) / 1000;
+        return {
+            result: {
+                jobs: args.jobs,
+                bytesPerJob: args.size,
+                concurrency: args.concurrency,
+                seconds: seconds,
+                jobsPerSecond: args.jobs / seconds,
+                megabytesPerSecond: args.jobs * args.size / (1024 * 1024) / seconds,
+                latency: summary(latencies)
+            },
+            jobIds: jobIds
+        };
+    });
+}
+
+function run(args, server)
+{
+    if(server) {
+        // libcups reads the server address on first use
+        process.env.CUPS_SERVER = server.address;
+    } else if(args.server) {
+        process.env.CUPS_SERVER = args.server;
+    }
+    var printer = require("../"),
+        printers = server ? server.printers : printer.getPrinters().map(function(p){ return p.name; }),
+        rssStart = process.memoryUsage().rss,
+        results = {
+            date: new Date().toISOString(),
+            node: process.version,
+            platform: os.platform() + ' ' + os.release(),
+            version: require("../package.json").version,
+            server: server ? 'private cupsd' : (args.server || 'default'),
+            options: args
+        };
+
+    if(!printers.length) {
+        throw new Error('no printer to benchmark');
+    }
+
+    results.getPrinters = measureSync(args.samples, function(){
+        printer.getPrinters();
+    });
+    results.getPrinter = measureSync(args.samples, function(i){
+        printer.getPrinter(printers[i % printers.length]);
+    });
+
+    return measurePrintDirect(printer, printers, args).then(function(printDirect){
+        results.printDirect = printDirect.result;
+        results.getJob = measureSync(args.samples, function(i){
+            var job = printDirect.jobIds[i % printDirect.jobIds.length];
+            printer.getJob(job.printer, job.id);
+        });
+        if(global.gc) {
+            global.gc();
+        }
+        var rssEnd = process.memoryUsage().rss;
+        results.rss = {start: rssStart, end: rssEnd, growth: rssEnd - rssStart};
+        return results;
+    });
+}
+
+var args = common.parseArgs(process.argv.slice(2), {
+    queues: 4,
+    heldJobs: 20,
+    jobs: 500,
+    size: 64 * 1024,
+    concurrency: 8,
+    samples: 200,
+    server: null,
+    out: 'bench-results.json'
+});
+common.main(args, {queues: args.queues, heldJobs: args.heldJobs, jobs: args.jobs}, run);
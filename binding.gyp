@@ -47,7 +47,9 @@
             #'-lcups -lgssapi_krb5 -lkrb5 -lk5crypto -lcom_err -lz -lpthread -lm -lcrypt -lz'
           ],
           'libraries':[
-            '<!(cups-config --libs)'
+            '<!(cups-config --libs)',
+            # deflate of compressed documents
+            '-lz'
             #'-lcups -lgssapi_krb5 -lkrb5 -lk5crypto -lcom_err -lz -lpthread -lm -lcrypt -lz'
           ],
           'link_settings': {
@@ -1,15 +1,15 @@
 ﻿var printer = require("../lib")
-	, template = "N\nS4\nD15\nq400\nR\nB20,10,0,1,2,30,173,B,\"barcode\"\nP0\n";
+	, template = printer.compileTemplate("N\nS4\nD15\nq400\nR\nB20,10,0,1,2,30,173,B,\"{{barcode}}\"\nP0\n", {language: 'epl'});
 
-function printZebra(barcode_text, printer_name){
-	printer.printDirect({data:template.replace(/barcode/, barcode_text)
-		, printer:printer_name
-		, type: "RAW"
+function printZebra(barcodes, printer_name){
+	// all the labels are rendered natively into one buffer and sent as one RAW job
+	printer.printTemplate(template, barcodes.map(function(barcode){ return {barcode: barcode}; }), {
+		printer: printer_name
 		, success:function(){
-			console.log("printed: "+barcode_text);
+			console.log("printed: "+barcodes.join(', '));
 		}
 		, error:function(err){console.log(err);}
 	});
 }
 
-printZebra("123", "ZEBRA");
+printZebra(["123", "456", "789"], "ZEBRA");
@@ -0,0 +1,20 @@
+// poll only what changed in printers and jobs
+var printer = require("../lib"),
+    version;
+
+setInterval(function(){
+    var delta = printer.getPrintersDelta(version);
+    version = delta.version;
+    if(delta.full) {
+        console.log('snapshot: ' + delta.printers.added.length + ' printers, ' + delta.jobs.added.length + ' jobs');
+        return;
+    }
+    delta.printers.added.concat(delta.printers.changed).forEach(function(p){
+        console.log('printer ' + p.name + ': ' + p.status);
+    });
+    delta.printers.removed.forEach(function(name){ console.log('printer ' + name + ' removed'); });
+    delta.jobs.added.concat(delta.jobs.changed).forEach(function(job){
+        console.log('job ' + job.id + ' on ' + job.printerName + ': ' + job.status.join(', '));
+    });
+    delta.jobs.removed.forEach(function(id){ console.log('job ' + id + ' done'); });
+}, 2000);
@@ -0,0 +1,11 @@
+// list the printers of several print servers, e.g. node getPrintersServers.js print1 print2:631
+var printer = require("../lib"),
+    servers = process.argv.slice(2);
+
+var printers = printer.getPrinters({jobs: 'none', servers: servers.length ? servers : ['localhost']});
+printers.forEach(function(p){
+    console.log(p.server + '\t' + p.name + (p.isDefault ? ' (default)' : ''));
+});
+(printers.errors || []).forEach(function(err){
+    console.error(err.server + ' did not answer: ' + err.message);
+});
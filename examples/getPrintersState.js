@@ -0,0 +1,8 @@
+// poll only the printer state: the server sends and the binding converts these attributes only
+var printer = require("../lib"),
+    util = require('util'),
+    attributes = ['printer-state', 'printer-state-reasons', 'queued-job-count'];
+
+setInterval(function(){
+    console.log(util.inspect(printer.getPrinters({jobs: 'none', attributes: attributes}), {colors:true, depth:10}));
+}, 2000);
@@ -0,0 +1,18 @@
+// use: node printBatch.js [printerName]
+var printer = require("../lib");
+
+var labels = [];
+for(var i = 1; i <= 3; ++i) {
+    labels.push({data: "label " + i + "\n", type: 'RAW', docname: "label " + i});
+}
+
+printer.printBatch({documents: labels,
+    printer: process.argv[2], // printer name, if missing then will print to default printer
+    docname: "labels batch",
+    success:function(jobID){
+        console.log("sent to printer with ID: "+jobID);
+    },
+    error:function(err){
+        console.log(err);
+    }
+});
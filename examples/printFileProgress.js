@@ -0,0 +1,22 @@
+// use: node printFileProgress.js filePath [printerName]
+// print a big file with progress, Ctrl+C cancels the job
+var printer = require("../lib"),
+    filename = process.argv[2] || __filename,
+    controller = new AbortController();
+
+process.on('SIGINT', function(){
+    controller.abort();
+});
+
+printer.printFile({
+    filename: filename,
+    printer: process.argv[3], // printer name, if missing then will print to default printer
+    signal: controller.signal,
+    progress: function(sent, total){
+        console.log('sent ' + sent + ' of ' + (total === null ? '?' : total) + ' bytes');
+    }
+}).then(function(jobID){
+    console.log("sent to printer with ID: " + jobID);
+}, function(err){
+    console.log(err.code === 'ECANCELED' ? 'cancelled' : err);
+});
@@ -0,0 +1,17 @@
+// print many jobs with the same options: the options are converted and encoded once
+// use: node printProfile.js [printer]
+var printer = require("../lib"),
+    printerName = process.argv[2] || printer.getDefaultPrinterName(),
+    draft = printer.createPrintProfile({'print-quality': '3', 'sides': 'one-sided', 'copies': '1'});
+
+console.log('profile options: ' + JSON.stringify(draft.options));
+
+var start = Date.now(), jobs = [];
+for(var i = 0; i < 20; ++i) {
+    jobs.push(printer.printDirect({data: 'draft page ' + i + '\n', printer: printerName, type: 'TEXT', profile: draft}));
+}
+Promise.all(jobs).then(function(ids){
+    console.log(ids.length + ' jobs sent in ' + (Date.now() - start) + 'ms: ' + ids.join(', '));
+}, function(err){
+    console.error(err.message);
+});
@@ -0,0 +1,16 @@
+// use: node printStream.js [filePath printerName]
+var printer = require("../lib"),
+    fs = require('fs'),
+    filename = process.argv[2] || __filename;
+
+printer.printStream({stream: fs.createReadStream(filename),
+    printer: process.argv[3], // printer name, if missing then will print to default printer
+    docname: filename,
+    type: 'RAW',
+    success:function(jobID){
+        console.log("sent to printer with ID: "+jobID);
+    },
+    error:function(err){
+        console.log(err);
+    }
+});
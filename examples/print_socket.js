@@ -0,0 +1,16 @@
+// send labels straight to a Zebra printer on its raw port (9100), without the print server
+// use: node print_socket.js socket://192.168.1.50:9100
+var printer = require("../lib"),
+    uri = process.argv[2] || 'socket://localhost:9100',
+    template = "N\nS4\nD15\nq400\nR\nB20,10,0,1,2,30,173,B,\"barcode\"\nP0\n";
+
+var start = Date.now(), labels = [];
+for(var i = 0; i < 10; ++i) {
+    // the labels share one connection and are written back to back
+    labels.push(printer.printDirect({data: template.replace(/barcode/, 'label' + i), printer: uri, type: 'RAW', timeout: 5000}));
+}
+Promise.all(labels).then(function(){
+    console.log(labels.length + ' labels written in ' + (Date.now() - start) + 'ms');
+}, function(err){
+    console.error(err.message);
+});
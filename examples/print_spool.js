@@ -0,0 +1,25 @@
+// keep printing while the CUPS server restarts: jobs go to a journal on disk and are sent once it is back
+// use: node print_spool.js [printer]
+var printer = require("../lib"),
+    printerName = process.argv[2] || printer.getDefaultPrinterName();
+
+printer.setSpoolOptions({path: __dirname + '/jobs.spool', retryInterval: 2000});
+
+var jobs = [];
+for(var i = 0; i < 5; ++i) {
+    // resolved once the job is in the journal, with its sequence number
+    jobs.push(printer.printDirect({data: 'spooled job ' + i + '\n', printer: printerName, type: 'RAW', spool: true}));
+}
+Promise.all(jobs).then(function(sequences){
+    console.log('spooled jobs ' + sequences.join(', '));
+    var timer = setInterval(function(){
+        var stats = printer.getSpoolStats();
+        console.log('pending: ' + stats.pending + ', submitted: ' + stats.submitted + (stats.lastError ? ', last error: ' + stats.lastError : ''));
+        if(stats.pending === 0) {
+            clearInterval(timer);
+            printer.setSpoolOptions({path: null});
+        }
+    }, 1000);
+}, function(err){
+    console.error(err.message);
+});
@@ -0,0 +1,15 @@
+// use: node watch.js [printerName]
+var printer = require("../lib");
+
+var watcher = printer.watch({printer: process.argv[2]}); // all printers if missing
+
+watcher.on('event', function(ev){
+    console.log(ev.event + ' ' + (ev.printerName || '') + (ev.jobId ? ' job ' + ev.jobId : '') + ' ' + (ev.status || '') + ' ' + (ev.text || ''));
+});
+watcher.on('error', function(err){
+    console.log(err);
+});
+
+process.on('SIGINT', function(){
+    watcher.close();
+});
@@ -48,6 +48,10 @@ interface PrinterDevice {
     options: {
     [key: string]: string;
     };
+    /**
+     * server of the printer, set when the server was given to getPrinters or getPrinter
+     */
+    server?: string;
 }
 
 interface PrintOptions {
@@ -64,17 +68,384 @@ interface PrintOptions {
     error?(err?: Error): void;
 }
 
-interface PrintDirectOptions extends PrintOptions {
-    data: Buffer | string;
+interface PrintProfile {
+    /**
+     * the options of the profile, as normalized by CUPS
+     */
+    readonly options: { [name: string]: string };
+}
+
+interface CompressionOptions {
+    /**
+     * 'gzip' deflates the document while it is sent, the server decompresses it (POSIX only). Default 'none'
+     */
+    compression?: 'none' | 'gzip';
+    /**
+     * 0 (fastest) to 9 (smallest), default 6
+     */
+    compressionLevel?: number;
+}
+
+interface PrintDirectOptions extends PrintOptions, CompressionOptions {
+    /**
+     * binary data is sent from its own memory without copy: do not modify it until the job is sent
+     */
+    data: Buffer | Uint8Array | ArrayBuffer | string;
+    /**
+     * socket://host[:port] printers only: ms without progress after which the job fails, default 10000
+     */
+    timeout?: number;
+    /**
+     * socket://host[:port] printers only: ms the connection is kept open after the last job, default 30000
+     */
+    idleTimeout?: number;
+    /**
+     * append the job to the journal opened by setSpoolOptions, it is sent when the server is reachable (POSIX only).
+     * The Promise is then resolved with the sequence number of the job in the journal
+     */
+    spool?: boolean;
+    /**
+     * options built by createPrintProfile, used instead of options (POSIX only)
+     */
+    profile?: PrintProfile;
+}
+
+interface LabelTemplate {
+    /**
+     * placeholder names, in order of first use
+     */
+    readonly fields: string[];
+}
+
+interface CompileTemplateOptions {
+    /**
+     * escaping of the field values: 'zpl' (^ ~ _ as _5E _7E _5F, fields need ^FH), 'epl' (quoted fields), default 'raw'
+     */
+    language?: 'raw' | 'zpl' | 'epl';
+}
+
+type PrintTemplateOptions = Pick<PrintDirectOptions, 'printer' | 'docname' | 'options' | 'timeout' | 'idleTimeout' | 'success' | 'error'>;
+
+interface PrintBatchDocument {
+    data: Buffer | Uint8Array | ArrayBuffer | string;
+    /**
+     * default RAW
+     */
+    type?: string;
+    /**
+     * default: job docname
+     */
+    docname?: string;
+}
+
+interface PrintBatchOptions extends CompressionOptions {
+    printer?: string;
+    /**
+     * job name
+     */
+    docname?: string;
+    documents: PrintBatchDocument[];
+    options?: Object;
+    success?(jobId: number): void;
+    error?(err?: Error): void;
+}
+
+interface PrintStreamOptions extends PrintOptions, CompressionOptions {
+    stream: NodeJS.ReadableStream;
+    docname?: string;
 }
 
-interface PrintFileOptions extends PrintOptions {
+interface PrintFileOptions extends PrintOptions, CompressionOptions {
     filename: string;
+    docname?: string;
+    /**
+     * options built by createPrintProfile, used instead of options
+     */
+    profile?: PrintProfile;
+    /**
+     * called while the file is sent, total is null if the size is unknown
+     */
+    progress?(bytesSent: number, total: number | null): void;
+    /**
+     * aborting cancels the job, the error has code ECANCELED
+     */
+    signal?: AbortSignal;
+}
+
+interface DestinationCacheOptions {
+    /**
+     * maximum age in milliseconds of cached destinations, 0 disables the cache
+     */
+    ttl: number;
+    /**
+     * milliseconds between two checks of the printers change times on the server, default 1000
+     */
+    checkInterval?: number;
+}
+
+interface WatchOptions {
+    /**
+     * printer to watch, all printers when missing
+     */
+    printer?: string;
+    /**
+     * watch only this job (Create-Job-Subscriptions), the watcher ends with the job
+     */
+    jobId?: number;
+    /**
+     * IPP notify-events, default: job-created, job-state-changed, job-completed, printer-state-changed
+     */
+    events?: string[];
+    /**
+     * subscription lease in seconds, renewed automatically. Default 3600
+     */
+    leaseDuration?: number;
+    /**
+     * milliseconds between two polls of the notifications, default 1000
+     */
+    interval?: number;
+}
+
+interface PrinterEvent {
+    event: string;
+    sequenceNumber: number;
+    printerName?: string;
+    jobId?: number;
+    /**
+     * job status (e.g. PRINTING, PRINTED) for job events, printer status (IDLE, PRINTING, STOPPED) otherwise
+     */
+    status?: string;
+    text?: string;
+    attributes: { [name: string]: string };
+}
+
+interface PrinterWatcher extends NodeJS.EventEmitter {
+    on(event: 'error', listener: (err: Error) => void): this;
+    on(event: string, listener: (ev: PrinterEvent) => void): this;
+    close(): void;
+}
+
+interface GetPrintersOptions {
+    /**
+     * 'eager' (default) converts active jobs with the printers, 'lazy' on first read of printer.jobs,
+     * 'none' does not retrieve them
+     */
+    jobs?: 'eager' | 'lazy' | 'none';
+    /**
+     * IPP printer attributes to retrieve, e.g. ['printer-state', 'printer-state-reasons', 'queued-job-count'].
+     * options holds only these attributes (POSIX only)
+     */
+    attributes?: string[];
+    /**
+     * print servers to query concurrently, e.g. ['print1', 'print2:631', '[::1]:631'] (POSIX only).
+     * getPrinter and getJob use only `server`
+     */
+    servers?: string[];
+    /**
+     * print server to query instead of the default one (POSIX only)
+     */
+    server?: string;
+}
+
+interface GetJobOptions {
+    /**
+     * IPP job attributes to retrieve, e.g. ['job-state', 'job-state-reasons'] (POSIX only)
+     */
+    attributes?: string[];
+    /**
+     * server of the printer, the default server if not given (POSIX only)
+     */
+    server?: string;
+}
+
+interface ServerError {
+    server: string;
+    message: string;
+}
+
+/**
+ * printers of several servers: the servers which did not answer are listed in errors (not enumerable)
+ */
+type PrinterDeviceList = PrinterDevice[] & { errors?: ServerError[] };
+
+interface RecordsDelta<Record, Key> {
+    added: Record[];
+    changed: Record[];
+    removed: Key[];
+}
+
+interface PrintersDelta {
+    /**
+     * version to pass to the next getPrintersDelta call, only valid in this process
+     */
+    version: string;
+    /**
+     * true if all printers and jobs are in added: first call, or sinceVersion unknown, of another process or too old
+     */
+    full: boolean;
+    /**
+     * printers without their jobs, removed by name ("name/instance" for lpoptions instances)
+     */
+    printers: RecordsDelta<PrinterDevice, string>;
+    /**
+     * active jobs, removed by id
+     */
+    jobs: RecordsDelta<Object, number>;
+}
+
+interface PrintQueueOptions {
+    /**
+     * jobs sent at once to a printer, default 1
+     */
+    concurrency?: number;
+    /**
+     * total size in bytes of the jobs being sent, a bigger job is sent alone. Default 64MB
+     */
+    maxInFlightBytes?: number;
+    /**
+     * queued jobs over which new jobs are rejected with an EQUEUEFULL error, default 1000
+     */
+    maxQueued?: number;
+}
+
+interface QueuedJobOptions {
+    /**
+     * higher priority jobs are sent first, default 0
+     */
+    priority?: number;
+}
+
+interface QueuedJob {
+    printer: string;
+    priority: number;
+    size: number;
+    state: 'queued' | 'printing' | 'printed' | 'failed';
+    queuedAt: number;
+    startedAt?: number;
+    jobId?: number;
+    /**
+     * resolved with the job id when neither success nor error callbacks are provided
+     */
+    promise?: Promise<number>;
+    /**
+     * remove the job if it is not sent yet
+     */
+    cancel(): boolean;
+}
+
+interface PrintQueueStats {
+    queued: number;
+    active: number;
+    inFlightBytes: number;
+    printers: { [name: string]: { queued: number; active: number } };
+    /**
+     * milliseconds from submission to the start of sending
+     */
+    waitTime: { last: number; average: number; max: number };
+}
+
+interface PrintQueue extends NodeJS.EventEmitter {
+    concurrency: number;
+    maxInFlightBytes: number;
+    maxQueued: number;
+    printDirect(options: PrintDirectOptions & QueuedJobOptions): QueuedJob;
+    printFile(options: PrintFileOptions & QueuedJobOptions): QueuedJob;
+    isFull(): boolean;
+    getStats(): PrintQueueStats;
+}
+
+interface OperationStats {
+    calls: number;
+    errors: number;
+    bytes: number;
+    /**
+     * total latency in milliseconds
+     */
+    latencySum: number;
+    /**
+     * calls per latency bucket, the last bucket is unbounded
+     */
+    latencyCounts: number[];
+}
+
+interface PrinterStats {
+    /**
+     * upper bounds in milliseconds of the latency buckets
+     */
+    latencyBuckets: number[];
+    /**
+     * by native method (e.g. getPrinters), worker (e.g. worker:printDirect) or libcups call (e.g. cupsGetDests)
+     */
+    metrics: { [operation: string]: OperationStats };
+}
+
+interface ConnectionPoolOptions {
+    /**
+     * idle connections kept for reuse, 0 closes connections after each operation. Default 4
+     */
+    size?: number;
+    /**
+     * use HTTP keep-alive, default true
+     */
+    keepAlive?: boolean;
+    /**
+     * milliseconds after which an idle connection is closed, 0 to keep them. Default 30000
+     */
+    idleTimeout?: number;
+}
+
+interface ConnectionPoolStats {
+    active: number;
+    idle: number;
+    created: number;
+    reused: number;
+}
+
+interface SpoolOptions {
+    /**
+     * file of the journal, created if missing, null to close the journal
+     */
+    path: string | null;
+    /**
+     * maximum size of the file in bytes, default 1 GiB
+     */
+    maxSize?: number;
+    /**
+     * milliseconds between two attempts while the server is unreachable, default 5000
+     */
+    retryInterval?: number;
+    /**
+     * flush each job to the disk, so that it survives a system crash. Default false
+     */
+    sync?: boolean;
+}
+
+interface SpoolStats {
+    /**
+     * null when no journal is open
+     */
+    path: string | null;
+    pending: number;
+    pendingBytes: number;
+    appended: number;
+    submitted: number;
+    /**
+     * jobs refused by the server, e.g. unknown printer, dropped from the journal
+     */
+    rejected: number;
+    retries: number;
+    compactions: number;
+    fileSize: number;
+    lastError: string;
 }
 
 declare const printer: {
-    getPrinters(): PrinterDevice[];
-    getPrinter(printerName?: string): PrinterDevice;
+    getPrinters(options?: GetPrintersOptions): PrinterDeviceList;
+    /**
+     * printers and active jobs added, changed and removed since sinceVersion (POSIX only)
+     */
+    getPrintersDelta(sinceVersion?: string): PrintersDelta;
+    getPrinter(printerName?: string, options?: GetPrintersOptions): PrinterDevice;
     /**
      * { PageSize:
      *   { '200dnp5x3.5': false,
@@ -142,12 +513,50 @@ declare const printer: {
      */
     getSelectedPaperSize(): string;
     getDefaultPrinterName(): string;
-    printDirect(options: PrintDirectOptions): void;
-    printFile(options: PrintFileOptions): void;
+    setDestinationCacheOptions(options: DestinationCacheOptions): void;
+    refreshDestinationCache(): void;
+    invalidateDestinationCache(): void;
+    setConnectionPoolOptions(options: ConnectionPoolOptions): void;
+    getStats(): PrinterStats;
+    resetStats(): void;
+    formatStatsPrometheus(stats?: PrinterStats, prefix?: string): string;
+    getConnectionPoolStats(): ConnectionPoolStats;
+    setSpoolOptions(options: SpoolOptions): void;
+    getSpoolStats(): SpoolStats;
+    /**
+     * Returns a Promise resolved with the job id when neither success nor error callbacks are provided
+     */
+    printDirect(options: PrintDirectOptions): void | Promise<number>;
+    /**
+     * build print options once for the printDirect and printFile jobs which reuse them (POSIX only)
+     */
+    createPrintProfile(options: Object): PrintProfile;
+    /**
+     * Returns a Promise resolved with the job id when neither success nor error callbacks are provided
+     */
+    printStream(options: PrintStreamOptions): void | Promise<number>;
+    /**
+     * Returns a Promise resolved with the job id when neither success nor error callbacks are provided
+     */
+    printBatch(options: PrintBatchOptions): void | Promise<number>;
+    printFile(options: PrintFileOptions): void | Promise<number>;
+    /**
+     * compile a template with {{field}} placeholders once
+     */
+    compileTemplate(source: string, options?: CompileTemplateOptions): LabelTemplate;
+    renderTemplate(template: LabelTemplate, records: Object[]): Buffer;
+    /**
+     * render all the records into one buffer and print it as a single RAW job.
+     * Returns a Promise resolved with the job id when neither success nor error callbacks are provided
+     */
+    printTemplate(template: LabelTemplate, records: Object[], options?: PrintTemplateOptions): void | Promise<number>;
+    createPrintQueue(options?: PrintQueueOptions): PrintQueue;
     getSupportedPrintFormats(): string[];
-    getJob(printerName: string, jobId: string): Object;
+    getJob(printerName: string, jobId: string, options?: GetJobOptions): Object;
+    getJobs(printerName: string, jobIds: number[], options?: { server?: string }): Array<Object | null>;
     setJob(printerName: string, jobId: string, command: string): void;
     getSupportedJobCommands(): string[];
+    watch(options?: WatchOptions): PrinterWatcher;
 };
 
 export default printer;
@@ -1,5 +1,8 @@
 var printer_helper = {},
     fs = require("fs"),
+    EventEmitter = require("events").EventEmitter,
+    PrintQueue = require("./queue").PrintQueue,
+    stats = require("./stats"),
     child_process = require("child_process"),
     os = require("os"),
     path = require("path"),
@@ -16,13 +19,39 @@ if(fs.existsSync(binding_path)) {
  */
 module.exports.getPrinters = getPrinters;
 
+/** Return what changed in printers and active jobs since a version (POSIX only)
+ */
+module.exports.getPrintersDelta = getPrintersDelta;
+
 /** send data to printer
  */
 module.exports.printDirect = printDirect;
 
+/** print options built once and reused by printDirect and printFile jobs (POSIX only)
+ */
+module.exports.createPrintProfile = createPrintProfile;
+
+/** send several documents to printer as a single job
+ */
+module.exports.printBatch = printBatch;
+
+/** send data from a Readable stream to printer, chunk by chunk
+ */
+module.exports.printStream = printStream;
+
 /// send file to printer
 module.exports.printFile = printFile;
 
+/** label templates compiled once and rendered natively, many records as one RAW job
+ */
+module.exports.compileTemplate = compileTemplate;
+module.exports.renderTemplate = renderTemplate;
+module.exports.printTemplate = printTemplate;
+
+/** create a bounded queue of print jobs with per printer concurrency, see lib/queue.js
+ */
+module.exports.createPrintQueue = createPrintQueue;
+
 /** Get supported print format for printDirect
  */
 module.exports.getSupportedPrintFormats = printer_helper.getSupportedPrintFormats;
@@ -42,11 +71,38 @@ module.exports.getPrinterDriverOptions = getPrinterDriverOptions;
 /// Return default printer name
 module.exports.getDefaultPrinterName = getDefaultPrinterName;
 
+/** cache of printer destinations used by getPrinters, getPrinter and getPrinterDriverOptions (POSIX only)
+ */
+module.exports.setDestinationCacheOptions = setDestinationCacheOptions;
+module.exports.refreshDestinationCache = printer_helper.refreshDestinationCache;
+module.exports.invalidateDestinationCache = printer_helper.invalidateDestinationCache;
+
+/** counters and latency histograms of native methods, workers and libcups calls
+ */
+module.exports.getStats = printer_helper.getStats;
+module.exports.resetStats = printer_helper.resetStats;
+module.exports.formatStatsPrometheus = formatStatsPrometheus;
+
+/** pool of connections to the CUPS server used by all operations (POSIX only)
+ */
+module.exports.setConnectionPoolOptions = setConnectionPoolOptions;
+module.exports.getConnectionPoolStats = printer_helper.getConnectionPoolStats;
+
+/** durable journal of the jobs sent with printDirect({spool: true}) (POSIX only)
+ */
+module.exports.setSpoolOptions = setSpoolOptions;
+module.exports.getSpoolStats = printer_helper.getSpoolStats;
+
 /** get printer job info object
  */
 module.exports.getJob = getJob;
+module.exports.getJobs = getJobs;
 module.exports.setJob = setJob;
 
+/** watch printer and job events. Return an EventEmitter (POSIX only)
+ */
+module.exports.watch = watch;
+
 /**
  * return user defined printer, according to https://www.cups.org/documentation.php/doc-2.0/api-cups.html#cupsGetDefault2 :
  * "Applications should use the cupsGetDests and cupsGetDest functions to get the user-defined default printer,
@@ -73,17 +129,76 @@ function getDefaultPrinterName() {
   // printer not found, return nothing(undefined)
 }
 
+/** Configure the cache of printer destinations
+ * @param options Object with the following structure:
+ *      ttl - Number, maximum age in milliseconds of cached destinations, 0 (default) disables the cache
+ *      checkInterval - Number, optional, milliseconds between two checks of printers state/config change time
+ *          on the server. Destinations are retrieved again as soon as these times moved. Default: 1000
+ */
+function setDestinationCacheOptions(options)
+{
+    options = options || {};
+    var ttl = Number(options.ttl) || 0,
+        checkInterval = (options.checkInterval === undefined) ? 1000 : Number(options.checkInterval);
+
+    printer_helper.setDestinationCacheOptions(ttl, checkInterval);
+}
+
+/** Prometheus text exposition of the statistics
+ * @param {Object} [statistics] result of getStats(), current statistics if missing
+ * @param {String} [prefix] metric names prefix. Default: node_printer
+ */
+function formatStatsPrometheus(statistics, prefix)
+{
+    return stats.formatPrometheus(statistics || printer_helper.getStats(), prefix);
+}
+
+function createPrintQueue(options)
+{
+    return new PrintQueue(module.exports, options);
+}
+
+function setConnectionPoolOptions(options)
+{
+    options = options || {};
+    var size = (options.size === undefined) ? 4 : Number(options.size),
+        keepAlive = (options.keepAlive === undefined) ? true : !!options.keepAlive,
+        idleTimeout = (options.idleTimeout === undefined) ? 30000 : Number(options.idleTimeout);
+
+    printer_helper.setConnectionPoolOptions(size, keepAlive, idleTimeout);
+}
+
+/** Open the spool journal used by printDirect({spool: true}), or close it
+ * @param options {path, maxSize, retryInterval, sync}:
+ *  - path: file of the journal, created if missing. Its pending jobs are sent again. null closes the journal
+ *  - maxSize: maximum size of the file in bytes, default 1 GiB
+ *  - retryInterval: ms between two attempts while the server is unreachable, default 5000
+ *  - sync: flush each job to the disk before it is acknowledged, default false: jobs then survive
+ *    a crash of the process but not of the system
+ */
+function setSpoolOptions(options)
+{
+    options = options || {};
+    var path = options.path ? String(options.path) : null,
+        maxSize = (options.maxSize === undefined) ? 1024 * 1024 * 1024 : Number(options.maxSize),
+        retryInterval = (options.retryInterval === undefined) ? 5000 : Number(options.retryInterval);
+
+    printer_helper.setSpoolOptions(path, maxSize, retryInterval, !!options.sync);
+}
+
 /** Get printer info with jobs
  * @param printerName printer name to extract the info
+ * @param options optional, {jobs: 'eager' | 'lazy' | 'none', attributes: [...], server: 'host:port'} see getPrinters
  * @return printer object info:
  *		TODO: to enum all possible attributes
  */
-function getPrinter(printerName)
+function getPrinter(printerName, options)
 {
     if(!printerName) {
         printerName = getDefaultPrinterName();
     }
-    var printer = printer_helper.getPrinter(printerName);
+    options = options || {};
+    var printer = printer_helper.getPrinter(printerName, options.jobs, options.attributes, options.server);
     correctPrinterinfo(printer);
     return printer;
 }
@@ -117,9 +232,29 @@ function getSelectedPaperSize(printerName){
     return selectedSize;
 }
 
-function getJob(printerName, jobId)
+/** Get job info
+ * @param printerName printer name of the job
+ * @param jobId job id
+ * @param options optional, {attributes: [...]} IPP job attributes to retrieve (POSIX only), e.g.
+ *  ['job-state', 'job-state-reasons']: the job object holds only the matching properties
+ *  (job-state: status, job-k-octets: size, ...) and the other attributes by their IPP name,
+ *  and {server: 'host:port'} the server of the printer (POSIX only), the default server if not given
+ */
+function getJob(printerName, jobId, options)
+{
+    options = options || {};
+    return printer_helper.getJob(printerName, jobId, options.attributes, options.server);
+}
+
+/** Get info of several jobs in one pass
+ * @param printerName printer name of the jobs
+ * @param jobIds Array of job ids
+ * @param options optional, {server: 'host:port'} the server of the printer (POSIX only)
+ * @return Array of job info objects in the same order as jobIds, null for unknown jobs
+ */
+function getJobs(printerName, jobIds, options)
 {
-    return printer_helper.getJob(printerName, jobId);
+    return printer_helper.getJobs(printerName, jobIds, (options || {}).server);
 }
 
 function setJob(printerName, jobId, command)
@@ -127,8 +262,100 @@ function setJob(printerName, jobId, command)
     return printer_helper.setJob(printerName, jobId, command);
 }
 
-function getPrinters(){
-    var printers = printer_helper.getPrinters();
+var JOB_STATE_STATUS = {
+    'pending': 'PENDING',
+    'pending-held': 'PAUSED',
+    'processing': 'PRINTING',
+    'processing-stopped': 'PAUSED',
+    'canceled': 'CANCELLED',
+    'aborted': 'ABORTED',
+    'completed': 'PRINTED'
+};
+
+var PRINTER_STATE_STATUS = {
+    'idle': 'IDLE',
+    'processing': 'PRINTING',
+    'stopped': 'STOPPED'
+};
+
+/** Watch printer and job events
+ * @param {Object} [options]
+ *  - printer: printer name, all printers if missing
+ *  - jobId: watch only this job (Create-Job-Subscriptions), the watcher ends with the job
+ *  - events: IPP event names. Default: job-created, job-state-changed, job-completed, printer-state-changed
+ *  - leaseDuration: subscription lease in seconds, renewed automatically. Default: 3600
+ *  - interval: delay in ms between two polls. Default: 1000
+ * @return EventEmitter emitting every notification under its event name and as 'event', plus 'error'
+ *  which throws without a listener. A subscription refused by the server (unknown printer or job,
+ *  unsupported event) is reported once and ends the watcher. Call close() to cancel the subscription.
+ */
+function watch(options)
+{
+    options = options || {};
+    var events = options.events || ['job-created', 'job-state-changed', 'job-completed', 'printer-state-changed'],
+        emitter = new EventEmitter();
+
+    var handle = printer_helper.watchNotifications(options.printer || '', events,
+        options.leaseDuration === undefined ? 3600 : options.leaseDuration,
+        options.interval === undefined ? 1000 : options.interval,
+        function(err, notifications) {
+            if(err) {
+                emitter.emit('error', err);
+                return;
+            }
+            notifications.forEach(function(notification) {
+                var ev = parseNotification(notification);
+                emitter.emit(ev.event, ev);
+                emitter.emit('event', ev);
+            });
+        }, options.jobId || 0);
+
+    emitter.close = function() {
+        handle.close();
+    };
+    return emitter;
+}
+
+function parseNotification(notification)
+{
+    var attributes = notification.attributes,
+        ev = {
+            event: notification.event,
+            sequenceNumber: notification.sequenceNumber,
+            printerName: attributes['printer-name'],
+            text: attributes['notify-text'],
+            attributes: attributes
+        };
+    if(attributes['notify-job-id']) {
+        ev.jobId = parseInt(attributes['notify-job-id'], 10);
+        ev.status = JOB_STATE_STATUS[attributes['job-state']];
+    } else if(attributes['printer-state']) {
+        ev.status = PRINTER_STATE_STATUS[attributes['printer-state']];
+    }
+    return ev;
+}
+
+/** Get all printers
+ * @param options optional, {jobs: mode} where mode is one of (POSIX only):
+ *  - 'eager' (default): printer.jobs holds the active jobs
+ *  - 'lazy': jobs are converted on first read of printer.jobs
+ *  - 'none': jobs are not retrieved
+ *  and {attributes: [...]} IPP printer attributes to retrieve (POSIX only), e.g.
+ *  ['printer-state', 'printer-state-reasons', 'queued-job-count']: they are sent as requested-attributes
+ *  and printer.options holds only them. The printers are then queried from the server, without lpoptions
+ *  instances nor the destination cache.
+ *  and {servers: ['host', 'host:port', ...]} or {server: 'host:port'} print servers to query (POSIX only):
+ *  the servers are queried concurrently, each printer has a `server` property, and the servers which
+ *  failed are listed in the non enumerable printers.errors ([{server, message}]). An error is thrown only
+ *  if no server answered.
+ */
+function getPrinters(options){
+    options = options || {};
+    var servers = options.servers;
+    if(servers === undefined && options.server !== undefined) {
+        servers = [options.server];
+    }
+    var printers = printer_helper.getPrinters(options.jobs, options.attributes, servers);
     if(printers && printers.length){
         var i = printers.length;
         for(i in printers){
@@ -138,6 +365,20 @@ function getPrinters(){
     return printers;
 }
 
+/** Get the printers and active jobs added, changed and removed since a version
+ * @param sinceVersion optional, `version` string of a previous result; a full snapshot (full: true) is returned
+ *  without it or when the version is too old or of another process (versions restart with the process)
+ * @return {version, full, printers: {added, changed, removed}, jobs: {added, changed, removed}}:
+ *  added and changed hold printer (without jobs) and job objects, removed holds printer names and job ids.
+ *  Jobs which are no longer active (e.g. completed) are removed.
+ */
+function getPrintersDelta(sinceVersion){
+    var delta = printer_helper.getPrintersDelta(sinceVersion);
+    delta.printers.added.forEach(correctPrinterinfo);
+    delta.printers.changed.forEach(correctPrinterinfo);
+    return delta;
+}
+
 function correctPrinterinfo(printer) {
     if(printer.status || !printer.options || !printer.options['printer-state']){
         return;
@@ -167,15 +408,29 @@ function correctPrinterinfo(printer) {
 }
 
 /*
- print raw data. This function is intend to be asynchronous
+ print raw data. This function is asynchronous: the job is sent from a native worker thread,
+ so the event loop is not blocked while the document is uploaded.
 
  parameters:
  parameters - Object, parameters objects with the following structure:
- data - String, mandatory, data to printer
- printer - String, optional, name of the printer, if missing, will try to print to default printer
+ data - String/Buffer/Uint8Array/ArrayBuffer, mandatory, data to printer. Binary data is sent from its own memory
+        without a copy, so it should not be modified until the job is sent
+ printer - String, optional, name of the printer, if missing, will try to print to default printer.
+           'socket://host[:port]' (POSIX only) sends RAW data straight to the device on its AppSocket port
+           (9100 by default) without the print server: jobs of a device share a persistent connection
+           and the job id is local to the process
  docname - String, optional, name of document showed in printer status
  type - String, optional, only for wind32, data type, one of the RAW, TEXT
  options - JS object with CUPS options, optional
+ profile - handle of createPrintProfile, optional (POSIX only), used instead of options
+ compression - String, optional, 'none' (default) or 'gzip' (POSIX only): the document is deflated while it is
+               sent and the server decompresses it. Useful for remote servers, see getStats() for the bytes saved
+ compressionLevel - Number, optional, 0 (fastest) to 9 (smallest), default 6
+ timeout - Number, optional, socket:// printers only, ms without progress after which the job fails, default 10000
+ idleTimeout - Number, optional, socket:// printers only, ms the connection is kept open after the last job, default 30000
+ spool - Boolean, optional (POSIX only), append the job to the journal opened by setSpoolOptions instead of sending it:
+         it is sent by a native thread as soon as the server is reachable, at least once. Resolved with the
+         sequence number of the job in the journal, not a job id
  success - Function, optional, callback function
  error - Function, optional, callback function if exists any error
 
@@ -188,6 +443,8 @@ function correctPrinterinfo(printer) {
  options - JS object with CUPS options, optional
  success - Function, optional, callback function with first argument job_id
  error - Function, optional, callback function if exists any error
+
+ returns a Promise resolved with the job id if neither success nor error callbacks are provided
  */
 function printDirect(parameters){
     var data = parameters
@@ -195,8 +452,14 @@ function printDirect(parameters){
         , docname
         , type
         , options
+        , compression
+        , compressionLevel
+        , timeout
+        , idleTimeout
+        , spool
         , success
-        , error;
+        , error
+        , promise;
 
     if(arguments.length==1){
         //TODO: check parameters type
@@ -205,7 +468,12 @@ function printDirect(parameters){
         printer = parameters.printer;
         docname = parameters.docname;
         type = parameters.type;
-        options = parameters.options||{};
+        options = parameters.profile||parameters.options||{};
+        compression = parameters.compression;
+        compressionLevel = parameters.compressionLevel;
+        timeout = parameters.timeout;
+        idleTimeout = parameters.idleTimeout;
+        spool = parameters.spool;
         success = parameters.success;
         error = parameters.error;
     }else{
@@ -217,6 +485,23 @@ function printDirect(parameters){
         error = arguments[6];
     }
 
+    if(!success && !error && typeof Promise === 'function'){
+        promise = new Promise(function(resolve, reject){
+            success = resolve;
+            error = reject;
+        });
+    }
+
+    if(!success){
+        success = function(){};
+    }
+
+    if(!error){
+        error = function(err){
+            throw err;
+        };
+    }
+
     if(!type){
         type = "RAW";
     }
@@ -237,9 +522,54 @@ function printDirect(parameters){
     }
 
     //TODO: check parameters type
-    if(printer_helper.printDirect){// call C++ binding
+    if(spool){// call C++ binding, the job is sent later from the spool journal
+        try{
+            if(/^socket:\/\//i.test(printer)){
+                throw new Error('socket:// printers can not be spooled');
+            }
+            printer_helper.printSpool(data, printer, docname, type, options, function(err, res){
+                if(err){
+                    error(err);
+                }else{
+                    success(res);
+                }
+            }, compression, compressionLevel);
+        }catch (e){
+            error(e);
+        }
+    }else if(/^socket:\/\//i.test(printer)){// call C++ binding, data is written to the device by the socket I/O thread
+        try{
+            if(type !== 'RAW'){
+                throw new Error('socket:// printers only accept RAW data');
+            }
+            printer_helper.printSocket(printer, data, (timeout === undefined) ? 10000 : timeout,
+                                       (idleTimeout === undefined) ? 30000 : idleTimeout, function(err, res){
+                if(err){
+                    error(err);
+                }else{
+                    success(res);
+                }
+            });
+        }catch (e){
+            error(e);
+        }
+    }else if(printer_helper.printDirectAsync){// call C++ binding, job is sent from a worker thread
+        try{
+            printer_helper.printDirectAsync(data, printer, docname, type, options, function(err, res){
+                if(err){
+                    error(err);
+                }else if(res){
+                    success(res);
+                }else{
+                    error(Error("Something wrong in printDirect"));
+                }
+            }, compression, compressionLevel);
+        }catch (e){
+            error(e);
+        }
+    }else if(printer_helper.printDirect){// call C++ binding
         try{
-            var res = printer_helper.printDirect(data, printer, docname, type, options);
+            var res = printer_helper.printDirect(data, printer, docname, type, options, compression, compressionLevel);
             if(res){
                 success(res);
             }else{
@@ -251,24 +581,350 @@ function printDirect(parameters){
     }else{
         error("Not supported");
     }
+
+    return promise;
+}
+
+/** Build print options once for the jobs which reuse them
+ * @param options JS object with CUPS options, e.g. {media: 'A4', sides: 'two-sided-long-edge'}
+ * @return profile handle to pass as printDirect/printFile `profile`: its jobs share the native options
+ *  and their IPP encoding, instead of converting `options` for each job. profile.options holds the options
+ */
+function createPrintProfile(options)
+{
+    return printer_helper.createPrintProfile(options || {});
+}
+
+/** Compile a label template
+ * @param source String, template with {{field}} placeholders, e.g. "^XA^FO50,50^FH^FD{{name}}^FS^XZ"
+ * @param options optional, {language: 'raw' | 'zpl' | 'epl'} escaping of the field values, default 'raw':
+ *  - 'zpl': ^ ~ _ become the _5E _7E _5F field hex escapes, so the fields must follow ^FH
+ *  - 'epl': " and \ are escaped with \ and line breaks replaced by spaces, for quoted fields
+ * @return template handle, template.fields holds the placeholder names
+ */
+function compileTemplate(source, options)
+{
+    return printer_helper.compileTemplate(source, (options || {}).language || 'raw');
+}
+
+/** Render records with a compiled template into one Buffer
+ * @param template handle returned by compileTemplate
+ * @param records Array of objects with the field values
+ */
+function renderTemplate(template, records)
+{
+    return printer_helper.renderTemplate(template, records);
+}
+
+/** Print records with a compiled template: all the records are rendered natively into one buffer,
+ * sent as a single RAW job
+ * @param template handle returned by compileTemplate
+ * @param records Array of objects with the field values
+ * @param options optional, printDirect parameters but data and type: printer (socket:// too), docname,
+ *  options, timeout, idleTimeout, success, error
+ * @return a Promise resolved with the job id if neither success nor error callbacks are provided
+ */
+function printTemplate(template, records, options)
+{
+    var parameters = {}, data;
+    options = options || {};
+    Object.keys(options).forEach(function(key){
+        parameters[key] = options[key];
+    });
+    try {
+        data = renderTemplate(template, records);
+    } catch(e) {
+        if(options.success || options.error || typeof Promise !== 'function') {
+            if(options.error) {
+                options.error(e);
+            }
+            return;
+        }
+        return Promise.reject(e);
+    }
+    parameters.data = data;
+    parameters.type = 'RAW';
+    return printDirect(parameters);
+}
+
+/*
+ print several documents as one job: the job is created once and every document is sent in it,
+ which saves the job setup of the scheduler and a request per document.
+
+ parameters:
+ parameters - Object, parameters objects with the following structure:
+ documents - Array, mandatory, of objects {data: String or Buffer, type: String (default RAW), docname: String (default job name)}
+ printer - String, optional, name of the printer, if missing, will try to print to default printer
+ docname - String, optional, name of the job showed in printer status
+ options - JS object with CUPS options, optional
+ compression, compressionLevel - optional, compression of each document, see printDirect
+ success - Function, optional, callback function with first argument job_id
+ error - Function, optional, callback function if exists any error
+
+ returns a Promise resolved with the job id if neither success nor error callbacks are provided
+ */
+function printBatch(parameters){
+    var documents,
+        printer,
+        docname,
+        options,
+        success,
+        error,
+        promise;
+
+    if((arguments.length !== 1) || (typeof(parameters) !== 'object')){
+        throw new Error('must provide arguments object');
+    }
+
+    documents = parameters.documents;
+    printer = parameters.printer;
+    docname = parameters.docname || "node print job";
+    options = parameters.options || {};
+    success = parameters.success;
+    error = parameters.error;
+
+    if(!success && !error && typeof Promise === 'function'){
+        promise = new Promise(function(resolve, reject){
+            success = resolve;
+            error = reject;
+        });
+    }
+
+    if(!success){
+        success = function(){};
+    }
+
+    if(!error){
+        error = function(err){
+            throw err;
+        };
+    }
+
+    if(!Array.isArray(documents) || !documents.length){
+        error(new Error('must provide at least one document'));
+        return promise;
+    }
+
+    // Set default printer name
+    if(!printer) {
+        printer = getDefaultPrinterName();
+    }
+
+    if(!printer_helper.printBatch){
+        error(new Error("Not supported"));
+        return promise;
+    }
+
+    documents = documents.map(function(document){
+        return {
+            data: document.data,
+            type: (document.type || "RAW").toUpperCase(),
+            docname: document.docname || docname
+        };
+    });
+
+    try{
+        printer_helper.printBatch(printer, docname, options, documents, function(err, res){
+            if(err){
+                error(err);
+            }else{
+                success(res);
+            }
+        }, parameters.compression, parameters.compressionLevel);
+    }catch (e){
+        error(e);
+    }
+    return promise;
+}
+
+/*
+ print data coming from a Readable stream. The job is opened before the data is read and every chunk
+ is sent to the printer as soon as it is available, so the document is never held in memory.
+ The stream is paused while a chunk is being sent (backpressure).
+
+ parameters:
+ parameters - Object, parameters objects with the following structure:
+ stream - Readable stream, mandatory, data to printer
+ printer - String, optional, name of the printer, if missing, will try to print to default printer
+ docname - String, optional, name of document showed in printer status
+ type - String, optional, data type, one of the RAW, TEXT
+ options - JS object with CUPS options, optional
+ compression, compressionLevel - optional, compression of the document, see printDirect
+ success - Function, optional, callback function with first argument job_id
+ error - Function, optional, callback function if exists any error
+
+ returns a Promise resolved with the job id if neither success nor error callbacks are provided
+ */
+function printStream(parameters){
+    var source,
+        printer,
+        docname,
+        type,
+        options,
+        success,
+        error,
+        promise;
+
+    if((arguments.length !== 1) || (typeof(parameters) !== 'object')){
+        throw new Error('must provide arguments object');
+    }
+
+    source = parameters.stream;
+    printer = parameters.printer;
+    docname = parameters.docname || "node print job";
+    type = (parameters.type || "RAW").toUpperCase();
+    options = parameters.options || {};
+    success = parameters.success;
+    error = parameters.error;
+
+    if(!success && !error && typeof Promise === 'function'){
+        promise = new Promise(function(resolve, reject){
+            success = resolve;
+            error = reject;
+        });
+    }
+
+    if(!success){
+        success = function(){};
+    }
+
+    if(!error){
+        error = function(err){
+            throw err;
+        };
+    }
+
+    if(!source || typeof(source.on) !== 'function'){
+        error(new Error('must provide a readable stream'));
+        return promise;
+    }
+
+    // Set default printer name
+    if(!printer) {
+        printer = getDefaultPrinterName();
+    }
+
+    if(!printer_helper.printStreamStart){
+        error(new Error("Not supported"));
+        return promise;
+    }
+
+    var job = null,
+        busy = false, // a write or finish is running, the job accepts one operation at a time
+        ended = false,
+        finished = false,
+        failure = null;
+
+    function cancel(){
+        busy = true;
+        job.cancel(function(){
+            error(failure);
+        });
+    }
+
+    function fail(err){
+        if(failure || finished){
+            return;
+        }
+        failure = err;
+        // an opening job or a running operation will cancel on its completion
+        if(job && !busy){
+            cancel();
+        }
+    }
+
+    function finish(){
+        busy = true;
+        job.finish(function(err, jobId){
+            busy = false;
+            if(err){
+                finished = true;
+                return error(err);
+            }
+            if(failure){
+                return cancel();
+            }
+            finished = true;
+            success(jobId);
+        });
+    }
+
+    source.on('error', fail);
+
+    try{
+        printer_helper.printStreamStart(printer, docname, type, options, function(err, openedJob){
+            if(err){
+                failure = failure || err;
+                return error(err);
+            }
+            job = openedJob;
+            if(failure){
+                return cancel();
+            }
+            source.on('data', function(chunk){
+                if(failure){
+                    return;
+                }
+                busy = true;
+                source.pause();
+                job.write(chunk, function(err){
+                    busy = false;
+                    if(err){
+                        fail(err);
+                    }else if(failure){
+                        cancel();
+                    }else if(ended){
+                        finish();
+                    }else{
+                        source.resume();
+                    }
+                });
+            });
+            source.on('end', function(){
+                ended = true;
+                // the last write may still be running
+                if(!failure && !busy){
+                    finish();
+                }
+            });
+            source.resume();
+        }, parameters.compression, parameters.compressionLevel);
+    }catch(e){
+        error(e);
+    }
+
+    return promise;
 }
 
 /**
+print a file. The file is read and sent in chunks from a native worker thread (POSIX), so big files
+neither block the event loop nor are loaded in memory.
+
 parameters:
    parameters - Object, parameters objects with the following structure:
       filename - String, mandatory, data to printer
       docname - String, optional, name of document showed in printer status
       printer - String, optional, mane of the printer, if missed, will try to retrieve the default printer name
-      success - Function, optional, callback function
+      type - String, optional, data type (RAW, PDF, ...), detected by the server if missing
+      options - JS object with CUPS options, optional
+      profile - handle of createPrintProfile, optional, used instead of options
+      compression, compressionLevel - optional, compression of the file, see printDirect
+      progress - Function, optional, called as progress(bytesSent, total) while the file is sent
+      signal - AbortSignal, optional, aborting it cancels the job: error gets an Error with code ECANCELED
+      success - Function, optional, callback function with first argument job_id
       error - Function, optional, callback function if exists any error
+
+returns a Promise resolved with the job id if neither success nor error callbacks are provided
 */
 function printFile(parameters){
     var filename,
         docname,
         printer,
         options,
+        signal,
         success,
-        error;
+        error,
+        promise;
 
     if((arguments.length !== 1) || (typeof(parameters) !== 'object')){
         throw new Error('must provide arguments object');
@@ -277,10 +933,18 @@ function printFile(parameters){
     filename = parameters.filename;
     docname = parameters.docname;
     printer = parameters.printer;
-    options = parameters.options || {};
+    options = parameters.profile || parameters.options || {};
+    signal = parameters.signal;
     success = parameters.success;
     error = parameters.error;
 
+    if(!success && !error && typeof Promise === 'function'){
+        promise = new Promise(function(resolve, reject){
+            success = resolve;
+            error = reject;
+        });
+    }
+
     if(!success){
         success = function(){};
     }
@@ -293,7 +957,8 @@ function printFile(parameters){
 
     if(!filename){
         var err = new Error('must provide at least a filename');
-        return error(err);
+        error(err);
+        return promise;
     }
 
     // try to define default printer name
@@ -302,7 +967,8 @@ function printFile(parameters){
     }
 
     if(!printer) {
-        return error(new Error('Printer parameter of default printer is not defined'));
+        error(new Error('Printer parameter of default printer is not defined'));
+        return promise;
     }
 
     // set filename if docname is missing
@@ -310,8 +976,44 @@ function printFile(parameters){
         docname = filename;
     }
 
+    function cancelledError(){
+        var err = new Error('print job cancelled');
+        err.code = 'ECANCELED';
+        return err;
+    }
+
+    if(signal && signal.aborted){
+        error(cancelledError());
+        return promise;
+    }
+
     //TODO: check parameters type
-    if(printer_helper.printFile){// call C++ binding
+    if(printer_helper.printFileAsync){// call C++ binding, the file is sent from a worker thread
+        try{
+            var job,
+                cancelled = false,
+                onAbort = function(){
+                    cancelled = true;
+                    job.cancel();
+                };
+            job = printer_helper.printFileAsync(filename, docname, printer, (parameters.type || "").toUpperCase(), options,
+                parameters.progress || null, function(err, res){
+                    if(signal){
+                        signal.removeEventListener('abort', onAbort);
+                    }
+                    if(err){
+                        error(cancelled ? cancelledError() : err);
+                    }else{
+                        success(res);
+                    }
+                }, parameters.compression, parameters.compressionLevel);
+            if(signal){
+                signal.addEventListener('abort', onAbort);
+            }
+        } catch (e) {
+            error(e);
+        }
+    } else if(printer_helper.printFile){// call C++ binding
         try{
             // TODO: proper success/error callbacks from the extension
             var res = printer_helper.printFile(filename, docname, printer, options);
@@ -325,6 +1027,7 @@ function printFile(parameters){
             error(e);
         }
     } else {
-        error("Not supported");
+        error(new Error("Not supported"));
     }
+    return promise;
 }
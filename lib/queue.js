@@ -0,0 +1,294 @@
+var EventEmitter = require("events").EventEmitter,
+    util = require("util"),
+    fs = require("fs");
+
+/** Bounded queue of print jobs.
+ * Jobs are sent through the native asynchronous binding, at most `concurrency` jobs at once per printer,
+ * while the size of the data being sent stays under `maxInFlightBytes`.
+ * Queued jobs are started by priority (higher first), then in submission order.
+ *
+ * @param {Object} printer module with printDirect and printFile functions
+ * @param {Object} [options]
+ *  - concurrency: jobs sent at once to a printer. Default: 1
+ *  - maxInFlightBytes: total size of the jobs being sent. A bigger job is sent alone. Default: 64MB
+ *  - maxQueued: queued jobs (not yet sent) over which new jobs are rejected. Default: 1000
+ *
+ * Emits 'drain' when the queue accepts jobs again after being full, and 'idle' when every job is done.
+ */
+function PrintQueue(printer, options)
+{
+    EventEmitter.call(this);
+    options = options || {};
+    this._printer = printer;
+    this.concurrency = Math.max(1, Number(options.concurrency) || 1);
+    this.maxInFlightBytes = (options.maxInFlightBytes === undefined) ? 64 * 1024 * 1024 : Number(options.maxInFlightBytes);
+    this.maxQueued = (options.maxQueued === undefined) ? 1000 : Number(options.maxQueued);
+    this._printers = {};
+    this._queued = 0;
+    this._active = 0;
+    this._inFlightBytes = 0;
+    this._sequence = 0;
+    this._wasFull = false;
+    this._wait = {count: 0, total: 0, max: 0, last: 0};
+}
+util.inherits(PrintQueue, EventEmitter);
+
+/** Queue a printDirect job
+ * @param {Object} parameters printDirect parameters, plus optional `priority` (Number, default 0)
+ * @return {QueuedJob} handle of the job. Without success/error callbacks, handle.promise is resolved with the job id
+ */
+PrintQueue.prototype.printDirect = function(parameters)
+{
+    var data = parameters.data,
+        size = 0;
+    if(typeof data === 'string') {
+        size = Buffer.byteLength(data);
+    } else if(data && data.byteLength !== undefined) {
+        size = data.byteLength;
+    }
+    return this._push('printDirect', parameters, size);
+};
+
+/** Queue a printFile job
+ * @param {Object} parameters printFile parameters, plus optional `priority` (Number, default 0)
+ * @return {QueuedJob} handle of the job
+ */
+PrintQueue.prototype.printFile = function(parameters)
+{
+    var size = 0;
+    try {
+        size = fs.statSync(parameters.filename).size;
+    } catch(e) {
+        // reported by printFile
+    }
+    return this._push('printFile', parameters, size);
+};
+
+/// true when new jobs are rejected until 'drain'
+PrintQueue.prototype.isFull = function()
+{
+    return this._queued >= this.maxQueued;
+};
+
+/** Queue statistics
+ * @return {Object} {queued, active, inFlightBytes, printers: {name: {queued, active}}, waitTime: {last, average, max}}
+ *  wait times are in milliseconds, from submission to the start of sending
+ */
+PrintQueue.prototype.getStats = function()
+{
+    var printers = {}, name, state;
+    for(name in this._printers) {
+        state = this._printers[name];
+        printers[name] = {queued: state.queue.length, active: state.active};
+    }
+    return {
+        queued: this._queued,
+        active: this._active,
+        inFlightBytes: this._inFlightBytes,
+        printers: printers,
+        waitTime: {
+            last: this._wait.last,
+            average: this._wait.count ? this._wait.total / this._wait.count : 0,
+            max: this._wait.max
+        }
+    };
+};
+
+PrintQueue.prototype._push = function(method, parameters, size)
+{
+    var self = this,
+        job = new QueuedJob(this, method, parameters, size);
+
+    if(this.isFull()) {
+        this._wasFull = true;
+        var err = new Error('print queue is full');
+        err.code = 'EQUEUEFULL';
+        job.state = 'failed';
+        process.nextTick(function() {
+            job._settle(err);
+        });
+        return job;
+    }
+
+    var name = job.printer,
+        state = this._printers[name] || (this._printers[name] = {queue: [], active: 0}),
+        queue = state.queue,
+        i = queue.length;
+    // keep the queue sorted by priority, FIFO for same priority
+    while(i > 0 && queue[i - 1].priority < job.priority) {
+        --i;
+    }
+    queue.splice(i, 0, job);
+    ++this._queued;
+
+    // start from next tick: the caller gets the handle before any callback
+    process.nextTick(function() {
+        self._pump();
+    });
+    return job;
+};
+
+/// Start as many queued jobs as limits allow
+PrintQueue.prototype._pump = function()
+{
+    for(;;) {
+        var best = null, name, state, head;
+        // best queued job among printers with a free slot
+        for(name in this._printers) {
+            state = this._printers[name];
+            if(state.active >= this.concurrency || !state.queue.length) {
+                continue;
+            }
+            head = state.queue[0];
+            if(!best || head.priority > best.priority || (head.priority === best.priority && head._sequence < best._sequence)) {
+                best = head;
+            }
+        }
+        if(!best || (this._inFlightBytes > 0 && this._inFlightBytes + best.size > this.maxInFlightBytes)) {
+            return;
+        }
+        this._start(best);
+    }
+};
+
+PrintQueue.prototype._start = function(job)
+{
+    var self = this,
+        state = this._printers[job.printer],
+        waited = Date.now() - job.queuedAt,
+        parameters = {}, k;
+
+    state.queue.shift();
+    --this._queued;
+    ++state.active;
+    ++this._active;
+    this._inFlightBytes += job.size;
+    this._wait.count++;
+    this._wait.total += waited;
+    this._wait.last = waited;
+    this._wait.max = Math.max(this._wait.max, waited);
+    job.state = 'printing';
+    job.startedAt = Date.now();
+
+    for(k in job._parameters) {
+        parameters[k] = job._parameters[k];
+    }
+    parameters.success = function(jobId) {
+        self._done(job, null, jobId);
+    };
+    parameters.error = function(err) {
+        self._done(job, (err instanceof Error) ? err : new Error(String(err)));
+    };
+    try {
+        this._printer[job._method](parameters);
+    } catch(e) {
+        parameters.error(e);
+    }
+
+    if(this._wasFull && !this.isFull()) {
+        this._wasFull = false;
+        this.emit('drain');
+    }
+};
+
+PrintQueue.prototype._done = function(job, err, jobId)
+{
+    var self = this;
+    // the printer may complete synchronously from _start: completing on the next tick
+    // keeps a run of failing jobs from recursing through _pump and _start
+    process.nextTick(function() {
+        self._complete(job, err, jobId);
+    });
+};
+
+PrintQueue.prototype._complete = function(job, err, jobId)
+{
+    var state = this._printers[job.printer];
+    --state.active;
+    --this._active;
+    this._inFlightBytes -= job.size;
+    if(!state.active && !state.queue.length) {
+        delete this._printers[job.printer];
+    }
+    job._settle(err, jobId);
+    this._pump();
+    if(!this._active && !this._queued) {
+        this.emit('idle');
+    }
+};
+
+PrintQueue.prototype._cancel = function(job)
+{
+    var state = this._printers[job.printer],
+        i = state ? state.queue.indexOf(job) : -1;
+    if(i < 0) {
+        return false;
+    }
+    state.queue.splice(i, 1);
+    --this._queued;
+    if(!state.active && !state.queue.length) {
+        delete this._printers[job.printer];
+    }
+    var err = new Error('print job cancelled before being sent');
+    err.code = 'ECANCELED';
+    job._settle(err);
+    if(this._wasFull && !this.isFull()) {
+        this._wasFull = false;
+        this.emit('drain');
+    }
+    return true;
+};
+
+/** Handle of a queued job
+ * state: 'queued', 'printing', 'printed' or 'failed'
+ */
+function QueuedJob(queue, method, parameters, size)
+{
+    var self = this;
+    this._queue = queue;
+    this._method = method;
+    this._parameters = parameters;
+    this._sequence = queue._sequence++;
+    this.printer = parameters.printer || '';
+    this.priority = Number(parameters.priority) || 0;
+    this.size = size;
+    this.state = 'queued';
+    this.queuedAt = Date.now();
+    this.startedAt = undefined;
+    this.jobId = undefined;
+
+    this._success = parameters.success;
+    this._error = parameters.error;
+    if(!this._success && !this._error && typeof Promise === 'function') {
+        this.promise = new Promise(function(resolve, reject) {
+            self._success = resolve;
+            self._error = reject;
+        });
+    }
+}
+
+/** Remove the job from the queue if it is not sent yet
+ * @return true if the job was removed, its error callback is called with an ECANCELED error
+ */
+QueuedJob.prototype.cancel = function()
+{
+    return this.state === 'queued' && this._queue._cancel(this);
+};
+
+QueuedJob.prototype._settle = function(err, jobId)
+{
+    if(err) {
+        this.state = 'failed';
+        if(this._error) {
+            this._error(err);
+        }
+    } else {
+        this.state = 'printed';
+        this.jobId = jobId;
+        if(this._success) {
+            this._success(jobId);
+        }
+    }
+};
+
+module.exports.PrintQueue = PrintQueue;
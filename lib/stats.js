@@ -0,0 +1,47 @@
+/** Prometheus text exposition of getStats() results
+ * @param {Object} stats result of getStats()
+ * @param {String} [prefix] metric names prefix. Default: node_printer
+ * @return {String} metrics in the Prometheus text format (version 0.0.4)
+ */
+function formatPrometheus(stats, prefix)
+{
+    prefix = prefix || 'node_printer';
+    var lines = [],
+        names = Object.keys(stats.metrics),
+        bounds = stats.latencyBuckets;
+
+    function label(name) {
+        return '{operation="' + name.replace(/\\/g, '\\\\').replace(/"/g, '\\"') + '"';
+    }
+
+    function counter(metric, help, field) {
+        lines.push('# HELP ' + prefix + '_' + metric + ' ' + help);
+        lines.push('# TYPE ' + prefix + '_' + metric + ' counter');
+        names.forEach(function(name) {
+            lines.push(prefix + '_' + metric + label(name) + '} ' + stats.metrics[name][field]);
+        });
+    }
+
+    counter('calls_total', 'Calls of native methods, workers and libcups functions.', 'calls');
+    counter('errors_total', 'Failed calls.', 'errors');
+    counter('bytes_total', 'Bytes sent to the printer.', 'bytes');
+
+    var histogram = prefix + '_latency_seconds';
+    lines.push('# HELP ' + histogram + ' Latency of calls.');
+    lines.push('# TYPE ' + histogram + ' histogram');
+    names.forEach(function(name) {
+        var metric = stats.metrics[name],
+            cumulative = 0;
+        metric.latencyCounts.forEach(function(count, i) {
+            cumulative += count;
+            var le = (i < bounds.length) ? String(bounds[i] / 1000) : '+Inf';
+            lines.push(histogram + '_bucket' + label(name) + ',le="' + le + '"} ' + cumulative);
+        });
+        lines.push(histogram + '_sum' + label(name) + '} ' + metric.latencySum / 1000);
+        lines.push(histogram + '_count' + label(name) + '} ' + metric.calls);
+    });
+
+    return lines.join('\n') + '\n';
+}
+
+module.exports.formatPrometheus = formatPrometheus;
@@ -24,9 +24,11 @@
 #  if NODE_MODULE_VERSION >= 73
 #   define V8_STRING_NEW_UTF8(value)   v8::String::NewFromUtf8(MY_NODE_MODULE_ISOLATE, value).ToLocalChecked()
 #   define V8_STRING_NEW_2BYTES(value)   v8::String::NewFromTwoByte(MY_NODE_MODULE_ISOLATE, value).ToLocalChecked()
+#   define V8_STRING_NEW_INTERNALIZED(value)   v8::String::NewFromUtf8(MY_NODE_MODULE_ISOLATE, value, v8::NewStringType::kInternalized).ToLocalChecked()
 #  else
 #    define V8_STRING_NEW_UTF8(value)   v8::String::NewFromUtf8(MY_NODE_MODULE_ISOLATE, value)
 #    define V8_STRING_NEW_2BYTES(value)   v8::String::NewFromTwoByte(MY_NODE_MODULE_ISOLATE, value)
+#    define V8_STRING_NEW_INTERNALIZED(value)   v8::String::NewFromUtf8(MY_NODE_MODULE_ISOLATE, value, v8::String::kInternalizedString)
 #  endif
 
 #  define RETURN_EXCEPTION(msg)  isolate->ThrowException(Nan::Error(msg));    \
@@ -44,6 +46,7 @@
 #  define V8_VALUE_NEW_DEFAULT(type)   v8::type::New()
 #  define V8_STRING_NEW_UTF8(value)   Nan::Utf8String(value)
 #  define V8_STRING_NEW_2BYTES(value)   v8::String::New(value)
+#  define V8_STRING_NEW_INTERNALIZED(value)   v8::String::NewSymbol(value)
 
 #  define RETURN_EXCEPTION(msg) return v8::ThrowException(Nan::Error(msg)) 
 
@@ -104,7 +107,7 @@
     v8::Local<v8::Object> var = v8::Local<v8::Object>::Cast(args[i]);
 
 
-#define REQUIRE_ARGUMENT_FUNCTION(i, var)                                      \
+#define REQUIRE_ARGUMENT_FUNCTION(args, i, var)                                \
     if (args.Length() <= (i) || !args[i]->IsFunction()) {                      \
         RETURN_EXCEPTION_STR("Argument " #i " must be a function");                 \
     }                                                                          \
@@ -130,7 +133,7 @@
         v8::String::Value var(V8_LOCAL_STRING_FROM_VALUE(args[i]));
 #endif
 
-#define OPTIONAL_ARGUMENT_FUNCTION(i, var)                                     \
+#define OPTIONAL_ARGUMENT_FUNCTION(args, i, var)                               \
     v8::Local<v8::Function> var;                                                       \
     if (args.Length() > i && !args[i]->IsUndefined()) {                        \
         if (!args[i]->IsFunction()) {                                          \
@@ -1,19 +1,44 @@
 #include "node_printer.hpp"
+#include "node_printer_stats.hpp"
 
 #include <node_buffer.h>
 
+#include <cstring>
+
 NAN_MODULE_INIT(Init) {
 // only for node
-    MY_MODULE_SET_METHOD(target, "getPrinters", getPrinters);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "getPrinters", getPrinters);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "getPrintersDelta", getPrintersDelta);
     MY_MODULE_SET_METHOD(target, "getDefaultPrinterName", getDefaultPrinterName);
-    MY_MODULE_SET_METHOD(target, "getPrinter", getPrinter);
-    MY_MODULE_SET_METHOD(target, "getPrinterDriverOptions", getPrinterDriverOptions);
-    MY_MODULE_SET_METHOD(target, "getJob", getJob);
-    MY_MODULE_SET_METHOD(target, "setJob", setJob);
-    MY_MODULE_SET_METHOD(target, "printDirect", PrintDirect);
-    MY_MODULE_SET_METHOD(target, "printFile", PrintFile);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "getPrinter", getPrinter);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "getPrinterDriverOptions", getPrinterDriverOptions);
+    MY_MODULE_SET_METHOD(target, "setDestinationCacheOptions", setDestinationCacheOptions);
+    MY_MODULE_SET_METHOD(target, "refreshDestinationCache", refreshDestinationCache);
+    MY_MODULE_SET_METHOD(target, "invalidateDestinationCache", invalidateDestinationCache);
+    MY_MODULE_SET_METHOD(target, "setConnectionPoolOptions", setConnectionPoolOptions);
+    MY_MODULE_SET_METHOD(target, "getConnectionPoolStats", getConnectionPoolStats);
+    MY_MODULE_SET_METHOD(target, "setSpoolOptions", setSpoolOptions);
+    MY_MODULE_SET_METHOD(target, "getSpoolStats", getSpoolStats);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "getJob", getJob);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "getJobs", getJobs);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "setJob", setJob);
+    MY_MODULE_SET_METHOD(target, "watchNotifications", watchNotifications);
+    MY_MODULE_SET_METHOD(target, "createPrintProfile", createPrintProfile);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printDirect", PrintDirect);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printDirectAsync", PrintDirectAsync);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printSocket", PrintSocket);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printSpool", PrintSpool);
+    MY_MODULE_SET_METHOD(target, "compileTemplate", compileTemplate);
+    MY_MODULE_SET_METHOD(target, "renderTemplate", renderTemplate);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printBatch", PrintBatch);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printStreamStart", PrintStreamStart);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printFile", PrintFile);
+    MY_MODULE_SET_INSTRUMENTED_METHOD(target, "printFileAsync", PrintFileAsync);
     MY_MODULE_SET_METHOD(target, "getSupportedPrintFormats", getSupportedPrintFormats);
     MY_MODULE_SET_METHOD(target, "getSupportedJobCommands", getSupportedJobCommands);
+    MY_MODULE_SET_METHOD(target, "getStats", getStats);
+    MY_MODULE_SET_METHOD(target, "resetStats", resetStats);
+    MY_MODULE_SET_METHOD(target, "setRecordKeysEnabled", setRecordKeysEnabled);
 }
 
 #if NODE_MAJOR_VERSION >= 10
@@ -24,17 +49,58 @@ NODE_MODULE(node_printer, Init)
 
 // Helpers
 
-bool getStringOrBufferFromV8Value(v8::Local<v8::Value> iV8Value, std::string &oData)
+/// The data is read on a worker thread while JS may detach or transfer the ArrayBuffer:
+/// reference its backing store when V8 shares it, copy it otherwise
+static void assignArrayBuffer(v8::Local<v8::ArrayBuffer> iBuffer, size_t iOffset, size_t iLength, PrintData &oData)
+{
+#if NODE_MAJOR_VERSION >= 14
+    std::shared_ptr<v8::BackingStore> store = iBuffer->GetBackingStore();
+    oData.assignShared(store, static_cast<const char*>(store->Data()) + iOffset, iLength);
+#else
+    char *buffer = oData.assignOwned(iLength);
+    if(iLength > 0)
+    {
+        Nan::TypedArrayContents<char> contents(v8::Uint8Array::New(iBuffer, iOffset, iLength));
+        memcpy(buffer, *contents, iLength);
+    }
+#endif
+}
+
+bool getStringOrBufferFromV8Value(v8::Local<v8::Value> iV8Value, PrintData &oData)
 {
     if(iV8Value->IsString())
     {
-        Nan::Utf8String data_str_v8(V8_LOCAL_STRING_FROM_VALUE(iV8Value));
-        oData.assign(*data_str_v8, data_str_v8.length());
+        // transcode directly into the destination buffer
+        ssize_t size = Nan::DecodeBytes(iV8Value, Nan::UTF8);
+        if(size < 0)
+        {
+            return false;
+        }
+        char *buffer = oData.assignOwned(static_cast<size_t>(size));
+        if(size > 0)
+        {
+            Nan::DecodeWrite(buffer, size, iV8Value, Nan::UTF8);
+        }
+        return true;
+    }
+    if(iV8Value->IsArrayBufferView())
+    {
+        // Buffers are Uint8Array views
+        v8::Local<v8::ArrayBufferView> view = iV8Value.As<v8::ArrayBufferView>();
+        assignArrayBuffer(view->Buffer(), view->ByteOffset(), view->ByteLength(), oData);
+        return true;
+    }
+    if(iV8Value->IsArrayBuffer())
+    {
+        v8::Local<v8::ArrayBuffer> array_buffer = iV8Value.As<v8::ArrayBuffer>();
+        assignArrayBuffer(array_buffer, 0, array_buffer->ByteLength(), oData);
         return true;
     }
     if(iV8Value->IsObject() && node::Buffer::HasInstance(iV8Value))
     {
-        oData.assign(node::Buffer::Data(iV8Value), node::Buffer::Length(iV8Value));
+        // Buffer of a node without typed arrays, it is not transferable
+        char *buffer = oData.assignOwned(node::Buffer::Length(iV8Value));
+        memcpy(buffer, node::Buffer::Data(iV8Value), oData.size());
         return true;
     }
     return false;
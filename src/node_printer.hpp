@@ -6,6 +6,7 @@
 #include <node.h>
 #include <v8.h>
 
+#include <memory>
 #include <string>
 
 /**
@@ -15,11 +16,105 @@
  * @param printername String, mandatory, specifying printer name
  * @param docname String, mandatory, specifying document name
  * @param type String, mandatory, specifying data type. E.G.: RAW, TEXT, ...
+ * @param options Object, mandatory, printer options, or a profile handle of createPrintProfile (posix only)
+ * @param compression String, optional, "none" (default) or "gzip" (posix only): the document is deflated
+ *        as it is written and sent with the IPP compression attribute
+ * @param compressionLevel Number, optional, 0 to 9, zlib default if undefined
  *
  * @returns true for success, false for failure.
  */
 MY_NODE_MODULE_CALLBACK(PrintDirect);
 
+/** Build print options once for the jobs which reuse them (posix only)
+ * @param options Object, mandatory, CUPS options
+ * @returns PrintProfile handle, accepted as options by the print methods: the jobs share its cups_option_t
+ *          array and its IPP encoding instead of converting the options for each job
+ */
+MY_NODE_MODULE_CALLBACK(createPrintProfile);
+
+/**
+ * Send data to printer without blocking the event loop.
+ * The same parameters as PrintDirect plus:
+ *
+ * @param options Object, mandatory, printer options
+ * @param callback Function, mandatory, called as callback(error, jobId)
+ * @param compression String, optional, as for PrintDirect
+ * @param compressionLevel Number, optional, as for PrintDirect
+ */
+MY_NODE_MODULE_CALLBACK(PrintDirectAsync);
+
+/**
+ * Send RAW data straight to a socket://host[:port] device (AppSocket/JetDirect, port 9100 by default),
+ * without the print server. Jobs of a device are pipelined on a persistent connection by a native I/O thread (posix only)
+ *
+ * @param uri String, mandatory, socket://host[:port]
+ * @param data String or Buffer, mandatory, data to send as is
+ * @param timeout Number, mandatory, ms without progress after which the job fails
+ * @param idleTimeout Number, mandatory, ms the connection is kept open after the last job
+ * @param callback Function, mandatory, called as callback(error, jobId) once all the data is written,
+ *        jobId is local to the process: the device has no job
+ */
+MY_NODE_MODULE_CALLBACK(PrintSocket);
+
+/**
+ * Append a job to the spool journal opened by setSpoolOptions (posix only). A native thread sends
+ * the jobs of the journal in order, retrying while the server is unreachable: at least once.
+ *
+ * @param data, printer, docname, type, options as for PrintDirectAsync
+ * @param callback Function, mandatory, called as callback(error, sequence) once the job is in the journal
+ * @param compression String, optional, as for PrintDirect
+ * @param compressionLevel Number, optional
+ */
+MY_NODE_MODULE_CALLBACK(PrintSpool);
+
+/**
+ * Compile a label template: literal text with {{field}} placeholders, parsed once
+ *
+ * @param source String, mandatory, template text, e.g. ZPL or EPL commands
+ * @param language String, optional, escaping of field values: "raw" (default, none),
+ *        "zpl" (^ ~ _ as _5E _7E _5F field hex escapes, fields need ^FH) or "epl" (" and \ escaped, line breaks as spaces)
+ *
+ * @returns template handle, with the read only fields Array of placeholder names
+ */
+MY_NODE_MODULE_CALLBACK(compileTemplate);
+
+/**
+ * Render records with a compiled template, one after the other, into one Buffer
+ *
+ * @param template handle returned by compileTemplate
+ * @param records Array of Object, mandatory, field values by placeholder name. Missing, null and undefined are empty
+ *
+ * @returns Buffer
+ */
+MY_NODE_MODULE_CALLBACK(renderTemplate);
+
+/**
+ * Send several documents as one print job, from a worker thread
+ *
+ * @param printername String, mandatory, specifying printer name
+ * @param jobname String, mandatory, specifying job name
+ * @param options Object, mandatory, printer options
+ * @param documents Array, mandatory, of {data: String or Buffer, type: String (default RAW), docname: String}
+ * @param callback Function, mandatory, called as callback(error, jobId)
+ * @param compression String, optional, as for PrintDirect, for each document
+ * @param compressionLevel Number, optional, as for PrintDirect
+ */
+MY_NODE_MODULE_CALLBACK(PrintBatch);
+
+/**
+ * Open a print job whose document is sent by chunks
+ *
+ * @param printername String, mandatory, specifying printer name
+ * @param docname String, mandatory, specifying document name
+ * @param type String, mandatory, specifying data type. E.G.: RAW, TEXT, ...
+ * @param options Object, mandatory, printer options
+ * @param callback Function, mandatory, called as callback(error, job) where
+ *        job has write(data, cb), finish(cb(error, jobId)) and cancel(cb) methods
+ * @param compression String, optional, as for PrintDirect
+ * @param compressionLevel Number, optional, as for PrintDirect
+ */
+MY_NODE_MODULE_CALLBACK(PrintStreamStart);
+
 /**
  * Send file to printer
  *
@@ -31,11 +126,41 @@ MY_NODE_MODULE_CALLBACK(PrintDirect);
  */
 MY_NODE_MODULE_CALLBACK(PrintFile);
 
+/**
+ * Send file to printer from a worker thread, chunk by chunk through create-job/send-document
+ *
+ * @param filename String, mandatory, specifying filename to print
+ * @param docname String, mandatory, specifying document name
+ * @param printer String, mandatory, specifying printer name
+ * @param type String, mandatory, specifying data type, empty to let the server detect it
+ * @param options Object, mandatory, printer options
+ * @param progress Function or null, called as progress(bytesSent, total) after each chunk, total is null if unknown
+ * @param callback Function, mandatory, called as callback(error, jobId)
+ * @param compression String, optional, as for PrintDirect
+ * @param compressionLevel Number, optional, as for PrintDirect
+ *
+ * @returns job handle with a cancel() method
+ */
+MY_NODE_MODULE_CALLBACK(PrintFileAsync);
+
 /** Retrieve all printers and jobs
  * posix: minimum version: CUPS 1.1.21/OS X 10.4
+ * @param jobs String, optional, "eager" (default), "lazy" (jobs converted on first read) or "none" (posix only)
+ * @param attributes Array of String, optional, IPP printer attributes to request, the only ones in options (posix only)
+ * @param servers Array of String, optional, "host[:port]" of the servers to query concurrently (posix only).
+ *  Printers get a server property, failed servers are in the non enumerable errors Array of {server, message}
  */
 MY_NODE_MODULE_CALLBACK(getPrinters);
 
+/** Retrieve what changed in printers and active jobs since a version (posix only)
+ * Printers and jobs are diffed natively on per-record hashes, only the changed records are converted.
+ * @param sinceVersion String, optional, version returned by a previous call, undefined for a full snapshot.
+ *  A version of another process (e.g. before a restart) also gives a full snapshot
+ * @returns Object {version, full, printers: {added, changed, removed}, jobs: {added, changed, removed}},
+ *  removed printers by name ("name/instance" for lpoptions instances), removed jobs by id
+ */
+MY_NODE_MODULE_CALLBACK(getPrintersDelta);
+
 /**
  * Return default printer name, if null then default printer is not set
  */
@@ -43,6 +168,9 @@ MY_NODE_MODULE_CALLBACK(getDefaultPrinterName);
 
 /** Retrieve printer info and jobs
  * @param printer name String
+ * @param jobs String, optional, as for getPrinters
+ * @param attributes Array of String, optional, as for getPrinters
+ * @param server String, optional, "host[:port]" of the server, the default one if not given (posix only)
  */
 MY_NODE_MODULE_CALLBACK(getPrinter);
 
@@ -51,12 +179,89 @@ MY_NODE_MODULE_CALLBACK(getPrinter);
  */
 MY_NODE_MODULE_CALLBACK(getPrinterDriverOptions);
 
+/** Configure the cache of printer destinations (posix only)
+ * @param ttl Number, maximum age in milliseconds of cached destinations, 0 disables the cache
+ * @param checkInterval Number, milliseconds between two checks of the printers change times on the server
+ */
+MY_NODE_MODULE_CALLBACK(setDestinationCacheOptions);
+
+/** Retrieve destinations now and store them in the cache
+ */
+MY_NODE_MODULE_CALLBACK(refreshDestinationCache);
+
+/** Drop cached destinations, next call will retrieve them
+ */
+MY_NODE_MODULE_CALLBACK(invalidateDestinationCache);
+
+/** Counters and latency histograms of native methods, workers and libcups calls
+ * @returns Object {latencyBuckets: Array of bucket upper bounds in ms,
+ *          metrics: {name: {calls, errors, bytes, latencySum (ms), latencyCounts: Array, last one unbounded}}}
+ */
+MY_NODE_MODULE_CALLBACK(getStats);
+
+/** Reset all counters and histograms
+ */
+MY_NODE_MODULE_CALLBACK(resetStats);
+
+/** Use the internalized keys and templates to build printer and job records, or plain objects and
+ *  new strings each time. Enabled by default, disabled only to benchmark the conversion
+ * @param enabled Boolean
+ */
+MY_NODE_MODULE_CALLBACK(setRecordKeysEnabled);
+
+/** Configure the pool of connections to the CUPS server (posix only)
+ * @param size Number, idle connections kept for reuse, 0 closes connections after each operation
+ * @param keepAlive Boolean, use HTTP keep-alive
+ * @param idleTimeout Number, milliseconds after which an idle connection is closed, 0 to keep them
+ */
+MY_NODE_MODULE_CALLBACK(setConnectionPoolOptions);
+
+/** Connection pool statistics (posix only)
+ * @returns Object {active, idle, created, reused}
+ */
+MY_NODE_MODULE_CALLBACK(getConnectionPoolStats);
+
+/** Open the durable spool journal used by printSpool, or close it (posix only).
+ * The pending jobs of an existing journal are sent again once it is open.
+ * @param path String, file of the journal, null to close the current one
+ * @param maxSize Number, maximum size of the file in bytes
+ * @param retryInterval Number, milliseconds between two attempts while the server is unreachable
+ * @param sync Boolean, flush each appended job to the disk, not only to the page cache
+ */
+MY_NODE_MODULE_CALLBACK(setSpoolOptions);
+
+/** Spool journal statistics (posix only)
+ * @returns Object {path, pending, pendingBytes, appended, submitted, rejected, retries, compactions, fileSize, lastError}
+ */
+MY_NODE_MODULE_CALLBACK(getSpoolStats);
+
 /** Retrieve job info
  *  @param printer name String
  *  @param job id Number
+ *  @param attributes Array of String, optional, IPP job attributes to request and convert (posix only)
+ *  @param server String, optional, as for getPrinter
  */
 MY_NODE_MODULE_CALLBACK(getJob);
 
+/** Retrieve info of several jobs in one pass
+ *  @param printer name String
+ *  @param job ids Array of Number
+ *  @param server String, optional, as for getPrinter
+ *  @returns Array of job info in the same order as ids, null for unknown jobs
+ */
+MY_NODE_MODULE_CALLBACK(getJobs);
+
+/** Watch printer and job events through an IPP subscription
+ *  @param printer name String, empty for all printers
+ *  @param events Array of String, IPP notify-events. E.G.: job-state-changed, printer-state-changed
+ *  @param lease duration Number, subscription lease in seconds, 0 for no expiration
+ *  @param interval Number, delay in ms between two Get-Notifications requests
+ *  @param callback Function, called as callback(error) or callback(null, events) until closed
+ *  @param job id Number, optional, watch only this job with a job subscription
+ *  @returns watcher object with close() method
+ */
+MY_NODE_MODULE_CALLBACK(watchNotifications);
+
 //TODO
 /** Set job command. 
  * arguments:
@@ -112,12 +317,68 @@ protected:
     virtual void free() {};
 };
 
+/** Data to send to printer.
+ * Buffer/Uint8Array/ArrayBuffer values are referenced in place (no copy): the source value
+ * must be kept alive (e.g. with Nan::AsyncWorker::SaveToPersistent) while the data is used.
+ * Strings are transcoded to UTF-8 once, into an owned buffer reused by the next assignments.
+ */
+class PrintData
+{
+public:
+    PrintData(): _data(NULL), _size(0) {}
+
+    const char * data() const { return _data; }
+    size_t size() const { return _size; }
+
+    /// Reference external memory without copying it
+    void assignView(const char *iData, size_t iSize)
+    {
+        _data = iData;
+        _size = iSize;
+    }
+
+#if NODE_MAJOR_VERSION >= 14
+    /// Reference iSize bytes at iData of a backing store without copying them.
+    /// The store is kept alive even if JS detaches or transfers its ArrayBuffer.
+    void assignShared(const std::shared_ptr<v8::BackingStore> &iStore, const char *iData, size_t iSize)
+    {
+        _store = iStore;
+        _data = iData;
+        _size = iSize;
+    }
+#endif
+
+    /// Reserve iSize bytes in the owned buffer and reference it. Returns the buffer to fill.
+    char * assignOwned(size_t iSize)
+    {
+#if NODE_MAJOR_VERSION >= 14
+        _store.reset();
+#endif
+        _buffer.resize(iSize);
+        char *buffer = &_buffer[0];
+        _data = buffer;
+        _size = iSize;
+        return buffer;
+    }
+private:
+    // _data may point into _buffer
+    PrintData(const PrintData&) = delete;
+    PrintData& operator=(const PrintData&) = delete;
+
+    std::string _buffer;
+#if NODE_MAJOR_VERSION >= 14
+    std::shared_ptr<v8::BackingStore> _store;
+#endif
+    const char *_data;
+    size_t _size;
+};
+
 /**
  * try to extract String or buffer from v8 value
- * @param iV8Value - source v8 value
- * @param oData - destination data
+ * @param iV8Value - source v8 value: String, Buffer, any ArrayBufferView or ArrayBuffer
+ * @param oData - destination data. A view on the backing store for binary values
  * @return TRUE if value is String or Buffer, FALSE otherwise
  */
-bool getStringOrBufferFromV8Value(v8::Local<v8::Value> iV8Value, std::string &oData);
+bool getStringOrBufferFromV8Value(v8::Local<v8::Value> iV8Value, PrintData &oData);
 
 #endif
@@ -0,0 +1,108 @@
+#ifndef NODE_PRINTER_ISOLATE_HPP
+#define NODE_PRINTER_ISOLATE_HPP
+
+#include "macros.hh"
+
+#include <node.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+
+/** One T per isolate: the main thread and every worker_threads worker get their own instance,
+ * created on first use and deleted by a cleanup hook when the isolate environment ends.
+ * v8 handles must never be shared between isolates, so anything holding one (persistent keys,
+ * constructors, callbacks) lives here instead of in a plain static.
+ * Instances must have static storage duration.
+ */
+template<typename T>
+class PerIsolate
+{
+public:
+    PerIsolate() {}
+
+    /// Instance of the current isolate
+    T& get()
+    {
+        v8::Isolate *isolate = v8::Isolate::GetCurrent();
+        std::lock_guard<std::mutex> lock(mutex);
+        typename InstanceMapType::iterator itInstance = instances.find(isolate);
+        if(itInstance != instances.end())
+        {
+            return *itInstance->second;
+        }
+        T *instance = new T();
+        instances[isolate] = instance;
+#if NODE_MAJOR_VERSION >= 10
+        node::AddEnvironmentCleanupHook(isolate, cleanup, new HookArg(this, isolate));
+#endif
+        return *instance;
+    }
+
+private:
+    typedef std::map<v8::Isolate*, T*> InstanceMapType;
+    typedef std::pair<PerIsolate*, v8::Isolate*> HookArg;
+
+    PerIsolate(const PerIsolate&);
+    PerIsolate& operator=(const PerIsolate&);
+
+    static void cleanup(void *iArg)
+    {
+        HookArg *arg = static_cast<HookArg*>(iArg);
+        T *instance = NULL;
+        {
+            std::lock_guard<std::mutex> lock(arg->first->mutex);
+            typename InstanceMapType::iterator itInstance = arg->first->instances.find(arg->second);
+            if(itInstance != arg->first->instances.end())
+            {
+                instance = itInstance->second;
+                arg->first->instances.erase(itInstance);
+            }
+        }
+        // outside of the lock: the destructor may use other PerIsolate values
+        delete instance;
+        delete arg;
+    }
+
+    std::mutex mutex;
+    InstanceMapType instances;
+};
+
+/// Function template of a native class, one per isolate
+class IsolateFunctionTemplate
+{
+public:
+    ~IsolateFunctionTemplate() { tpl.Reset(); }
+
+    bool isEmpty() const { return tpl.IsEmpty(); }
+    void reset(v8::Local<v8::FunctionTemplate> iTemplate) { tpl.Reset(iTemplate); }
+    v8::Local<v8::FunctionTemplate> get() const { return Nan::New(tpl); }
+    v8::Local<v8::Function> getFunction() const { return Nan::GetFunction(Nan::New(tpl)).ToLocalChecked(); }
+private:
+    Nan::Persistent<v8::FunctionTemplate> tpl;
+};
+
+/** Objects of the current isolate which must be shut down with it, e.g. those owning a
+ * thread or an uv handle. T::shutdown() is called for the objects still registered.
+ */
+template<typename T>
+class IsolateObjects
+{
+public:
+    ~IsolateObjects()
+    {
+        std::set<T*> remaining;
+        remaining.swap(objects);
+        for(typename std::set<T*>::iterator itObject = remaining.begin(); itObject != remaining.end(); ++itObject)
+        {
+            (*itObject)->shutdown();
+        }
+    }
+
+    void add(T *iObject) { objects.insert(iObject); }
+    void remove(T *iObject) { objects.erase(iObject); }
+private:
+    std::set<T*> objects;
+};
+
+#endif
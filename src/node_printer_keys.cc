@@ -0,0 +1,113 @@
+#include "node_printer.hpp"
+#include "node_printer_keys.hpp"
+#include "node_printer_isolate.hpp"
+
+namespace
+{
+    const char * const kKeyNames[RecordKeys::KEYS_COUNT] = {
+        "id",
+        "name",
+        "printerName",
+        "user",
+        "format",
+        "priority",
+        "size",
+        "status",
+        "completedTime",
+        "creationTime",
+        "processingTime",
+        "isDefault",
+        "instance",
+        "options",
+        "jobs",
+        "server"
+    };
+
+    /// Keys of the templates, in the order they are filled
+    const RecordKeys::Key kJobKeys[] = {
+        RecordKeys::ID, RecordKeys::NAME, RecordKeys::PRINTER_NAME, RecordKeys::USER, RecordKeys::FORMAT,
+        RecordKeys::PRIORITY, RecordKeys::SIZE, RecordKeys::STATUS,
+        RecordKeys::COMPLETED_TIME, RecordKeys::CREATION_TIME, RecordKeys::PROCESSING_TIME
+    };
+    const RecordKeys::Key kPrinterKeys[] = { RecordKeys::NAME, RecordKeys::IS_DEFAULT, RecordKeys::OPTIONS };
+
+    v8::Local<v8::ObjectTemplate> newTemplate(RecordKeys &iKeys, const RecordKeys::Key *iKeysList, size_t iCount)
+    {
+        v8::Local<v8::ObjectTemplate> tpl = Nan::New<v8::ObjectTemplate>();
+        for(size_t i = 0; i < iCount; ++i)
+        {
+            tpl->Set(iKeys.key(iKeysList[i]), Nan::Undefined());
+        }
+        return tpl;
+    }
+}
+
+std::atomic<bool> RecordKeys::enabled(true);
+
+RecordKeys& RecordKeys::get()
+{
+    static PerIsolate<RecordKeys> instances;
+    return instances.get();
+}
+
+RecordKeys::RecordKeys()
+{
+    Nan::HandleScope scope;
+    MY_NODE_MODULE_ISOLATE_DECL
+    for(int i = 0; i < KEYS_COUNT; ++i)
+    {
+        keys[i].Reset(V8_STRING_NEW_INTERNALIZED(kKeyNames[i]));
+    }
+    job_template.Reset(newTemplate(*this, kJobKeys, sizeof(kJobKeys) / sizeof(kJobKeys[0])));
+    printer_template.Reset(newTemplate(*this, kPrinterKeys, sizeof(kPrinterKeys) / sizeof(kPrinterKeys[0])));
+}
+
+RecordKeys::~RecordKeys()
+{
+    for(int i = 0; i < KEYS_COUNT; ++i)
+    {
+        keys[i].Reset();
+    }
+    for(std::map<std::string, Nan::Persistent<v8::String>*>::iterator itInterned = interned.begin(); itInterned != interned.end(); ++itInterned)
+    {
+        itInterned->second->Reset();
+        delete itInterned->second;
+    }
+    job_template.Reset();
+    printer_template.Reset();
+}
+
+v8::Local<v8::String> RecordKeys::newKey(Key iKey)
+{
+    MY_NODE_MODULE_ISOLATE_DECL
+    return V8_STRING_NEW_UTF8(kKeyNames[iKey]);
+}
+
+v8::Local<v8::String> RecordKeys::intern(const char *iValue)
+{
+    MY_NODE_MODULE_ISOLATE_DECL
+    if(!isEnabled())
+    {
+        return V8_STRING_NEW_UTF8(iValue);
+    }
+    std::map<std::string, Nan::Persistent<v8::String>*>::iterator itInterned = interned.find(iValue);
+    if(itInterned != interned.end())
+    {
+        return Nan::New(*itInterned->second);
+    }
+    if(interned.size() >= kMaxInterned)
+    {
+        return V8_STRING_NEW_UTF8(iValue);
+    }
+    v8::Local<v8::String> result = V8_STRING_NEW_INTERNALIZED(iValue);
+    interned[iValue] = new Nan::Persistent<v8::String>(result);
+    return result;
+}
+
+MY_NODE_MODULE_CALLBACK(setRecordKeysEnabled)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 1);
+    RecordKeys::setEnabled(Nan::To<bool>(iArgs[0]).FromJust());
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
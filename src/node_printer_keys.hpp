@@ -0,0 +1,82 @@
+#ifndef NODE_PRINTER_KEYS_HPP
+#define NODE_PRINTER_KEYS_HPP
+
+#include "macros.hh"
+
+#include <atomic>
+#include <map>
+#include <string>
+
+/** Internalized property keys and object templates of printer and job records, one instance per isolate.
+ * Records created from the templates start with all their properties in a fixed order, so they share
+ * one hidden class and filling them only stores values.
+ */
+class RecordKeys
+{
+public:
+    enum Key {
+        // job
+        ID,
+        NAME,
+        PRINTER_NAME,
+        USER,
+        FORMAT,
+        PRIORITY,
+        SIZE,
+        STATUS,
+        COMPLETED_TIME,
+        CREATION_TIME,
+        PROCESSING_TIME,
+        // printer
+        IS_DEFAULT,
+        INSTANCE,
+        OPTIONS,
+        JOBS,
+        SERVER,
+        KEYS_COUNT
+    };
+
+    /// Instance of the current isolate, created on first use and freed with the isolate environment
+    static RecordKeys& get();
+
+    /** Disabled, keys and values are new strings and records plain objects each time, as before
+     * the templates: only meant to measure what they save (see bench/convert.js)
+     */
+    static void setEnabled(bool iEnabled) { enabled.store(iEnabled, std::memory_order_relaxed); }
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    v8::Local<v8::String> key(Key iKey) { return isEnabled() ? Nan::New(keys[iKey]) : newKey(iKey); }
+
+    /** Internalized string of a frequent value, e.g. an option name.
+     * At most kMaxInterned strings are cached, others are created each time
+     */
+    v8::Local<v8::String> intern(const char *iValue);
+
+    /// New job object with the properties filled by parseJobObject
+    v8::Local<v8::Object> newJob() { return isEnabled() ? Nan::NewInstance(Nan::New(job_template)).ToLocalChecked() : Nan::New<v8::Object>(); }
+
+    /// New printer object with name, isDefault and options properties
+    v8::Local<v8::Object> newPrinter() { return isEnabled() ? Nan::NewInstance(Nan::New(printer_template)).ToLocalChecked() : Nan::New<v8::Object>(); }
+
+private:
+    template<typename T> friend class PerIsolate;
+
+    static const size_t kMaxInterned = 1024;
+
+    static std::atomic<bool> enabled;
+
+    /// Not internalized string of iKey
+    static v8::Local<v8::String> newKey(Key iKey);
+
+    RecordKeys();
+    ~RecordKeys();
+    RecordKeys(const RecordKeys&);
+    RecordKeys& operator=(const RecordKeys&);
+
+    Nan::Persistent<v8::String> keys[KEYS_COUNT];
+    std::map<std::string, Nan::Persistent<v8::String>*> interned;
+    Nan::Persistent<v8::ObjectTemplate> job_template;
+    Nan::Persistent<v8::ObjectTemplate> printer_template;
+};
+
+#endif
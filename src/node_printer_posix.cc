@@ -1,13 +1,49 @@
 #include "node_printer.hpp"
+#include "node_printer_stats.hpp"
+#include "node_printer_keys.hpp"
+#include "node_printer_isolate.hpp"
 
 #include <string>
 #include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
 #include <utility>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <random>
+#include <system_error>
 #include <node_version.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+
 #include <cups/cups.h>
 #include <cups/ppd.h>
+#include <zlib.h>
+
+#ifndef MSG_NOSIGNAL
+// macOS: SIGPIPE is disabled with SO_NOSIGPIPE instead
+#define MSG_NOSIGNAL 0
+#endif
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
@@ -16,14 +52,9 @@ namespace
     typedef std::map<std::string, int> StatusMapType;
     typedef std::map<std::string, std::string> FormatMapType;
 
-    const StatusMapType& getJobStatusMap()
+    StatusMapType buildJobStatusMap()
     {
-        static StatusMapType result;
-        if(!result.empty())
-        {
-            return result;
-        }
-        // add only first time
+        StatusMapType result;
 #define STATUS_PRINTER_ADD(value, type) result.insert(std::make_pair(value, type))
         // Common statuses
         STATUS_PRINTER_ADD("PRINTING", IPP_JOB_PROCESSING);
@@ -39,13 +70,16 @@ namespace
         return result;
     }
 
-    const FormatMapType& getPrinterFormatMap()
+    /// Immutable table built on first use: a local static is initialized once, even from several threads
+    const StatusMapType& getJobStatusMap()
     {
-        static FormatMapType result;
-        if(!result.empty())
-        {
-            return result;
-        }
+        static const StatusMapType result = buildJobStatusMap();
+        return result;
+    }
+
+    FormatMapType buildPrinterFormatMap()
+    {
+        FormatMapType result;
         result.insert(std::make_pair("RAW", CUPS_FORMAT_RAW));
         result.insert(std::make_pair("TEXT", CUPS_FORMAT_TEXT));
 #ifdef CUPS_FORMAT_PDF
@@ -66,17 +100,15 @@ namespace
         return result;
     }
 
-    /** Parse job info object.
-     * @return error string. if empty, then no error
-     */
-    std::string parseJobObject(const cups_job_t *job, v8::Local<v8::Object> result_printer_job)
+    const FormatMapType& getPrinterFormatMap()
+    {
+        static const FormatMapType result = buildPrinterFormatMap();
+        return result;
+    }
+
+    /// Set job.format, with the format name when the mime type is known
+    void parseJobFormat(RecordKeys &keys, const cups_job_t *job, v8::Local<v8::Object> result_printer_job)
     {
-        MY_NODE_MODULE_ISOLATE_DECL
-        //Common fields
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("id"), V8_VALUE_NEW(Number, job->id));
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("name"), V8_STRING_NEW_UTF8(job->title));
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("printerName"), V8_STRING_NEW_UTF8(job->dest));
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("user"), V8_STRING_NEW_UTF8(job->user));
         std::string job_format(job->format);
 
         // Try to parse the data format, otherwise will write the unformatted one
@@ -89,16 +121,20 @@ namespace
             }
         }
 
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("format"), V8_STRING_NEW_UTF8(job_format.c_str()));
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("priority"), V8_VALUE_NEW(Number, job->priority));
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("size"), V8_VALUE_NEW(Number, job->size));
+        Nan::Set(result_printer_job, keys.key(RecordKeys::FORMAT), keys.intern(job_format.c_str()));
+    }
+
+    /// Set job.status, the array of status names
+    void parseJobStatus(RecordKeys &keys, const cups_job_t *job, v8::Local<v8::Object> result_printer_job)
+    {
+        MY_NODE_MODULE_ISOLATE_DECL
         v8::Local<v8::Array> result_printer_job_status = V8_VALUE_NEW_DEFAULT(Array);
         int i_status = 0;
         for(StatusMapType::const_iterator itStatus = getJobStatusMap().begin(); itStatus != getJobStatusMap().end(); ++itStatus)
         {
             if(job->state == itStatus->second)
             {
-                Nan::Set(result_printer_job_status, i_status++, V8_STRING_NEW_UTF8(itStatus->first.c_str()));
+                Nan::Set(result_printer_job_status, i_status++, keys.intern(itStatus->first.c_str()));
                 // only one status could be on posix
                 break;
             }
@@ -111,7 +147,59 @@ namespace
             Nan::Set(result_printer_job_status, i_status++, V8_STRING_NEW_UTF8(s.str().c_str()));
         }
 
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("status"), result_printer_job_status);
+        Nan::Set(result_printer_job, keys.key(RecordKeys::STATUS), result_printer_job_status);
+    }
+
+    /// Set of job object properties, bit (1 << RecordKeys::Key)
+    typedef unsigned int JobFieldsType;
+    const JobFieldsType kAllJobFields = ~0u;
+
+    inline bool hasJobField(JobFieldsType iFields, RecordKeys::Key iKey)
+    {
+        return (iFields & (1u << iKey)) != 0;
+    }
+
+    /** Fill a job object, created with keys.newJob() so that the properties are stored in place
+     * @param iFields properties to fill, all by default
+     * @return error string.
+     */
+    std::string parseJobObject(RecordKeys &keys, const cups_job_t *job, v8::Local<v8::Object> result_printer_job,
+                               JobFieldsType iFields = kAllJobFields)
+    {
+        MY_NODE_MODULE_ISOLATE_DECL
+        //Common fields
+        if(hasJobField(iFields, RecordKeys::ID))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::ID), V8_VALUE_NEW(Number, job->id));
+        }
+        if(hasJobField(iFields, RecordKeys::NAME))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::NAME), V8_STRING_NEW_UTF8(job->title));
+        }
+        if(hasJobField(iFields, RecordKeys::PRINTER_NAME))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::PRINTER_NAME), keys.intern(job->dest));
+        }
+        if(hasJobField(iFields, RecordKeys::USER))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::USER), keys.intern(job->user));
+        }
+        if(hasJobField(iFields, RecordKeys::FORMAT))
+        {
+            parseJobFormat(keys, job, result_printer_job);
+        }
+        if(hasJobField(iFields, RecordKeys::PRIORITY))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::PRIORITY), V8_VALUE_NEW(Number, job->priority));
+        }
+        if(hasJobField(iFields, RecordKeys::SIZE))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::SIZE), V8_VALUE_NEW(Number, job->size));
+        }
+        if(hasJobField(iFields, RecordKeys::STATUS))
+        {
+            parseJobStatus(keys, job, result_printer_job);
+        }
 
         //Specific fields
         // Ecmascript store time in milliseconds, but time_t in seconds
@@ -120,188 +208,5097 @@ namespace
         double completedTime = ((double)job->completed_time) * 1000;
         double processingTime = ((double)job->processing_time) * 1000;
 
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("completedTime"), Nan::New<v8::Date>(completedTime).ToLocalChecked());
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("creationTime"), Nan::New<v8::Date>(creationTime).ToLocalChecked());
-        Nan::Set(result_printer_job, V8_STRING_NEW_UTF8("processingTime"), Nan::New<v8::Date>(processingTime).ToLocalChecked());
+        if(hasJobField(iFields, RecordKeys::COMPLETED_TIME))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::COMPLETED_TIME), Nan::New<v8::Date>(completedTime).ToLocalChecked());
+        }
+        if(hasJobField(iFields, RecordKeys::CREATION_TIME))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::CREATION_TIME), Nan::New<v8::Date>(creationTime).ToLocalChecked());
+        }
+        if(hasJobField(iFields, RecordKeys::PROCESSING_TIME))
+        {
+            Nan::Set(result_printer_job, keys.key(RecordKeys::PROCESSING_TIME), Nan::New<v8::Date>(processingTime).ToLocalChecked());
+        }
 
         // No error. return an empty string
         return "";
     }
 
-    /** Parses printer driver PPD options
+    /// Job attributes needed to fill a cups_job_t, the same as cupsGetJobs requests
+    const char * const kJobAttributes[] = {
+        "document-format",
+        "job-id",
+        "job-k-octets",
+        "job-name",
+        "job-originating-user-name",
+        "job-printer-uri",
+        "job-priority",
+        "job-state",
+        "time-at-completed",
+        "time-at-creation",
+        "time-at-processing"
+    };
+    const int kJobAttributesSize = sizeof(kJobAttributes) / sizeof(kJobAttributes[0]);
+
+    /// Job object property filled from each job attribute
+    const struct {
+        const char *attribute;
+        RecordKeys::Key key;
+    } kJobAttributeKeys[] = {
+        { "document-format", RecordKeys::FORMAT },
+        { "job-id", RecordKeys::ID },
+        { "job-k-octets", RecordKeys::SIZE },
+        { "job-name", RecordKeys::NAME },
+        { "job-originating-user-name", RecordKeys::USER },
+        { "job-printer-uri", RecordKeys::PRINTER_NAME },
+        { "job-priority", RecordKeys::PRIORITY },
+        { "job-state", RecordKeys::STATUS },
+        { "time-at-completed", RecordKeys::COMPLETED_TIME },
+        { "time-at-creation", RecordKeys::CREATION_TIME },
+        { "time-at-processing", RecordKeys::PROCESSING_TIME }
+    };
+
+    /** Value of an IPP attribute as text, several values are separated by commas.
+     * Integers and enums are written as numbers and dates as seconds since the epoch, as in the
+     * cups_dest_t options, so that both sources give the same printer object (status, *-time dates)
      */
-    void populatePpdOptions(v8::Local<v8::Object> ppd_options, ppd_file_t  *ppd, ppd_group_t *group)
+    std::string getAttributeValue(ipp_attribute_t *attr)
     {
-        int i, j;
-        ppd_option_t *option;
-        ppd_choice_t *choice;
-        ppd_group_t *subgroup;
+        ipp_tag_t tag = ippGetValueTag(attr);
+        if(tag == IPP_TAG_INTEGER || tag == IPP_TAG_ENUM || tag == IPP_TAG_DATE)
+        {
+            std::ostringstream result;
+            for(int i = 0; i < ippGetCount(attr); ++i)
+            {
+                if(i > 0)
+                {
+                    result << ',';
+                }
+                if(tag == IPP_TAG_DATE)
+                {
+                    result << static_cast<long long>(ippDateToTime(ippGetDate(attr, i)));
+                }
+                else
+                {
+                    result << ippGetInteger(attr, i);
+                }
+            }
+            return result.str();
+        }
+        char value[256];
+        size_t length = ippAttributeString(attr, value, sizeof(value));
+        if(length < sizeof(value))
+        {
+            return std::string(value, length);
+        }
+        std::vector<char> buffer(length + 1);
+        ippAttributeString(attr, &buffer[0], buffer.size());
+        return std::string(&buffer[0], length);
+    }
 
-        for (i = group->num_options, option = group->options; i > 0; --i, ++option)
+    typedef std::vector<std::pair<std::string, std::string> > AttributeListType;
+
+    /** IPP requested-attributes given by the caller: the server sends only these attributes
+     * and only these are converted. Empty when the whole records are wanted.
+     */
+    class RequestedAttributes {
+    public:
+        RequestedAttributes(): all(false) {}
+
+        /// @return false if iValue is neither undefined nor an array of strings
+        bool parse(v8::Local<v8::Value> iValue)
         {
-            MY_NODE_MODULE_ISOLATE_DECL
-            v8::Local<v8::Object> ppd_suboptions = V8_VALUE_NEW_DEFAULT(Object);
-            for (j = option->num_choices, choice = option->choices;
-                 j > 0;
-                 --j, ++choice)
+            if(iValue->IsUndefined())
             {
-                Nan::Set(ppd_suboptions, V8_STRING_NEW_UTF8(choice->choice), V8_VALUE_NEW(Boolean, static_cast<bool>(choice->marked)));
+                return true;
+            }
+            if(!iValue->IsArray())
+            {
+                return false;
+            }
+            v8::Local<v8::Array> names_array = v8::Local<v8::Array>::Cast(iValue);
+            for(uint32_t i = 0; i < names_array->Length(); ++i)
+            {
+                v8::Local<v8::Value> name = Nan::Get(names_array, i).ToLocalChecked();
+                if(!name->IsString())
+                {
+                    return false;
+                }
+                names.push_back(*Nan::Utf8String(name));
+                all = all || isGroup(names.back());
             }
+            return true;
+        }
 
-            Nan::Set(ppd_options, V8_STRING_NEW_UTF8(option->keyword), ppd_suboptions);
+        bool empty() const { return names.empty(); }
+
+        /// @return true if iName was requested, by name or with a group
+        bool has(const char *iName) const
+        {
+            return all || std::find(names.begin(), names.end(), iName) != names.end();
         }
 
-        for (i = group->num_subgroups, subgroup = group->subgroups; i > 0; --i, ++subgroup) {
-            populatePpdOptions(ppd_options, ppd, subgroup);
+        /** Add requested-attributes to iRequest
+         * @param iRequired attributes needed by the conversion, requested but converted only if has(name)
+         */
+        void addTo(ipp_t *iRequest, const char * const *iRequired, size_t iRequiredSize) const
+        {
+            std::vector<const char*> values(iRequired, iRequired + iRequiredSize);
+            for(std::vector<std::string>::const_iterator itName = names.begin(); itName != names.end(); ++itName)
+            {
+                values.push_back(itName->c_str());
+            }
+            ippAddStrings(iRequest, IPP_TAG_OPERATION, IPP_TAG_KEYWORD, "requested-attributes",
+                          static_cast<int>(values.size()), NULL, &values[0]);
+        }
+
+        /// Job object properties of the requested job attributes
+        JobFieldsType getJobFields() const
+        {
+            JobFieldsType fields = 0;
+            for(size_t i = 0; i < sizeof(kJobAttributeKeys) / sizeof(kJobAttributeKeys[0]); ++i)
+            {
+                if(has(kJobAttributeKeys[i].attribute))
+                {
+                    fields |= (1u << kJobAttributeKeys[i].key);
+                }
+            }
+            return fields;
+        }
+    private:
+        /// @return true for a group of attributes, e.g. "all" or "printer-description"
+        static bool isGroup(const std::string &iName)
+        {
+            static const char * const groups[] = {
+                "all",
+                "job-description",
+                "job-template",
+                "printer-description",
+                "document-description",
+                "document-template"
+            };
+            for(size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); ++i)
+            {
+                if(iName == groups[i])
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<std::string> names;
+        bool all;
+    };
+
+    /// Job read from IPP job attributes, owns the strings of its cups_job_t
+    class IppJob {
+    public:
+        IppJob(): format(CUPS_FORMAT_AUTO) {
+            memset(&job, 0, sizeof(job));
+            job.state = IPP_JOB_PENDING;
+            job.priority = 50;
+        }
+
+        /// Read one job attribute
+        void set(ipp_attribute_t *attr)
+        {
+            const char *name = ippGetName(attr);
+            if(name == NULL)
+            {
+                return;
+            }
+            std::string key(name);
+            if(key == "job-id") job.id = ippGetInteger(attr, 0);
+            else if(key == "job-state") job.state = static_cast<ipp_jstate_t>(ippGetInteger(attr, 0));
+            else if(key == "job-priority") job.priority = ippGetInteger(attr, 0);
+            else if(key == "job-k-octets") job.size = ippGetInteger(attr, 0);
+            else if(key == "time-at-completed") job.completed_time = ippGetInteger(attr, 0);
+            else if(key == "time-at-creation") job.creation_time = ippGetInteger(attr, 0);
+            else if(key == "time-at-processing") job.processing_time = ippGetInteger(attr, 0);
+            else if(key == "job-name") title = ippGetString(attr, 0, NULL);
+            else if(key == "job-originating-user-name") user = ippGetString(attr, 0, NULL);
+            else if(key == "document-format") format = ippGetString(attr, 0, NULL);
+            else if(key == "job-printer-uri")
+            {
+                // the destination is the last part of the printer uri
+                const char *uri = ippGetString(attr, 0, NULL);
+                const char *slash = (uri != NULL) ? strrchr(uri, '/') : NULL;
+                dest = (slash != NULL) ? (slash + 1) : "";
+            }
+            else others.push_back(std::make_pair(key, getAttributeValue(attr)));
+        }
+
+        /// @return cups job, valid while this object is not modified
+        const cups_job_t* get()
+        {
+            job.dest = const_cast<char*>(dest.c_str());
+            job.title = const_cast<char*>(title.c_str());
+            job.user = const_cast<char*>(user.c_str());
+            job.format = const_cast<char*>(format.c_str());
+            return &job;
+        }
+
+        int getId() const { return job.id; }
+        const std::string& getDest() const { return dest; }
+
+        /// Attributes without a cups_job_t field, only returned when requested
+        const AttributeListType& getOthers() const { return others; }
+    private:
+        cups_job_t job;
+        std::string dest;
+        std::string title;
+        std::string user;
+        std::string format;
+        AttributeListType others;
+    };
+
+    typedef std::vector<IppJob> IppJobListType;
+
+    /// Read all the job groups of an IPP response
+    void parseIppJobs(ipp_t *response, IppJobListType &oJobs)
+    {
+        IppJob *current = NULL;
+        for(ipp_attribute_t *attr = ippFirstAttribute(response); attr != NULL; attr = ippNextAttribute(response))
+        {
+            if(ippGetGroupTag(attr) != IPP_TAG_JOB)
+            {
+                // separator or another group
+                current = NULL;
+                continue;
+            }
+            if(current == NULL)
+            {
+                oJobs.push_back(IppJob());
+                current = &oJobs.back();
+            }
+            current->set(attr);
         }
     }
 
-    /** Parse printer driver options
-     * @return error string.
+    /** Create a request for a printer
+     * @param iPrinterName printer name, NULL or empty for the whole server
      */
-    std::string parseDriverOptions(const cups_dest_t * printer, v8::Local<v8::Object> ppd_options)
+    ipp_t* newPrinterRequest(ipp_op_t iOperation, const char *iPrinterName)
     {
-        const char *filename;
-        ppd_file_t *ppd;
-        ppd_group_t *group;
-        int i;
+        char uri[HTTP_MAX_URI];
+        if(iPrinterName != NULL && *iPrinterName != '\0')
+        {
+            httpAssembleURIf(HTTP_URI_CODING_ALL, uri, sizeof(uri), "ipp", NULL, "localhost", ippPort(), "/printers/%s", iPrinterName);
+        }
+        else
+        {
+            httpAssembleURIf(HTTP_URI_CODING_ALL, uri, sizeof(uri), "ipp", NULL, "localhost", ippPort(), "/");
+        }
+        ipp_t *request = ippNewRequest(iOperation);
+        ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_URI, "printer-uri", NULL, uri);
+        ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME, "requesting-user-name", NULL, cupsUser());
+        return request;
+    }
 
-        std::ostringstream error_str; // error string
+    /* libcups calls recording statistics (see getStats), same arguments and results as the wrapped functions */
+
+    ipp_t* doRequest(http_t *http, ipp_t *request)
+    {
+        StatsTimer timer(STATS_METRIC("cupsDoRequest"));
+        ipp_t *response = cupsDoRequest(http, request, "/");
+        timer.setError(response == NULL || ippGetStatusCode(response) > IPP_STATUS_OK_CONFLICTING);
+        return response;
+    }
 
-        if ((filename = cupsGetPPD(printer->name)) != NULL)
+    /// @param iAttributes optional, the options already encoded as IPP attributes (see CupsOptions::encode), sent instead of them.
+    ///        A printer unknown to the server falls back to cupsCreateJob with the options
+    int createJob(http_t *http, const char *name, const char *title, int num_options, cups_option_t *options,
+                  const ipp_t *iAttributes = NULL)
+    {
+        StatsTimer timer(STATS_METRIC("cupsCreateJob"));
+        int job_id = 0;
+        if(iAttributes == NULL)
+        {
+            job_id = cupsCreateJob(http, name, title, num_options, options);
+        }
+        else
         {
-            if ((ppd = ppdOpenFile(filename)) != NULL)
+            // the Create-Job request of cupsCreateJob, without its lookup of the destination
+            ipp_t *request = newPrinterRequest(IPP_OP_CREATE_JOB, name);
+            if(title != NULL)
             {
-                 ppdMarkDefaults(ppd);
-                 cupsMarkOptions(ppd, printer->num_options, printer->options);
-
-                 for (i = ppd->num_groups, group = ppd->groups; i > 0; --i, ++group)
-                 {
-                    populatePpdOptions(ppd_options, ppd, group);
-                 }
-                 ppdClose(ppd);
+                ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME, "job-name", NULL, title);
             }
-            else
+            // quick copy: the values are not duplicated, iAttributes outlives the request and is only read
+            ippCopyAttributes(request, const_cast<ipp_t*>(iAttributes), 1, NULL, NULL);
+            std::string resource("/printers/");
+            resource += name;
+            ipp_t *response = cupsDoRequest(http, request, resource.c_str());
+            ipp_attribute_t *attr = (response != NULL && ippGetStatusCode(response) <= IPP_STATUS_OK_CONFLICTING)
+                ? ippFindAttribute(response, "job-id", IPP_TAG_INTEGER) : NULL;
+            if(attr != NULL)
             {
-                error_str << "Unable to open PPD filename " << filename << " ";
+                job_id = ippGetInteger(attr, 0);
             }
-            unlink(filename);
+            ippDelete(response);
+            if(job_id == 0 && cupsLastError() == IPP_STATUS_ERROR_NOT_FOUND)
+            {
+                // a discovered IPP Everywhere/driverless printer has no queue until cupsCreateJob
+                // creates its temporary one (CUPS 2.2+): retry through it with the plain options
+                job_id = cupsCreateJob(http, name, title, num_options, options);
+            }
+        }
+        timer.setError(job_id == 0);
+        return job_id;
+    }
+
+    /// @param compression IPP compression of the document data, e.g. "gzip", NULL if not compressed
+    http_status_t startDocument(http_t *http, const char *name, int job_id, const char *docname, const char *format, int last_document,
+                                const char *compression = NULL)
+    {
+        StatsTimer timer(STATS_METRIC("cupsStartDocument"));
+        http_status_t status;
+        if(compression == NULL)
+        {
+            status = cupsStartDocument(http, name, job_id, docname, format, last_document);
         }
         else
         {
-            error_str << "Unable to get CUPS PPD driver file. ";
+            // the Send-Document request of cupsStartDocument, with the compression attribute
+            ipp_t *request = newPrinterRequest(IPP_OP_SEND_DOCUMENT, name);
+            ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "job-id", job_id);
+            if(docname != NULL)
+            {
+                ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME, "document-name", NULL, docname);
+            }
+            if(format != NULL)
+            {
+                ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_MIMETYPE, "document-format", NULL, format);
+            }
+            ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD, "compression", NULL, compression);
+            ippAddBoolean(request, IPP_TAG_OPERATION, "last-document", static_cast<char>(last_document));
+            std::string resource("/printers/");
+            resource += name;
+            status = cupsSendRequest(http, request, resource.c_str(), CUPS_LENGTH_VARIABLE);
+            ippDelete(request);
         }
+        timer.setError(status != HTTP_CONTINUE);
+        return status;
+    }
 
-        return error_str.str();
+    http_status_t writeRequestData(http_t *http, const char *buffer, size_t length)
+    {
+        StatsTimer timer(STATS_METRIC("cupsWriteRequestData"));
+        http_status_t status = cupsWriteRequestData(http, buffer, length);
+        timer.setError(status != HTTP_CONTINUE);
+        timer.addBytes(length);
+        return status;
     }
 
+    /// Compression of the documents sent, see getCompression
+    struct Compression {
+        Compression(): gzip(false), level(Z_DEFAULT_COMPRESSION) {}
+
+        /// IPP compression keyword, NULL if not compressed
+        const char* getName() const { return gzip ? "gzip" : NULL; }
+
+        bool gzip;
+        int level;
+    };
 
-    /** Parse printer info object
+    /** Read compression arguments
+     * @param iType undefined, "none" or "gzip"
+     * @param iLevel undefined or a zlib compression level, 0 (none) to 9 (best)
      * @return error string.
      */
-    std::string parsePrinterInfo(const cups_dest_t * printer, v8::Local<v8::Object> result_printer)
+    std::string getCompression(v8::Local<v8::Value> iType, v8::Local<v8::Value> iLevel, Compression &oCompression)
     {
-        MY_NODE_MODULE_ISOLATE_DECL
-        Nan::Set(result_printer, V8_STRING_NEW_UTF8("name"), V8_STRING_NEW_UTF8(printer->name));
-        Nan::Set(result_printer, V8_STRING_NEW_UTF8("isDefault"), V8_VALUE_NEW(Boolean, static_cast<bool>(printer->is_default)));
+        oCompression = Compression();
+        if(!iType->IsUndefined())
+        {
+            std::string type(iType->IsString() ? *Nan::Utf8String(iType) : "");
+            if(type == "gzip")
+            {
+                oCompression.gzip = true;
+            }
+            else if(type != "none")
+            {
+                return "compression must be one of none, gzip";
+            }
+        }
+        if(!iLevel->IsUndefined())
+        {
+            if(!iLevel->IsInt32() || Nan::To<int32_t>(iLevel).FromJust() < 0 || Nan::To<int32_t>(iLevel).FromJust() > 9)
+            {
+                return "compressionLevel must be an integer from 0 to 9";
+            }
+            oCompression.level = Nan::To<int32_t>(iLevel).FromJust();
+        }
+        return "";
+    }
 
-        if(printer->instance)
+    /** Writes the data of a started document, through gzip deflate if compressed.
+     * Deflate time and bytes before and after compression are recorded in the
+     * deflate and deflate:compressed metrics.
+     * Does not touch v8, so it can run on a worker thread.
+     */
+    class DocumentWriter {
+    public:
+        DocumentWriter(const Compression &iCompression): compressed(false), bytes_in(0), bytes_out(0), deflate_ns(0), deflate_failed(false)
         {
-            Nan::Set(result_printer, V8_STRING_NEW_UTF8("instance"), V8_STRING_NEW_UTF8(printer->instance));
+            if(iCompression.gzip)
+            {
+                memset(&stream, 0, sizeof(stream));
+                // 16 + max window bits: gzip header and trailer
+                compressed = (deflateInit2(&stream, iCompression.level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+                deflate_failed = !compressed;
+            }
         }
 
-        v8::Local<v8::Object> result_printer_options = V8_VALUE_NEW_DEFAULT(Object);
-        cups_option_t *dest_option = printer->options;
-        for(int j = 0; j < printer->num_options; ++j, ++dest_option)
+        ~DocumentWriter()
         {
-            Nan::Set(result_printer_options, V8_STRING_NEW_UTF8(dest_option->name), V8_STRING_NEW_UTF8(dest_option->value));
+            if(compressed)
+            {
+                deflateEnd(&stream);
+                STATS_METRIC("deflate").record(deflate_ns, deflate_failed, bytes_in);
+                // bytes only: the call and its duration are in "deflate"
+                STATS_METRIC("deflate:compressed").addBytes(bytes_out);
+            }
         }
-        Nan::Set(result_printer, V8_STRING_NEW_UTF8("options"), result_printer_options);
-        // Get printer jobs
-        cups_job_t * jobs;
-        int totalJobs = cupsGetJobs(&jobs, printer->name, 0 /*0 means all users*/, CUPS_WHICHJOBS_ACTIVE);
-        std::string error_str;
-        if(totalJobs > 0)
+
+        /// @return HTTP_CONTINUE on success, like cupsWriteRequestData
+        http_status_t write(http_t *http, const char *iData, size_t iSize)
         {
-            v8::Local<v8::Array> result_priner_jobs = V8_VALUE_NEW(Array, totalJobs);
-            int jobi =0;
-            cups_job_t * job = jobs;
-            for(; jobi < totalJobs; ++jobi, ++job)
+            if(!compressed)
             {
-                v8::Local<v8::Object> result_printer_job = V8_VALUE_NEW_DEFAULT(Object);
-                error_str = parseJobObject(job, result_printer_job);
-                if(!error_str.empty())
+                return deflate_failed ? HTTP_STATUS_ERROR : writeRequestData(http, iData, iSize);
+            }
+            bytes_in += iSize;
+            // avail_in holds at most 4GB
+            for(size_t offset = 0; offset < iSize; )
+            {
+                uInt length = static_cast<uInt>(std::min<size_t>(iSize - offset, 1 << 30));
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(iData + offset));
+                stream.avail_in = length;
+                if(deflateData(http, Z_NO_FLUSH) != HTTP_CONTINUE)
                 {
-                    // got an error? break then.
-                    break;
+                    return HTTP_STATUS_ERROR;
                 }
-                Nan::Set(result_priner_jobs, jobi, result_printer_job);
+                offset += length;
             }
-            Nan::Set(result_printer, V8_STRING_NEW_UTF8("jobs"), result_priner_jobs);
+            return HTTP_CONTINUE;
         }
-        cupsFreeJobs(totalJobs, jobs);
-        return error_str;
-    }
 
-    /// cups option class to automatically free memory.
-    class CupsOptions: public MemValueBase<cups_option_t> {
-    protected:
-        int num_options;
-        virtual void free() {
-            if(_value != NULL)
+        /// Write the end of the compressed data, to call before finishDocument
+        http_status_t finish(http_t *http)
+        {
+            if(!compressed)
             {
-                cupsFreeOptions(num_options, get());
-                _value = NULL;
-                num_options = 0;
+                return deflate_failed ? HTTP_STATUS_ERROR : HTTP_CONTINUE;
             }
+            stream.next_in = NULL;
+            stream.avail_in = 0;
+            return deflateData(http, Z_FINISH);
         }
-    public:
-        CupsOptions(): num_options(0) {}
-        ~CupsOptions () { free(); }
-
-        /// Add options from v8 object
-        CupsOptions(v8::Local<v8::Object> iV8Options): num_options(0) {
-            v8::Local<v8::Array> props = Nan::GetPropertyNames(iV8Options).ToLocalChecked();
 
-            for(unsigned int i = 0; i < props->Length(); ++i) {
-                v8::Local<v8::Value> key(Nan::Get(props, i).ToLocalChecked());
-                Nan::Utf8String keyStr(V8_LOCAL_STRING_FROM_VALUE(key));
-                Nan::Utf8String valStr(V8_LOCAL_STRING_FROM_VALUE(Nan::Get(iV8Options, key).ToLocalChecked()));
+        /// Error of the last failed write or finish
+        std::string getError() const
+        {
+            return deflate_failed ? std::string("Unable to compress the document") : std::string(cupsLastErrorString());
+        }
+    private:
+        DocumentWriter(const DocumentWriter&);
+        DocumentWriter& operator=(const DocumentWriter&);
 
-                num_options = cupsAddOption(*keyStr, *valStr, num_options, &_value);
+        /// Deflate the pending input and write the output, at most kChunkSize bytes at once
+        http_status_t deflateData(http_t *http, int iFlush)
+        {
+            static const size_t kChunkSize = 64 * 1024;
+            if(output.empty())
+            {
+                output.resize(kChunkSize);
             }
+            int result = Z_OK;
+            do
+            {
+                stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+                stream.avail_out = static_cast<uInt>(output.size());
+                uint64_t start = uv_hrtime();
+                result = deflate(&stream, iFlush);
+                deflate_ns += uv_hrtime() - start;
+                if(result == Z_STREAM_ERROR)
+                {
+                    deflate_failed = true;
+                    return HTTP_STATUS_ERROR;
+                }
+                size_t size = output.size() - stream.avail_out;
+                bytes_out += size;
+                if(size > 0 && writeRequestData(http, &output[0], size) != HTTP_CONTINUE)
+                {
+                    return HTTP_STATUS_ERROR;
+                }
+            } while(stream.avail_out == 0 || (iFlush == Z_FINISH && result != Z_STREAM_END));
+            return HTTP_CONTINUE;
         }
 
-        const int& getNumOptions() { return num_options; }
-    };
+        bool compressed;
+        z_stream stream;
+        std::vector<char> output;
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t deflate_ns;
+        bool deflate_failed;
+    };
+
+    ipp_status_t finishDocument(http_t *http, const char *name)
+    {
+        StatsTimer timer(STATS_METRIC("cupsFinishDocument"));
+        ipp_status_t status = cupsFinishDocument(http, name);
+        timer.setError(status > IPP_STATUS_OK_CONFLICTING);
+        return status;
+    }
+
+    ipp_status_t cancelJob(http_t *http, const char *name, int job_id)
+    {
+        StatsTimer timer(STATS_METRIC("cupsCancelJob"));
+        ipp_status_t status = cupsCancelJob2(http, name, job_id, 0);
+        timer.setError(status > IPP_STATUS_OK_CONFLICTING);
+        return status;
+    }
+
+    /** Open a new connection to a CUPS server, for a use from any thread
+     * @param iServer "host", "host:port" or "[ipv6]:port", empty for the default server (CUPS_SERVER, client.conf)
+     * @param iCancel optional, a non zero value set by another thread stops the connection attempt
+     */
+    http_t* connectToServer(const std::string &iServer = std::string(), int *iCancel = NULL)
+    {
+        std::string host(iServer.empty() ? cupsServer() : iServer);
+        int port = ippPort();
+        size_t colon = host.rfind(':');
+        if(!iServer.empty() && colon != std::string::npos && host.find(']', colon) == std::string::npos
+           && (host[0] == '[' || host.find(':') == colon))
+        {
+            port = atoi(host.c_str() + colon + 1);
+            host.erase(colon);
+        }
+        if(host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']')
+        {
+            host = host.substr(1, host.size() - 2);
+        }
+        StatsTimer timer(STATS_METRIC("httpConnect"));
+        http_t *http = httpConnect2(host.c_str(), port, NULL, AF_UNSPEC, cupsEncryption(), 1, 30000, iCancel);
+        timer.setError(http == NULL);
+        return http;
+    }
+
+    /** Abort of the requests of a thread from another thread: the connection in use is shut down,
+     * which ends a blocked read or write at once, and a connection attempt gives up
+     */
+    class HttpAbort {
+    public:
+        HttpAbort(): cancel(0), http(NULL) {}
+
+        /// Abort the current and next requests, until reset
+        void abort()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancel = 1;
+            if(http != NULL)
+            {
+                httpShutdown(http);
+            }
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancel = 0;
+        }
+
+        bool isAborted()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return cancel != 0;
+        }
+
+        /// Flag polled by httpConnect2
+        int* getCancel() { return &cancel; }
+
+        /// Connection of the requests, shut down at once if already aborted
+        void attach(http_t *iHttp)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            http = iHttp;
+            if(cancel != 0)
+            {
+                httpShutdown(http);
+            }
+        }
+
+        /// @return true if the connection may have been shut down
+        bool detach()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            http = NULL;
+            return cancel != 0;
+        }
+    private:
+        HttpAbort(const HttpAbort&);
+        HttpAbort& operator=(const HttpAbort&);
+
+        std::mutex mutex;
+        int cancel;
+        http_t *http;
+    };
+
+    /** Pool of connections to the CUPS servers.
+     * CUPS_HTTP_DEFAULT is a single per-thread connection: the pool lets worker threads
+     * run requests in parallel and reuse connections instead of connecting for each job.
+     * Idle connections are kept by server, the size limit applies to each server.
+     * A connection is used by one thread at a time, leased with HttpLease.
+     */
+    class HttpPool {
+    public:
+        struct Stats {
+            size_t active;
+            size_t idle;
+            uint64_t created;
+            uint64_t reused;
+        };
+
+        static HttpPool& instance()
+        {
+            static HttpPool pool;
+            return pool;
+        }
+
+        /** @param iSize number of idle connections kept for reuse by server, 0 closes connections after each operation
+         *  @param iKeepAlive use HTTP keep-alive on pooled connections
+         *  @param iIdleTimeout ms after which an idle connection is closed, <= 0 to keep them
+         */
+        void configure(int iSize, bool iKeepAlive, int iIdleTimeout)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size = (iSize > 0) ? static_cast<size_t>(iSize) : 0;
+            keep_alive = iKeepAlive;
+            idle_timeout = iIdleTimeout;
+            evict(0);
+        }
+
+        /** @param iServer server address, empty for the default server (see connectToServer)
+         *  @return a connection, NULL if the server can not be reached
+         */
+        /// @param iCancel optional, see connectToServer
+        http_t* acquire(const std::string &iServer = std::string(), int *iCancel = NULL)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                evict(size);
+                std::vector<Idle> &server_idle = idle[iServer];
+                if(!server_idle.empty())
+                {
+                    http_t *http = server_idle.back().http;
+                    server_idle.pop_back();
+                    leased[http] = iServer;
+                    ++reused;
+                    return http;
+                }
+            }
+            // connect outside of the lock
+            http_t *http = connectToServer(iServer, iCancel);
+            if(http == NULL)
+            {
+                return NULL;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            httpSetKeepAlive(http, keep_alive ? HTTP_KEEPALIVE_ON : HTTP_KEEPALIVE_OFF);
+            leased[http] = iServer;
+            ++created;
+            return http;
+        }
+
+        /** Give back a leased connection
+         * @param iReusable false if the connection is in an unknown state (e.g. interrupted request)
+         */
+        void release(http_t *http, bool iReusable)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            std::map<http_t*, std::string>::iterator itLeased = leased.find(http);
+            std::vector<Idle> &server_idle = idle[itLeased->second];
+            leased.erase(itLeased);
+            if(iReusable && keep_alive && httpError(http) == 0 && server_idle.size() < size)
+            {
+                Idle entry = { http, uv_hrtime() };
+                server_idle.push_back(entry);
+                return;
+            }
+            lock.unlock();
+            httpClose(http);
+        }
+
+        Stats getStats()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            evict(size);
+            Stats stats = { leased.size(), 0, created, reused };
+            for(IdleMapType::const_iterator itIdle = idle.begin(); itIdle != idle.end(); ++itIdle)
+            {
+                stats.idle += itIdle->second.size();
+            }
+            return stats;
+        }
+
+    private:
+        struct Idle {
+            http_t *http;
+            uint64_t since; // uv_hrtime ns
+        };
+        typedef std::map<std::string, std::vector<Idle> > IdleMapType;
+
+        HttpPool(): size(4), keep_alive(true), idle_timeout(30000), created(0), reused(0) {}
+
+        ~HttpPool()
+        {
+            evict(0);
+        }
+
+        /// Close expired idle connections and the ones above iMaxIdle by server, mutex must be locked
+        void evict(size_t iMaxIdle)
+        {
+            // most recently used are at the back
+            uint64_t now = uv_hrtime();
+            for(IdleMapType::iterator itIdle = idle.begin(); itIdle != idle.end(); ++itIdle)
+            {
+                std::vector<Idle> &server_idle = itIdle->second;
+                size_t first_kept = (server_idle.size() > iMaxIdle) ? server_idle.size() - iMaxIdle : 0;
+                while(first_kept < server_idle.size() && idle_timeout > 0
+                      && (now - server_idle[first_kept].since) / 1000000 >= static_cast<uint64_t>(idle_timeout))
+                {
+                    ++first_kept;
+                }
+                for(size_t i = 0; i < first_kept; ++i)
+                {
+                    httpClose(server_idle[i].http);
+                }
+                server_idle.erase(server_idle.begin(), server_idle.begin() + first_kept);
+            }
+        }
+
+        std::mutex mutex;
+        IdleMapType idle;
+        std::map<http_t*, std::string> leased;
+        size_t size;
+        bool keep_alive;
+        int idle_timeout;
+        uint64_t created;
+        uint64_t reused;
+    };
+
+    /// A pooled connection leased for the duration of one operation
+    class HttpLease {
+    public:
+        /** @param iServer server address, empty for the default server (see connectToServer)
+         * @param iAbort optional, lets another thread abort the requests on the connection
+         */
+        explicit HttpLease(const std::string &iServer = std::string(), HttpAbort *iAbort = NULL):
+            http(HttpPool::instance().acquire(iServer, (iAbort != NULL) ? iAbort->getCancel() : NULL)),
+            server(iServer), reusable(true), abort(iAbort)
+        {
+            if(abort != NULL && http != NULL)
+            {
+                abort->attach(http);
+            }
+        }
+        ~HttpLease() { release(); }
+
+        /** @return the connection. NULL if the server can not be reached: CUPS functions then use
+         *  CUPS_HTTP_DEFAULT and report the connection error. Check getError() first for another server
+         */
+        http_t* get() const { return http; }
+
+        /// @return error string if a given server could not be reached, the default server falls back to CUPS_HTTP_DEFAULT
+        std::string getError() const
+        {
+            if(http != NULL || server.empty())
+            {
+                return "";
+            }
+            return "Unable to connect to " + server + ": " + cupsLastErrorString();
+        }
+
+        /// Close the connection instead of giving it back to the pool
+        void discard() { reusable = false; }
+
+        void release()
+        {
+            if(http != NULL)
+            {
+                if(abort != NULL && abort->detach())
+                {
+                    reusable = false;
+                }
+                HttpPool::instance().release(http, reusable);
+                http = NULL;
+            }
+        }
+    private:
+        HttpLease(const HttpLease&);
+        HttpLease& operator=(const HttpLease&);
+
+        http_t *http;
+        std::string server;
+        bool reusable;
+        HttpAbort *abort;
+    };
+
+    /** Create a job request for a printer with the attributes required by IppJob
+     * @param iAttributes attributes requested by the caller, all the IppJob ones if empty
+     */
+    ipp_t* newJobRequest(ipp_op_t iOperation, const char *iPrinterName, const RequestedAttributes &iAttributes)
+    {
+        ipp_t *request = newPrinterRequest(iOperation, iPrinterName);
+        if(iAttributes.empty())
+        {
+            ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD, "requested-attributes", kJobAttributesSize, NULL, kJobAttributes);
+        }
+        else
+        {
+            // id and printer are needed to match the jobs
+            static const char * const required[] = { "job-id", "job-printer-uri" };
+            iAttributes.addTo(request, required, sizeof(required) / sizeof(required[0]));
+        }
+        return request;
+    }
+
+    /// Whether the server listed the request attribute iName in the unsupported attributes of iResponse
+    bool isUnsupported(ipp_t *iResponse, const char *iName)
+    {
+        ipp_attribute_t *attr = ippFindAttribute(iResponse, iName, IPP_TAG_ZERO);
+        return (attr != NULL) && (ippGetGroupTag(attr) == IPP_TAG_UNSUPPORTED_GROUP);
+    }
+
+    /** Retrieve jobs of a printer by id, without downloading the whole jobs history.
+     * Several ids are requested with a single Get-Jobs "job-ids" request when the server supports it,
+     * else with one Get-Job-Attributes request per id.
+     * @param iAttributes job attributes to retrieve, all the converted ones if empty
+     * @param iServer server address, empty for the default server
+     * @param oJobs found jobs of iPrinterName, in any order
+     * @return error string. Unknown jobs are not an error
+     */
+    std::string getJobsById(const char *iPrinterName, const std::vector<int> &iJobIds,
+                            const RequestedAttributes &iAttributes, const std::string &iServer, IppJobListType &oJobs)
+    {
+        IppJobListType jobs;
+        bool done = false;
+        HttpLease http(iServer);
+        if(!http.getError().empty())
+        {
+            return http.getError();
+        }
+        if(iJobIds.size() > 1)
+        {
+            ipp_t *request = newJobRequest(IPP_OP_GET_JOBS, iPrinterName, iAttributes);
+            ippAddIntegers(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "job-ids", static_cast<int>(iJobIds.size()), &iJobIds[0]);
+            ipp_t *response = doRequest(http.get(), request);
+            // a server which ignores job-ids answers with all the jobs and successful-ok-ignored-or-substituted-attributes
+            if(response != NULL && ippGetStatusCode(response) == IPP_STATUS_OK && !isUnsupported(response, "job-ids"))
+            {
+                parseIppJobs(response, jobs);
+                done = true;
+            }
+            ippDelete(response);
+        }
+        if(!done)
+        {
+            for(std::vector<int>::const_iterator itId = iJobIds.begin(); itId != iJobIds.end(); ++itId)
+            {
+                ipp_t *request = newJobRequest(IPP_OP_GET_JOB_ATTRIBUTES, iPrinterName, iAttributes);
+                ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "job-id", *itId);
+                ipp_t *response = doRequest(http.get(), request);
+                if(response == NULL)
+                {
+                    return cupsLastErrorString();
+                }
+                ipp_status_t status = ippGetStatusCode(response);
+                if(status <= IPP_STATUS_OK_CONFLICTING)
+                {
+                    parseIppJobs(response, jobs);
+                }
+                ippDelete(response);
+                if(status > IPP_STATUS_OK_CONFLICTING && status != IPP_STATUS_ERROR_NOT_FOUND)
+                {
+                    return cupsLastErrorString();
+                }
+            }
+        }
+        // keep only the jobs of the printer
+        for(IppJobListType::iterator itJob = jobs.begin(); itJob != jobs.end(); ++itJob)
+        {
+            // printer names are case insensitive, as for cupsGetDest
+            if(strcasecmp(itJob->getDest().c_str(), iPrinterName) == 0)
+            {
+                oJobs.push_back(*itJob);
+            }
+        }
+        return "";
+    }
+
+    /// Printer read from the IPP printer attributes requested by the caller
+    struct IppPrinter {
+        IppPrinter(): is_default(false) {}
+
+        std::string name;
+        bool is_default;
+        AttributeListType attributes;
+    };
+
+    typedef std::vector<IppPrinter> IppPrinterListType;
+
+    /** Retrieve only the requested attributes of printers, with a CUPS-Get-Printers request
+     * or a Get-Printer-Attributes request for a single printer. Destinations are not used.
+     * @param iPrinterName printer name, NULL for all printers
+     * @param iServer server address, empty for the default server
+     * @param oPrinters found printers, empty if iPrinterName is not found
+     * @return error string.
+     */
+    std::string getPrintersAttributes(const char *iPrinterName, const RequestedAttributes &iAttributes, const std::string &iServer,
+                                      IppPrinterListType &oPrinters)
+    {
+        // name and default flag of the printer object
+        static const char * const required[] = { "printer-name", "printer-type" };
+        ipp_t *request = (iPrinterName != NULL) ? newPrinterRequest(IPP_OP_GET_PRINTER_ATTRIBUTES, iPrinterName)
+                                                : ippNewRequest(IPP_OP_CUPS_GET_PRINTERS);
+        iAttributes.addTo(request, required, sizeof(required) / sizeof(required[0]));
+        HttpLease http(iServer);
+        if(!http.getError().empty())
+        {
+            ippDelete(request);
+            return http.getError();
+        }
+        ipp_t *response = doRequest(http.get(), request);
+        if(response == NULL)
+        {
+            return cupsLastErrorString();
+        }
+        ipp_status_t status = ippGetStatusCode(response);
+        if(status > IPP_STATUS_OK_CONFLICTING)
+        {
+            ippDelete(response);
+            return (status == IPP_STATUS_ERROR_NOT_FOUND) ? "" : cupsLastErrorString();
+        }
+        IppPrinter *current = NULL;
+        for(ipp_attribute_t *attr = ippFirstAttribute(response); attr != NULL; attr = ippNextAttribute(response))
+        {
+            const char *name = ippGetName(attr);
+            if(ippGetGroupTag(attr) != IPP_TAG_PRINTER || name == NULL)
+            {
+                // separator or another group
+                current = NULL;
+                continue;
+            }
+            if(current == NULL)
+            {
+                oPrinters.push_back(IppPrinter());
+                current = &oPrinters.back();
+            }
+            if(strcmp(name, "printer-name") == 0)
+            {
+                current->name = ippGetString(attr, 0, NULL);
+            }
+            else if(strcmp(name, "printer-type") == 0)
+            {
+                current->is_default = (ippGetInteger(attr, 0) & CUPS_PRINTER_DEFAULT) != 0;
+            }
+            if(iAttributes.has(name))
+            {
+                current->attributes.push_back(std::make_pair(std::string(name), getAttributeValue(attr)));
+            }
+        }
+        ippDelete(response);
+        return "";
+    }
+
+    /** Parses printer driver PPD options
+     */
+    void populatePpdOptions(v8::Local<v8::Object> ppd_options, ppd_file_t  *ppd, ppd_group_t *group)
+    {
+        int i, j;
+        ppd_option_t *option;
+        ppd_choice_t *choice;
+        ppd_group_t *subgroup;
+
+        for (i = group->num_options, option = group->options; i > 0; --i, ++option)
+        {
+            MY_NODE_MODULE_ISOLATE_DECL
+            v8::Local<v8::Object> ppd_suboptions = V8_VALUE_NEW_DEFAULT(Object);
+            for (j = option->num_choices, choice = option->choices;
+                 j > 0;
+                 --j, ++choice)
+            {
+                Nan::Set(ppd_suboptions, V8_STRING_NEW_UTF8(choice->choice), V8_VALUE_NEW(Boolean, static_cast<bool>(choice->marked)));
+            }
+
+            Nan::Set(ppd_options, V8_STRING_NEW_UTF8(option->keyword), ppd_suboptions);
+        }
+
+        for (i = group->num_subgroups, subgroup = group->subgroups; i > 0; --i, ++subgroup) {
+            populatePpdOptions(ppd_options, ppd, subgroup);
+        }
+    }
+
+    class CupsDests;
+
+    /** Cache of parsed PPD files by printer.
+     * cupsGetPPD3 gets the modification time of the cached PPD, so an unchanged PPD is neither
+     * downloaded nor parsed again: only the marked choices are reset from the destination options.
+     * The map lock is only held to find an entry, each entry has its own lock for the download,
+     * so a slow printer does not hold back the lookups of the others.
+     */
+    class PpdCache {
+    public:
+        static PpdCache& instance()
+        {
+            static PpdCache cache;
+            return cache;
+        }
+
+        /** Mark PPD defaults and printer options, then fill ppd_options
+         * @param iDests destinations the printer comes from, entries of the printers not in them are dropped
+         * @return error string.
+         */
+        std::string populate(CupsDests &iDests, const cups_dest_t * printer, v8::Local<v8::Object> ppd_options);
+    private:
+        struct Entry {
+            Entry(): modtime(0), ppd(NULL) {}
+            ~Entry() { release(""); }
+
+            /// close the parsed PPD and remove its file, unless it is iKeepFilename
+            void release(const std::string &iKeepFilename)
+            {
+                if(ppd != NULL)
+                {
+                    ppdClose(ppd);
+                    ppd = NULL;
+                }
+                if(!filename.empty() && filename != iKeepFilename)
+                {
+                    unlink(filename.c_str());
+                }
+                filename.clear();
+                modtime = 0;
+            }
+
+            std::mutex mutex;
+            std::string filename;
+            time_t modtime;
+            ppd_file_t *ppd;
+        };
+        typedef std::shared_ptr<Entry> EntryPtr;
+        typedef std::map<std::string, EntryPtr> EntriesMapType;
+
+        /// Entry of iName, created if missing, after dropping the ones of the printers not in iDests
+        EntryPtr getEntry(CupsDests &iDests, const char *iName);
+
+        std::mutex mutex;
+        EntriesMapType entries;
+    };
+
+    /// cups destinations class to automatically free memory.
+    class CupsDests: public MemValueBase<cups_dest_t> {
+    protected:
+        int num_dests;
+        std::string error_str;
+        virtual void free() {
+            if(_value != NULL)
+            {
+                cupsFreeDests(num_dests, get());
+                _value = NULL;
+                num_dests = 0;
+            }
+        }
+    public:
+        /** Retrieve the destinations from lpoptions and the server
+         * @param iServer server address, empty for the default server
+         */
+        explicit CupsDests(const std::string &iServer = std::string()): num_dests(0) {
+            HttpLease http(iServer);
+            error_str = http.getError();
+            if(!error_str.empty())
+            {
+                return;
+            }
+            StatsTimer timer(STATS_METRIC("cupsGetDests"));
+            num_dests = cupsGetDests2(http.get(), &_value);
+            if(num_dests == 0 && cupsLastError() > IPP_STATUS_OK_CONFLICTING && cupsLastError() != IPP_STATUS_ERROR_NOT_FOUND)
+            {
+                timer.setError();
+                error_str = cupsLastErrorString();
+            }
+        }
+        ~CupsDests () { free(); }
+
+        const int& getNumDests() { return num_dests; }
+
+        /// Error of the retrieval, empty on success
+        const std::string& getError() const { return error_str; }
+
+        /// @return destination, NULL if not found
+        cups_dest_t* find(const char *iPrinterName) {
+            return cupsGetDest(iPrinterName, NULL, num_dests, get());
+        }
+    };
+
+    typedef std::shared_ptr<CupsDests> CupsDestsPtr;
+
+    PpdCache::EntryPtr PpdCache::getEntry(CupsDests &iDests, const char *iName)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(EntriesMapType::iterator itEntry = entries.begin(); itEntry != entries.end();)
+        {
+            // the PPD and its file go with the last user of the entry
+            if(iDests.find(itEntry->first.c_str()) == NULL)
+            {
+                entries.erase(itEntry++);
+            }
+            else
+            {
+                ++itEntry;
+            }
+        }
+        EntryPtr &entry = entries[iName];
+        if(!entry)
+        {
+            entry.reset(new Entry());
+        }
+        return entry;
+    }
+
+    std::string PpdCache::populate(CupsDests &iDests, const cups_dest_t * printer, v8::Local<v8::Object> ppd_options)
+    {
+        EntryPtr entry_ptr = getEntry(iDests, printer->name);
+        Entry &entry = *entry_ptr;
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        std::ostringstream error_str; // error string
+
+        char filename[1024];
+        strncpy(filename, entry.filename.c_str(), sizeof(filename) - 1);
+        filename[sizeof(filename) - 1] = '\0';
+        time_t modtime = entry.modtime;
+        HttpLease http;
+        http_status_t status;
+        {
+            StatsTimer timer(STATS_METRIC("cupsGetPPD"));
+            status = cupsGetPPD3(http.get(), printer->name, &modtime, filename, sizeof(filename));
+            timer.setError(status != HTTP_STATUS_OK && status != HTTP_STATUS_NOT_MODIFIED);
+        }
+        if(status == HTTP_STATUS_OK)
+        {
+            // new or changed PPD
+            entry.release(filename);
+            entry.filename = filename;
+            entry.modtime = modtime;
+            if((entry.ppd = ppdOpenFile(filename)) == NULL)
+            {
+                error_str << "Unable to open PPD filename " << filename << " ";
+                entry.release("");
+                return error_str.str();
+            }
+        }
+        else if(status != HTTP_STATUS_NOT_MODIFIED || entry.ppd == NULL)
+        {
+            error_str << "Unable to get CUPS PPD driver file. ";
+            entry.release("");
+            return error_str.str();
+        }
+
+        ppd_file_t *ppd = entry.ppd;
+        ppd_group_t *group;
+        int i;
+        ppdMarkDefaults(ppd);
+        cupsMarkOptions(ppd, printer->num_options, printer->options);
+
+        for (i = ppd->num_groups, group = ppd->groups; i > 0; --i, ++group)
+        {
+            populatePpdOptions(ppd_options, ppd, group);
+        }
+        return "";
+    }
+
+    /** Parse printer driver options
+     * @param iDests destinations printer comes from
+     * @return error string.
+     */
+    std::string parseDriverOptions(CupsDests &iDests, const cups_dest_t * printer, v8::Local<v8::Object> ppd_options)
+    {
+        return PpdCache::instance().populate(iDests, printer, ppd_options);
+    }
+
+    /// FNV-1a hash of the fields of a record, each field followed by a separator
+    class RecordHash {
+    public:
+        RecordHash(): hash(14695981039346656037ULL) {}
+
+        RecordHash& add(const char *iValue)
+        {
+            for(const char *c = iValue; c != NULL && *c; ++c)
+            {
+                hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ULL;
+            }
+            hash = (hash ^ '\n') * 1099511628211ULL;
+            return *this;
+        }
+
+        RecordHash& add(long long iValue)
+        {
+            char value[32];
+            snprintf(value, sizeof(value), "%lld", iValue);
+            return add(value);
+        }
+
+        uint64_t get() const { return hash; }
+    private:
+        uint64_t hash;
+    };
+
+    /** Process wide cache of cups destinations.
+     * Cached destinations are kept at most `ttl` ms. Every `checkInterval` ms the change times
+     * of the printers are requested from the server (one small CUPS-Get-Printers request)
+     * and the destinations are retrieved again as soon as they moved.
+     * A ttl of 0 disables the cache: destinations are retrieved on each call.
+     */
+    class DestCache {
+    public:
+        DestCache(): fetched_at(0), checked_at(0), ttl(0), check_interval(1000), signature(0) {}
+
+        static DestCache& instance()
+        {
+            static DestCache cache;
+            return cache;
+        }
+
+        void configure(double iTtl, double iCheckInterval)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ttl = iTtl;
+            check_interval = iCheckInterval;
+            if(ttl <= 0)
+            {
+                dests.reset();
+            }
+        }
+
+        /// Cached destinations, retrieved again if expired or changed on the server
+        CupsDestsPtr get()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(ttl <= 0)
+            {
+                return CupsDestsPtr(new CupsDests());
+            }
+            double now = nowMs();
+            if(dests && (now - fetched_at) < ttl)
+            {
+                if((now - checked_at) < check_interval)
+                {
+                    return dests;
+                }
+                checked_at = now;
+                uint64_t current_signature = 0;
+                if(getChangeSignature(current_signature) && (current_signature == signature))
+                {
+                    return dests;
+                }
+            }
+            return fetch(now);
+        }
+
+        /// Retrieve the destinations now
+        CupsDestsPtr refresh()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(ttl <= 0)
+            {
+                return CupsDestsPtr(new CupsDests());
+            }
+            return fetch(nowMs());
+        }
+
+        void invalidate()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dests.reset();
+        }
+
+    private:
+        /// must be called with the lock held
+        CupsDestsPtr fetch(double iNow)
+        {
+            // signature before destinations: a change in between is seen on the next check
+            signature = 0;
+            getChangeSignature(signature);
+            dests.reset(new CupsDests());
+            fetched_at = checked_at = iNow;
+            return dests;
+        }
+
+        static double nowMs()
+        {
+            return static_cast<double>(uv_hrtime()) / 1e6;
+        }
+
+        /** Hash of printer names and their state/config change times
+         * @return false if the server could not be queried
+         */
+        static bool getChangeSignature(uint64_t &oSignature)
+        {
+            static const char * const requested[] = {
+                "printer-name",
+                "printer-state-change-time",
+                "printer-config-change-time"
+            };
+            ipp_t *request = ippNewRequest(IPP_OP_CUPS_GET_PRINTERS);
+            ippAddStrings(request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD, "requested-attributes",
+                          sizeof(requested) / sizeof(requested[0]), NULL, requested);
+            HttpLease http;
+            ipp_t *response = doRequest(http.get(), request);
+            if(response == NULL)
+            {
+                return false;
+            }
+            bool ok = (ippGetStatusCode(response) <= IPP_STATUS_OK_CONFLICTING);
+            RecordHash hash;
+            for(ipp_attribute_t *attr = ippFirstAttribute(response); attr != NULL; attr = ippNextAttribute(response))
+            {
+                const char *name = ippGetName(attr);
+                if(name == NULL)
+                {
+                    continue;
+                }
+                char value[256];
+                ippAttributeString(attr, value, sizeof(value));
+                hash.add(value);
+            }
+            ippDelete(response);
+            oSignature = hash.get();
+            return ok;
+        }
+
+        std::mutex mutex;
+        CupsDestsPtr dests;
+        double fetched_at;
+        double checked_at;
+        double ttl;
+        double check_interval;
+        uint64_t signature;
+    };
+
+    typedef std::vector<const cups_job_t*> JobListType;
+    typedef std::map<std::string, JobListType> JobsByPrinterMapType;
+
+    /// cups jobs class to automatically free memory.
+    class CupsJobs: public MemValueBase<cups_job_t> {
+    protected:
+        int num_jobs;
+        std::string error_str;
+        virtual void free() {
+            if(_value != NULL)
+            {
+                cupsFreeJobs(num_jobs, get());
+                _value = NULL;
+                num_jobs = 0;
+            }
+        }
+    public:
+        /** Retrieve jobs with one Get-Jobs request
+         * @param iPrinterName printer name, NULL to retrieve the jobs of all printers
+         * @param iWhichJobs CUPS_WHICHJOBS_*
+         * @param iServer server address, empty for the default server
+         */
+        CupsJobs(const char *iPrinterName, int iWhichJobs, const std::string &iServer = std::string()): num_jobs(0) {
+            HttpLease http(iServer);
+            error_str = http.getError();
+            if(!error_str.empty())
+            {
+                return;
+            }
+            StatsTimer timer(STATS_METRIC("cupsGetJobs"));
+            num_jobs = cupsGetJobs2(http.get(), &_value, iPrinterName, 0 /*0 means all users*/, iWhichJobs);
+            timer.setError(num_jobs < 0);
+            if(num_jobs < 0)
+            {
+                error_str = cupsLastErrorString();
+                num_jobs = 0;
+            }
+        }
+        ~CupsJobs () { free(); }
+
+        const int& getNumJobs() { return num_jobs; }
+
+        /// Error of the retrieval, empty on success
+        const std::string& getError() const { return error_str; }
+
+        /// All jobs, in server order
+        void getList(JobListType &oJobs) {
+            cups_job_t *job = get();
+            for(int i = 0; i < num_jobs; ++i, ++job)
+            {
+                oJobs.push_back(job);
+            }
+        }
+
+        /// Jobs bucketed by destination name, server order is kept inside a bucket
+        void groupByPrinter(JobsByPrinterMapType &oJobs) {
+            cups_job_t *job = get();
+            for(int i = 0; i < num_jobs; ++i, ++job)
+            {
+                if(job->dest != NULL)
+                {
+                    oJobs[job->dest].push_back(job);
+                }
+            }
+        }
+    };
+
+    /// Convert jobs into oResult, sized by the caller
+    std::string parseJobList(RecordKeys &keys, const JobListType &jobs, v8::Local<v8::Array> oResult)
+    {
+        std::string error_str;
+        for(size_t jobi = 0; jobi < jobs.size(); ++jobi)
+        {
+            v8::Local<v8::Object> result_printer_job = keys.newJob();
+            error_str = parseJobObject(keys, jobs[jobi], result_printer_job);
+            if(!error_str.empty())
+            {
+                // got an error? break then.
+                break;
+            }
+            Nan::Set(oResult, static_cast<uint32_t>(jobi), result_printer_job);
+        }
+        return error_str;
+    }
+
+    /** Parse printer info object, created with keys.newPrinter()
+     * Jobs are set afterwards by setPrinterJobs.
+     */
+    void parsePrinterInfo(RecordKeys &keys, const cups_dest_t * printer, v8::Local<v8::Object> result_printer)
+    {
+        MY_NODE_MODULE_ISOLATE_DECL
+        Nan::Set(result_printer, keys.key(RecordKeys::NAME), keys.intern(printer->name));
+        Nan::Set(result_printer, keys.key(RecordKeys::IS_DEFAULT), V8_VALUE_NEW(Boolean, static_cast<bool>(printer->is_default)));
+
+        v8::Local<v8::Object> result_printer_options = V8_VALUE_NEW_DEFAULT(Object);
+        cups_option_t *dest_option = printer->options;
+        for(int j = 0; j < printer->num_options; ++j, ++dest_option)
+        {
+            Nan::Set(result_printer_options, keys.intern(dest_option->name), V8_STRING_NEW_UTF8(dest_option->value));
+        }
+        Nan::Set(result_printer, keys.key(RecordKeys::OPTIONS), result_printer_options);
+
+        if(printer->instance)
+        {
+            Nan::Set(result_printer, keys.key(RecordKeys::INSTANCE), V8_STRING_NEW_UTF8(printer->instance));
+        }
+    }
+
+    /** Parse printer info object from the requested attributes, created with keys.newPrinter()
+     * options holds the requested attributes only
+     */
+    void parseIppPrinterInfo(RecordKeys &keys, const IppPrinter &printer, v8::Local<v8::Object> result_printer)
+    {
+        MY_NODE_MODULE_ISOLATE_DECL
+        Nan::Set(result_printer, keys.key(RecordKeys::NAME), keys.intern(printer.name.c_str()));
+        Nan::Set(result_printer, keys.key(RecordKeys::IS_DEFAULT), V8_VALUE_NEW(Boolean, printer.is_default));
+
+        v8::Local<v8::Object> result_printer_options = V8_VALUE_NEW_DEFAULT(Object);
+        for(AttributeListType::const_iterator itAttribute = printer.attributes.begin(); itAttribute != printer.attributes.end(); ++itAttribute)
+        {
+            Nan::Set(result_printer_options, keys.intern(itAttribute->first.c_str()), V8_STRING_NEW_UTF8(itAttribute->second.c_str()));
+        }
+        Nan::Set(result_printer, keys.key(RecordKeys::OPTIONS), result_printer_options);
+    }
+
+    typedef std::shared_ptr<CupsJobs> CupsJobsPtr;
+
+    /// How getPrinters/getPrinter fill printer.jobs
+    enum JobsMode {
+        JOBS_NONE,  ///< jobs are not retrieved
+        JOBS_LAZY,  ///< jobs are retrieved, converted on first read of printer.jobs
+        JOBS_EAGER  ///< jobs are converted with the printer
+    };
+
+    /// @return false if iValue is not undefined nor one of "none", "lazy", "eager"
+    bool getJobsMode(v8::Local<v8::Value> iValue, JobsMode &oMode)
+    {
+        oMode = JOBS_EAGER;
+        if(iValue->IsUndefined())
+        {
+            return true;
+        }
+        if(!iValue->IsString())
+        {
+            return false;
+        }
+        std::string mode(*Nan::Utf8String(iValue));
+        if(mode == "none")
+        {
+            oMode = JOBS_NONE;
+        }
+        else if(mode == "lazy")
+        {
+            oMode = JOBS_LAZY;
+        }
+        else if(mode != "eager")
+        {
+            return false;
+        }
+        return true;
+    }
+
+    /** Jobs of a printer kept in native memory until printer.jobs is read.
+     * The jobs property is an accessor holding this wrapper: the first read converts the jobs
+     * and replaces the accessor by the array, which releases the wrapper.
+     */
+    class LazyJobs: public Nan::ObjectWrap {
+    public:
+        /// Define the jobs accessor on iPrinter
+        static void define(v8::Local<v8::Object> iPrinter, const CupsJobsPtr &iOwner, const JobListType &iJobs)
+        {
+            Nan::HandleScope scope;
+            static PerIsolate<IsolateFunctionTemplate> function_template;
+            IsolateFunctionTemplate &constructor = function_template.get();
+            if(constructor.isEmpty())
+            {
+                v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+                tpl->SetClassName(Nan::New("PrinterJobs").ToLocalChecked());
+                tpl->InstanceTemplate()->SetInternalFieldCount(1);
+                constructor.reset(tpl);
+            }
+            v8::Local<v8::Object> holder = Nan::NewInstance(constructor.getFunction()).ToLocalChecked();
+            LazyJobs *lazy_jobs = new LazyJobs(iOwner, iJobs);
+            lazy_jobs->Wrap(holder);
+            Nan::SetAccessor(iPrinter, RecordKeys::get().key(RecordKeys::JOBS), GetJobs, SetJobs, holder);
+        }
+    private:
+        LazyJobs(const CupsJobsPtr &iOwner, const JobListType &iJobs): owner(iOwner), jobs(iJobs) {}
+
+        static NAN_GETTER(GetJobs)
+        {
+            MY_NODE_MODULE_ISOLATE_DECL
+            LazyJobs *lazy_jobs = Nan::ObjectWrap::Unwrap<LazyJobs>(info.Data().As<v8::Object>());
+            RecordKeys &keys = RecordKeys::get();
+            v8::Local<v8::Array> result = V8_VALUE_NEW(Array, static_cast<int>(lazy_jobs->jobs.size()));
+            std::string error_str = parseJobList(keys, lazy_jobs->jobs, result);
+            if(!error_str.empty())
+            {
+                Nan::ThrowError(error_str.c_str());
+                return;
+            }
+            Nan::DefineOwnProperty(info.This(), keys.key(RecordKeys::JOBS), result);
+            info.GetReturnValue().Set(result);
+        }
+
+        /// Assigning printer.jobs replaces the accessor, like for a plain property
+        static NAN_SETTER(SetJobs)
+        {
+            Nan::DefineOwnProperty(info.This(), property, value);
+        }
+
+        CupsJobsPtr owner;
+        JobListType jobs;
+    };
+
+    /** Fill printer.jobs according to the jobs mode
+     * @param iOwner jobs list owning iJobs, kept by lazy jobs
+     * @param iJobs active jobs of the printer
+     * @return error string.
+     */
+    std::string setPrinterJobs(RecordKeys &keys, v8::Local<v8::Object> result_printer, JobsMode iMode,
+                               const CupsJobsPtr &iOwner, const JobListType &iJobs)
+    {
+        MY_NODE_MODULE_ISOLATE_DECL
+        std::string error_str;
+        if(iJobs.empty())
+        {
+            return error_str;
+        }
+        if(iMode == JOBS_LAZY)
+        {
+            LazyJobs::define(result_printer, iOwner, iJobs);
+        }
+        else if(iMode == JOBS_EAGER)
+        {
+            v8::Local<v8::Array> result_priner_jobs = V8_VALUE_NEW(Array, static_cast<int>(iJobs.size()));
+            error_str = parseJobList(keys, iJobs, result_priner_jobs);
+            Nan::Set(result_printer, keys.key(RecordKeys::JOBS), result_priner_jobs);
+        }
+        return error_str;
+    }
+
+    /// Printers and active jobs of one server
+    class ServerInventory {
+    public:
+        explicit ServerInventory(const std::string &iServer = std::string()): server(iServer) {}
+
+        /** Retrieve the printers: the requested attributes, or the destinations (cached for the default server).
+         * Does not touch v8, so it can run on any thread.
+         */
+        void fetch(JobsMode iJobsMode, const RequestedAttributes &iAttributes)
+        {
+            if(!iAttributes.empty())
+            {
+                error_str = getPrintersAttributes(NULL, iAttributes, server, ipp_printers);
+            }
+            else
+            {
+                dests = server.empty() ? DestCache::instance().get() : CupsDestsPtr(new CupsDests(server));
+                // the default server keeps reporting an unreachable server as no printer
+                if(!server.empty())
+                {
+                    error_str = dests->getError();
+                }
+            }
+            if(error_str.empty() && iJobsMode != JOBS_NONE)
+            {
+                // Active jobs of all printers with a single request
+                jobs.reset(new CupsJobs(NULL, CUPS_WHICHJOBS_ACTIVE, server));
+                // as for the destinations, a failure is reported for the servers given by the caller:
+                // their printers would be listed without their jobs
+                if(!server.empty())
+                {
+                    error_str = jobs->getError();
+                }
+            }
+        }
+
+        /** Append the printers to ioResult
+         * @param iTagServer set printer.server
+         * @return error string.
+         */
+        std::string convert(RecordKeys &keys, JobsMode iJobsMode, v8::Local<v8::Array> ioResult, uint32_t &ioIndex, bool iTagServer)
+        {
+            MY_NODE_MODULE_ISOLATE_DECL
+            JobsByPrinterMapType printers_jobs;
+            if(jobs)
+            {
+                jobs->groupByPrinter(printers_jobs);
+            }
+            const JobListType no_jobs;
+            cups_dest_t *printer = dests ? dests->get() : NULL;
+            int printers_size = dests ? dests->getNumDests() : static_cast<int>(ipp_printers.size());
+            v8::Local<v8::String> server_v8 = V8_STRING_NEW_UTF8(server.c_str());
+            for(int i = 0; i < printers_size; ++i)
+            {
+                v8::Local<v8::Object> result_printer = keys.newPrinter();
+                const char *printer_name = NULL;
+                if(printer != NULL)
+                {
+                    parsePrinterInfo(keys, printer, result_printer);
+                    printer_name = (printer++)->name;
+                }
+                else
+                {
+                    parseIppPrinterInfo(keys, ipp_printers[i], result_printer);
+                    printer_name = ipp_printers[i].name.c_str();
+                }
+                if(iTagServer)
+                {
+                    Nan::Set(result_printer, keys.key(RecordKeys::SERVER), server_v8);
+                }
+                JobsByPrinterMapType::const_iterator itJobs = printers_jobs.find(printer_name);
+                std::string error_str = setPrinterJobs(keys, result_printer, iJobsMode, jobs, (itJobs != printers_jobs.end()) ? itJobs->second : no_jobs);
+                if(!error_str.empty())
+                {
+                    // got an error? break then
+                    return error_str;
+                }
+                Nan::Set(ioResult, ioIndex++, result_printer);
+            }
+            return "";
+        }
+
+        const std::string& getServer() const { return server; }
+        const std::string& getError() const { return error_str; }
+    private:
+        std::string server;
+        CupsDestsPtr dests;
+        IppPrinterListType ipp_printers;
+        CupsJobsPtr jobs;
+        std::string error_str;
+    };
+
+    typedef std::vector<ServerInventory> ServerInventoryListType;
+
+    /** Versioned records of one kind (printers or jobs): compact hash of each record, with the versions
+     * it was added and last changed at. Removed records are kept as tombstones, at most kMaxRemoved.
+     */
+    template<typename KeyType>
+    class SnapshotTable {
+    public:
+        typedef std::map<KeyType, uint64_t> HashMapType;
+        typedef std::vector<KeyType> KeyListType;
+
+        SnapshotTable(): horizon(0) {}
+
+        /** Record the current hashes
+         * @param iVersion version of the changes
+         * @return true if a record was added, changed or removed
+         */
+        bool update(const HashMapType &iCurrent, uint64_t iVersion)
+        {
+            bool changed = false;
+            for(typename HashMapType::const_iterator itCurrent = iCurrent.begin(); itCurrent != iCurrent.end(); ++itCurrent)
+            {
+                typename RecordMapType::iterator itRecord = records.find(itCurrent->first);
+                if(itRecord == records.end())
+                {
+                    Record record = { itCurrent->second, iVersion, iVersion };
+                    records[itCurrent->first] = record;
+                    removed.erase(itCurrent->first);
+                    changed = true;
+                }
+                else if(itRecord->second.hash != itCurrent->second)
+                {
+                    itRecord->second.hash = itCurrent->second;
+                    itRecord->second.changed = iVersion;
+                    changed = true;
+                }
+            }
+            for(typename RecordMapType::iterator itRecord = records.begin(); itRecord != records.end();)
+            {
+                if(iCurrent.find(itRecord->first) != iCurrent.end())
+                {
+                    ++itRecord;
+                    continue;
+                }
+                removed[itRecord->first] = iVersion;
+                records.erase(itRecord++);
+                changed = true;
+            }
+            prune();
+            return changed;
+        }
+
+        /// Records added, changed and removed after iSince, all records as added if iSince is 0
+        void delta(uint64_t iSince, KeyListType &oAdded, KeyListType &oChanged, KeyListType &oRemoved) const
+        {
+            for(typename RecordMapType::const_iterator itRecord = records.begin(); itRecord != records.end(); ++itRecord)
+            {
+                if(itRecord->second.added > iSince)
+                {
+                    oAdded.push_back(itRecord->first);
+                }
+                else if(itRecord->second.changed > iSince)
+                {
+                    oChanged.push_back(itRecord->first);
+                }
+            }
+            if(iSince == 0)
+            {
+                return;
+            }
+            for(typename RemovedMapType::const_iterator itRemoved = removed.begin(); itRemoved != removed.end(); ++itRemoved)
+            {
+                if(itRemoved->second > iSince)
+                {
+                    oRemoved.push_back(itRemoved->first);
+                }
+            }
+        }
+
+        /// Newest version of the dropped tombstones: older versions can not get a delta
+        uint64_t getHorizon() const { return horizon; }
+
+    private:
+        static const size_t kMaxRemoved = 4096;
+
+        struct Record
+        {
+            uint64_t hash;
+            uint64_t added;
+            uint64_t changed;
+        };
+        typedef std::map<KeyType, Record> RecordMapType;
+        typedef std::map<KeyType, uint64_t> RemovedMapType;
+
+        /// Drop the oldest half of the tombstones once there are too many
+        void prune()
+        {
+            if(removed.size() <= kMaxRemoved)
+            {
+                return;
+            }
+            std::vector<uint64_t> versions;
+            for(typename RemovedMapType::const_iterator itRemoved = removed.begin(); itRemoved != removed.end(); ++itRemoved)
+            {
+                versions.push_back(itRemoved->second);
+            }
+            std::nth_element(versions.begin(), versions.begin() + kMaxRemoved / 2, versions.end());
+            horizon = std::max(horizon, versions[kMaxRemoved / 2]);
+            for(typename RemovedMapType::iterator itRemoved = removed.begin(); itRemoved != removed.end();)
+            {
+                if(itRemoved->second <= horizon)
+                {
+                    removed.erase(itRemoved++);
+                }
+                else
+                {
+                    ++itRemoved;
+                }
+            }
+        }
+
+        RecordMapType records;
+        RemovedMapType removed;
+        uint64_t horizon;
+    };
+
+    /** Process wide snapshot of the printers and active jobs, for pollers which only want what changed.
+     * Each update which changes a record bumps the version; a delta since a version lists the keys
+     * of the records added, changed and removed after it. Diffing is done on hashes, records are
+     * converted only when they are part of the delta.
+     * Versions are given to JS as "epoch.version" tokens: the epoch is drawn for each process, so a token
+     * kept across a restart (which starts again at version 0) gives a full snapshot.
+     */
+    class PrintersSnapshot {
+    public:
+        typedef SnapshotTable<std::string> PrinterTableType;
+        typedef SnapshotTable<int> JobTableType;
+
+        struct Delta
+        {
+            std::string version;
+            bool full;
+            PrinterTableType::KeyListType added_printers;
+            PrinterTableType::KeyListType changed_printers;
+            PrinterTableType::KeyListType removed_printers;
+            JobTableType::KeyListType added_jobs;
+            JobTableType::KeyListType changed_jobs;
+            JobTableType::KeyListType removed_jobs;
+        };
+
+        static PrintersSnapshot& instance()
+        {
+            static PrintersSnapshot snapshot;
+            return snapshot;
+        }
+
+        /** Record the current state and compute the delta since the version token iSince.
+         * The delta is a full snapshot if iSince is empty, of another process, unknown, or older than the kept tombstones
+         */
+        void update(const PrinterTableType::HashMapType &iPrinters, const JobTableType::HashMapType &iJobs,
+                    const std::string &iSince, Delta &oDelta)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bool printers_changed = printers.update(iPrinters, version + 1);
+            bool jobs_changed = jobs.update(iJobs, version + 1);
+            if(printers_changed || jobs_changed)
+            {
+                ++version;
+            }
+            std::ostringstream token;
+            token << epoch << '.' << version;
+            oDelta.version = token.str();
+            uint64_t since = parseToken(iSince);
+            oDelta.full = (since == 0) || (since > version)
+                || (since < printers.getHorizon()) || (since < jobs.getHorizon());
+            if(oDelta.full)
+            {
+                since = 0;
+            }
+            printers.delta(since, oDelta.added_printers, oDelta.changed_printers, oDelta.removed_printers);
+            jobs.delta(since, oDelta.added_jobs, oDelta.changed_jobs, oDelta.removed_jobs);
+        }
+
+    private:
+        PrintersSnapshot(): version(0)
+        {
+            std::random_device random;
+            std::ostringstream epoch_stream;
+            epoch_stream << std::hex << random() << static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+            epoch = epoch_stream.str();
+        }
+
+        /// @return version of a token of this process, 0 if it is not one
+        uint64_t parseToken(const std::string &iToken) const
+        {
+            // 19 digits fit in 64 bits
+            if(iToken.size() <= epoch.size() + 1 || iToken.size() > epoch.size() + 20
+               || iToken.compare(0, epoch.size(), epoch) != 0 || iToken[epoch.size()] != '.')
+            {
+                return 0;
+            }
+            uint64_t result = 0;
+            for(size_t i = epoch.size() + 1; i < iToken.size(); ++i)
+            {
+                if(iToken[i] < '0' || iToken[i] > '9')
+                {
+                    return 0;
+                }
+                result = result * 10 + static_cast<uint64_t>(iToken[i] - '0');
+            }
+            return result;
+        }
+
+        std::mutex mutex;
+        PrinterTableType printers;
+        JobTableType jobs;
+        uint64_t version;
+        std::string epoch;
+    };
+
+    /// Key of a destination in the snapshot: "name" or "name/instance"
+    std::string getPrinterKey(const cups_dest_t *iPrinter)
+    {
+        std::string key(iPrinter->name);
+        if(iPrinter->instance != NULL)
+        {
+            key.append("/").append(iPrinter->instance);
+        }
+        return key;
+    }
+
+    uint64_t hashPrinter(const cups_dest_t *iPrinter)
+    {
+        RecordHash hash;
+        hash.add(iPrinter->name).add(iPrinter->instance).add(iPrinter->is_default);
+        const cups_option_t *dest_option = iPrinter->options;
+        for(int j = 0; j < iPrinter->num_options; ++j, ++dest_option)
+        {
+            hash.add(dest_option->name).add(dest_option->value);
+        }
+        return hash.get();
+    }
+
+    uint64_t hashJob(const cups_job_t *iJob)
+    {
+        RecordHash hash;
+        hash.add(iJob->dest).add(iJob->title).add(iJob->user).add(iJob->format)
+            .add(iJob->state).add(iJob->priority).add(iJob->size)
+            .add(iJob->creation_time).add(iJob->processing_time).add(iJob->completed_time);
+        return hash.get();
+    }
+
+    /** Retrieve the inventories of several servers at once, one native thread by server:
+     * the duration is the one of the slowest server. A server whose thread can not be started
+     * is retrieved from this thread
+     */
+    void fetchInventories(ServerInventoryListType &ioInventories, JobsMode iJobsMode, const RequestedAttributes &iAttributes)
+    {
+        std::vector<std::thread> threads;
+        std::vector<ServerInventory*> inline_inventories;
+        threads.reserve(ioInventories.size());
+        for(size_t i = 1; i < ioInventories.size(); ++i)
+        {
+            ServerInventory *inventory = &ioInventories[i];
+            try
+            {
+                threads.emplace_back([inventory, iJobsMode, &iAttributes]() {
+                    inventory->fetch(iJobsMode, iAttributes);
+                });
+            }
+            catch(const std::system_error &)
+            {
+                // e.g. thread limit reached
+                inline_inventories.push_back(inventory);
+            }
+        }
+        // the first server from this thread
+        if(!ioInventories.empty())
+        {
+            ioInventories[0].fetch(iJobsMode, iAttributes);
+        }
+        for(std::vector<ServerInventory*>::iterator itInventory = inline_inventories.begin(); itInventory != inline_inventories.end(); ++itInventory)
+        {
+            (*itInventory)->fetch(iJobsMode, iAttributes);
+        }
+        for(std::vector<std::thread>::iterator itThread = threads.begin(); itThread != threads.end(); ++itThread)
+        {
+            itThread->join();
+        }
+    }
+
+    /** Read an optional server address
+     * @return false if iValue is neither undefined nor a string
+     */
+    bool getServer(v8::Local<v8::Value> iValue, std::string &oServer)
+    {
+        oServer.clear();
+        if(iValue->IsUndefined() || iValue->IsNull())
+        {
+            return true;
+        }
+        if(!iValue->IsString())
+        {
+            return false;
+        }
+        oServer = *Nan::Utf8String(iValue);
+        return true;
+    }
+
+    class CupsOptions;
+
+    /// Options of a print profile handle (see PrintProfile), empty if iValue is not one
+    std::shared_ptr<CupsOptions> getProfileOptions(v8::Local<v8::Value> iValue);
+
+    /** cups option class to automatically free memory.
+     * Options of a print profile are shared with it, along with their IPP encoding, instead of
+     * being converted again from JS: they must then be only read.
+     */
+    class CupsOptions: public MemValueBase<cups_option_t> {
+    protected:
+        int num_options;
+        ipp_t *attributes;
+        std::shared_ptr<CupsOptions> profile;
+        virtual void free() {
+            if(profile)
+            {
+                // owned by the profile
+                profile.reset();
+                _value = NULL;
+                attributes = NULL;
+            }
+            if(_value != NULL)
+            {
+                cupsFreeOptions(num_options, get());
+                _value = NULL;
+            }
+            if(attributes != NULL)
+            {
+                ippDelete(attributes);
+                attributes = NULL;
+            }
+            num_options = 0;
+        }
+    public:
+        CupsOptions(): num_options(0), attributes(NULL) {}
+        ~CupsOptions () { free(); }
+
+        /// Add options from v8 object, or share the ones of a print profile handle
+        CupsOptions(v8::Local<v8::Object> iV8Options): num_options(0), attributes(NULL) {
+            profile = getProfileOptions(iV8Options);
+            if(profile)
+            {
+                _value = profile->get();
+                num_options = profile->num_options;
+                attributes = profile->attributes;
+                return;
+            }
+            v8::Local<v8::Array> props = Nan::GetPropertyNames(iV8Options).ToLocalChecked();
+
+            for(unsigned int i = 0; i < props->Length(); ++i) {
+                v8::Local<v8::Value> key(Nan::Get(props, i).ToLocalChecked());
+                Nan::Utf8String keyStr(V8_LOCAL_STRING_FROM_VALUE(key));
+                Nan::Utf8String valStr(V8_LOCAL_STRING_FROM_VALUE(Nan::Get(iV8Options, key).ToLocalChecked()));
+
+                num_options = cupsAddOption(*keyStr, *valStr, num_options, &_value);
+            }
+        }
+
+        const int& getNumOptions() { return num_options; }
+
+        /// Not for the options of a profile
+        void add(const char *iName, const char *iValue) { num_options = cupsAddOption(iName, iValue, num_options, &_value); }
+
+        /** Encode the options as the IPP attributes of a Create-Job request, once:
+         * createJob then copies them instead of encoding the options for each job
+         */
+        void encode()
+        {
+            if(attributes != NULL)
+            {
+                return;
+            }
+            attributes = ippNew();
+            // the groups of cupsCreateJob, in the same order
+            cupsEncodeOptions2(attributes, num_options, _value, IPP_TAG_OPERATION);
+            cupsEncodeOptions2(attributes, num_options, _value, IPP_TAG_JOB);
+            cupsEncodeOptions2(attributes, num_options, _value, IPP_TAG_SUBSCRIPTION);
+        }
+
+        /// @return options encoded by encode(), NULL if not encoded
+        const ipp_t* getAttributes() const { return attributes; }
+    };
+
+    /** JS handle of print options built once (createPrintProfile) for the jobs which reuse them:
+     * the jobs share its cups_option_t array and their IPP encoding, so their options cost nothing
+     */
+    class PrintProfile: public Nan::ObjectWrap {
+    public:
+        static v8::Local<v8::Object> NewInstance(v8::Local<v8::Object> iV8Options)
+        {
+            Nan::EscapableHandleScope scope;
+            PrintProfile *wrapper = new PrintProfile(iV8Options);
+            v8::Local<v8::Object> result = Nan::NewInstance(Nan::GetFunction(getFunctionTemplate()).ToLocalChecked()).ToLocalChecked();
+            wrapper->Wrap(result);
+
+            // normalized copy of the options, for information
+            CupsOptions &options = *wrapper->options;
+            v8::Local<v8::Object> options_v8 = Nan::New<v8::Object>();
+            for(int i = 0; i < options.getNumOptions(); ++i)
+            {
+                Nan::Set(options_v8, Nan::New(options.get()[i].name).ToLocalChecked(), Nan::New(options.get()[i].value).ToLocalChecked());
+            }
+            Nan::DefineOwnProperty(result, Nan::New("options").ToLocalChecked(), options_v8, v8::ReadOnly);
+            return scope.Escape(result);
+        }
+
+        static PrintProfile* Unwrap(v8::Local<v8::Value> iValue)
+        {
+            if(!iValue->IsObject() || !getFunctionTemplate()->HasInstance(iValue))
+            {
+                return NULL;
+            }
+            return Nan::ObjectWrap::Unwrap<PrintProfile>(Nan::To<v8::Object>(iValue).ToLocalChecked());
+        }
+
+        /// Kept alive by the jobs using it, after the handle is collected
+        const std::shared_ptr<CupsOptions>& getOptions() const { return options; }
+
+    private:
+        static v8::Local<v8::FunctionTemplate> getFunctionTemplate()
+        {
+            static PerIsolate<IsolateFunctionTemplate> function_template;
+            IsolateFunctionTemplate &constructor = function_template.get();
+            if(constructor.isEmpty())
+            {
+                v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+                tpl->SetClassName(Nan::New("PrintProfile").ToLocalChecked());
+                tpl->InstanceTemplate()->SetInternalFieldCount(1);
+                constructor.reset(tpl);
+            }
+            return constructor.get();
+        }
+
+        PrintProfile(v8::Local<v8::Object> iV8Options): options(std::make_shared<CupsOptions>(iV8Options))
+        {
+            options->encode();
+        }
+
+        std::shared_ptr<CupsOptions> options;
+    };
+
+    std::shared_ptr<CupsOptions> getProfileOptions(v8::Local<v8::Value> iValue)
+    {
+        PrintProfile *profile = PrintProfile::Unwrap(iValue);
+        return (profile != NULL) ? profile->getOptions() : std::shared_ptr<CupsOptions>();
+    }
+
+    /// Document of a print job
+    struct PrintDocument {
+        std::string docname;
+        std::string format;
+        PrintData data;
+    };
+
+    typedef std::vector<PrintDocument> PrintDocumentListType;
+
+    /** Send documents as one job through create-job/send-document:
+     * every document but the last one is sent with last_document=0.
+     * A partially sent job is cancelled.
+     * Does not touch v8, so it can run on a worker thread.
+     * @param compression compression of the document data
+     * @param oStatus optional, IPP status of the failed request, to tell a rejected job from an unreachable server.
+     *        A failure at the HTTP level (connection lost while the document is sent) is IPP_STATUS_ERROR_SERVICE_UNAVAILABLE
+     * @param iAbort optional, lets another thread abort the job while it is sent. An aborted job fails with
+     *        IPP_STATUS_ERROR_SERVICE_UNAVAILABLE, and it is neither sent through nor cancelled on another connection
+     * @return job id, 0 on failure and error_str is filled
+     */
+    int printDocuments(const char *printername, const char *jobname, CupsOptions &options,
+                       const PrintDocumentListType &documents, const Compression &compression, std::string &error_str,
+                       ipp_status_t *oStatus = NULL, HttpAbort *iAbort = NULL)
+    {
+        HttpLease http(std::string(), iAbort);
+        if(iAbort != NULL && (http.get() == NULL || iAbort->isAborted()))
+        {
+            // no fall back on CUPS_HTTP_DEFAULT, whose connection can not be aborted
+            error_str = iAbort->isAborted() ? std::string("Aborted") : std::string("Unable to connect to CUPS server: ") + cupsLastErrorString();
+            if(oStatus != NULL)
+            {
+                *oStatus = IPP_STATUS_ERROR_SERVICE_UNAVAILABLE;
+            }
+            return 0;
+        }
+        int job_id = createJob(http.get(), printername, jobname, options.getNumOptions(), options.get(), options.getAttributes());
+        if(job_id == 0) {
+            error_str = cupsLastErrorString();
+            if(oStatus != NULL)
+            {
+                *oStatus = (iAbort != NULL && iAbort->isAborted()) ? IPP_STATUS_ERROR_SERVICE_UNAVAILABLE : cupsLastError();
+            }
+            return 0;
+        }
+
+        ipp_status_t status = IPP_STATUS_OK;
+        for(size_t i = 0; i < documents.size(); ++i)
+        {
+            const PrintDocument &document = documents[i];
+            int last_document = (i + 1 == documents.size()) ? 1 : 0;
+            if(HTTP_CONTINUE != startDocument(http.get(), printername, job_id, document.docname.c_str(), document.format.c_str(), last_document,
+                                              compression.getName())) {
+                error_str = cupsLastErrorString();
+                status = IPP_STATUS_ERROR_SERVICE_UNAVAILABLE;
+                http.discard();
+                break;
+            }
+
+            /* the whole document is in memory here, printStream uploads it chunk by chunk instead */
+            DocumentWriter writer(compression);
+            if (HTTP_CONTINUE != writer.write(http.get(), document.data.data(), document.data.size())
+                || HTTP_CONTINUE != writer.finish(http.get())) {
+                error_str = writer.getError();
+                // the status left by finishDocument on a broken connection would tell nothing about the job
+                status = IPP_STATUS_ERROR_SERVICE_UNAVAILABLE;
+                finishDocument(http.get(), printername);
+                http.discard();
+                break;
+            }
+
+            if(finishDocument(http.get(), printername) > IPP_STATUS_OK_CONFLICTING) {
+                error_str = cupsLastErrorString();
+                status = cupsLastError();
+                break;
+            }
+        }
+
+        if(!error_str.empty())
+        {
+            bool aborted = (iAbort != NULL && iAbort->isAborted());
+            if(oStatus != NULL)
+            {
+                *oStatus = aborted ? IPP_STATUS_ERROR_SERVICE_UNAVAILABLE : status;
+            }
+            http.release();
+            if(!aborted)
+            {
+                HttpLease cancel_http;
+                cancelJob(cancel_http.get(), printername, job_id);
+            }
+            return 0;
+        }
+        return job_id;
+    }
+
+    /** Send raw data to printer as a single document job.
+     * Does not touch v8, so it can run on a worker thread.
+     * @return job id, 0 on failure and error_str is filled
+     */
+    int printDirectData(const char *printername, const char *docname, const char *format,
+                        CupsOptions &options, const char *data, size_t data_size, const Compression &compression, std::string &error_str,
+                        ipp_status_t *oStatus = NULL, HttpAbort *iAbort = NULL)
+    {
+        PrintDocumentListType documents(1);
+        documents[0].docname = docname;
+        documents[0].format = format;
+        documents[0].data.assignView(data, data_size);
+        return printDocuments(printername, docname, options, documents, compression, error_str, oStatus, iAbort);
+    }
+
+    /// printDirect worker: the whole IPP exchange runs outside of the event loop
+    class PrintDirectWorker: public Nan::AsyncWorker {
+    public:
+        PrintDirectWorker(Nan::Callback *iCallback, const char *iPrinterName,
+                          const char *iDocName, const std::string &iFormat, v8::Local<v8::Object> iV8Options,
+                          const Compression &iCompression):
+            Nan::AsyncWorker(iCallback, "printer:printDirect"),
+            printername(iPrinterName), docname(iDocName), format(iFormat),
+            options(iV8Options), compression(iCompression), job_id(0) {}
+
+        /// Data to send. The v8 source value should be saved to persistent
+        PrintData& getData() { return data; }
+
+        void Execute() {
+            StatsTimer timer(STATS_METRIC("worker:printDirect"));
+            timer.addBytes(data.size());
+            std::string error_str;
+            job_id = printDirectData(printername.c_str(), docname.c_str(), format.c_str(), options, data.data(), data.size(), compression, error_str);
+            if(job_id == 0)
+            {
+                timer.setError();
+                SetErrorMessage(error_str.c_str());
+            }
+        }
+
+        void HandleOKCallback() {
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = { Nan::Null(), Nan::New<v8::Number>(job_id) };
+            callback->Call(2, argv, async_resource);
+        }
+    private:
+        PrintData data;
+        std::string printername;
+        std::string docname;
+        std::string format;
+        CupsOptions options;
+        Compression compression;
+        int job_id;
+    };
+
+    /// printBatch worker: all documents are sent in one job outside of the event loop
+    class PrintBatchWorker: public Nan::AsyncWorker {
+    public:
+        PrintBatchWorker(Nan::Callback *iCallback, const char *iPrinterName,
+                         const char *iJobName, v8::Local<v8::Object> iV8Options, size_t iDocumentsCount,
+                         const Compression &iCompression):
+            Nan::AsyncWorker(iCallback, "printer:printBatch"),
+            printername(iPrinterName), jobname(iJobName),
+            options(iV8Options), documents(iDocumentsCount), compression(iCompression), job_id(0) {}
+
+        /** Documents to send, allocated once: their data may reference their own buffer.
+         * The v8 source values should be saved to persistent
+         */
+        PrintDocumentListType& getDocuments() { return documents; }
+
+        void Execute() {
+            StatsTimer timer(STATS_METRIC("worker:printBatch"));
+            for(PrintDocumentListType::const_iterator itDocument = documents.begin(); itDocument != documents.end(); ++itDocument)
+            {
+                timer.addBytes(itDocument->data.size());
+            }
+            std::string error_str;
+            job_id = printDocuments(printername.c_str(), jobname.c_str(), options, documents, compression, error_str);
+            if(job_id == 0)
+            {
+                timer.setError();
+                SetErrorMessage(error_str.c_str());
+            }
+        }
+
+        void HandleOKCallback() {
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = { Nan::Null(), Nan::New<v8::Number>(job_id) };
+            callback->Call(2, argv, async_resource);
+        }
+    private:
+        std::string printername;
+        std::string jobname;
+        CupsOptions options;
+        PrintDocumentListType documents;
+        Compression compression;
+        int job_id;
+    };
+
+    /// Job of the spool journal
+    struct SpoolJob {
+        SpoolJob() {}
+        SpoolJob(v8::Local<v8::Object> iV8Options): options(iV8Options) {}
+
+        std::string printername;
+        std::string docname;
+        std::string format;
+        CupsOptions options;
+        Compression compression;
+        PrintData data;
+    };
+
+    /** Serialization of a spool job: with a NULL buffer only the size is computed.
+     * Lengths are stored as 64 bits integers in the machine byte order, the journal is not portable.
+     */
+    class SpoolEncoder {
+    public:
+        explicit SpoolEncoder(char *iBuffer = NULL): buffer(iBuffer), size(0) {}
+
+        void encode(SpoolJob &iJob)
+        {
+            addString(iJob.printername.data(), iJob.printername.size());
+            addString(iJob.docname.data(), iJob.docname.size());
+            addString(iJob.format.data(), iJob.format.size());
+            addInteger(iJob.compression.gzip ? 1 : 0);
+            addInteger(static_cast<uint64_t>(static_cast<int64_t>(iJob.compression.level)));
+            addInteger(static_cast<uint64_t>(iJob.options.getNumOptions()));
+            for(int i = 0; i < iJob.options.getNumOptions(); ++i)
+            {
+                const cups_option_t &option = iJob.options.get()[i];
+                addString(option.name, strlen(option.name));
+                addString(option.value, strlen(option.value));
+            }
+            addString(iJob.data.data(), iJob.data.size());
+        }
+
+        uint64_t getSize() const { return size; }
+    private:
+        void addInteger(uint64_t iValue)
+        {
+            if(buffer != NULL)
+            {
+                memcpy(buffer + size, &iValue, sizeof(iValue));
+            }
+            size += sizeof(iValue);
+        }
+
+        void addString(const char *iData, size_t iSize)
+        {
+            addInteger(iSize);
+            if(buffer != NULL && iSize > 0)
+            {
+                memcpy(buffer + size, iData, iSize);
+            }
+            size += iSize;
+        }
+
+        char *buffer;
+        uint64_t size;
+    };
+
+    /// Reads a job written by SpoolEncoder, every read is bounds-checked
+    class SpoolDecoder {
+    public:
+        SpoolDecoder(const char *iBuffer, uint64_t iSize): buffer(iBuffer), size(iSize), offset(0) {}
+
+        /// Read only the printer name, the first field of a job
+        bool decodePrinterName(std::string &oPrinterName)
+        {
+            return getString(oPrinterName);
+        }
+
+        bool decode(SpoolJob &oJob)
+        {
+            uint64_t gzip, level, options_count;
+            if(!getString(oJob.printername) || !getString(oJob.docname) || !getString(oJob.format)
+               || !getInteger(gzip) || !getInteger(level) || !getInteger(options_count))
+            {
+                return false;
+            }
+            oJob.compression.gzip = (gzip != 0);
+            oJob.compression.level = static_cast<int>(static_cast<int64_t>(level));
+            std::string name, value;
+            for(uint64_t i = 0; i < options_count; ++i)
+            {
+                if(!getString(name) || !getString(value))
+                {
+                    return false;
+                }
+                oJob.options.add(name.c_str(), value.c_str());
+            }
+            uint64_t data_size;
+            if(!getInteger(data_size) || data_size != size - offset)
+            {
+                return false;
+            }
+            char *data = oJob.data.assignOwned(static_cast<size_t>(data_size));
+            if(data_size > 0)
+            {
+                memcpy(data, buffer + offset, static_cast<size_t>(data_size));
+            }
+            return true;
+        }
+    private:
+        bool getInteger(uint64_t &oValue)
+        {
+            if(size - offset < sizeof(oValue))
+            {
+                return false;
+            }
+            memcpy(&oValue, buffer + offset, sizeof(oValue));
+            offset += sizeof(oValue);
+            return true;
+        }
+
+        bool getString(std::string &oValue)
+        {
+            uint64_t length;
+            if(!getInteger(length) || size - offset < length)
+            {
+                return false;
+            }
+            oValue.assign(buffer + offset, static_cast<size_t>(length));
+            offset += length;
+            return true;
+        }
+
+        const char *buffer;
+        uint64_t size;
+        uint64_t offset;
+    };
+
+    /** Durable spool of the jobs sent while the CUPS server may be unreachable (printDirect with spool).
+     *
+     * The journal is a memory-mapped append-only file: a header, then records {magic, crc32,
+     * sequence, size, payload} aligned on 8 bytes. Producers append jobs at the tail and a drainer
+     * thread sends them in order for each printer, moving the head of the header past each job once CUPS
+     * accepted or rejected it. The jobs of a printer which does not take jobs (not accepting, busy...)
+     * are skipped until the retry interval elapsed, so that it does not hold back the other printers:
+     * a job sent out of order is marked done in place (kDoneMagic) and the head moves past it once
+     * the jobs before it are done. A job sent just before a crash but not acknowledged yet is sent again:
+     * delivery is at least once. Written through a shared mapping, appended jobs survive a
+     * process crash; with sync they are also flushed to the disk before the append returns.
+     * Closing the journal aborts the job being sent, which stays pending.
+     *
+     * On open, records are read from the head up to the first one with a wrong magic, checksum
+     * or sequence number: a torn append is dropped. Sequence numbers of consecutive records follow
+     * each other and never go below the one of the header, so records left over by a compaction
+     * are never taken for new ones.
+     *
+     * The space of the sent jobs is reused once all the jobs are sent, or by moving the pending
+     * jobs to the start of the file when they fit in the freed space. Otherwise the file grows,
+     * by doubling, up to the maximum size.
+     */
+    class SpoolJournal {
+    public:
+        struct Stats {
+            std::string path;
+            uint64_t pending;
+            uint64_t pending_bytes;
+            uint64_t appended;
+            uint64_t submitted;
+            uint64_t rejected;
+            uint64_t retries;
+            uint64_t compactions;
+            uint64_t file_size;
+            std::string last_error;
+        };
+
+        static SpoolJournal& instance()
+        {
+            static SpoolJournal journal;
+            return journal;
+        }
+
+        /** Open a journal and start sending its pending jobs. The current journal is closed first.
+         * @param iMaxSize maximum size of the file in bytes
+         * @param iRetryInterval ms between two attempts while the server is unreachable or the printer not accepting jobs
+         * @param iSync flush each appended job to the disk
+         * @return error string.
+         */
+        std::string open(const std::string &iPath, uint64_t iMaxSize, int iRetryInterval, bool iSync)
+        {
+            std::lock_guard<std::mutex> control_lock(control_mutex);
+            closeJournal();
+
+            int new_fd;
+            do
+            {
+                new_fd = ::open(iPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+            } while(new_fd < 0 && errno == EINTR);
+            if(new_fd < 0)
+            {
+                return "Unable to open " + iPath + ": " + strerror(errno);
+            }
+            // one drainer per journal
+            if(flock(new_fd, LOCK_EX | LOCK_NB) != 0)
+            {
+                ::close(new_fd);
+                return "The spool " + iPath + " is used by another process";
+            }
+            struct stat file_stat;
+            if(fstat(new_fd, &file_stat) != 0)
+            {
+                std::string error_str = "Unable to open " + iPath + ": " + strerror(errno);
+                ::close(new_fd);
+                return error_str;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            fd = new_fd;
+            path = iPath;
+            max_size = iMaxSize;
+            retry_interval = iRetryInterval;
+            sync = iSync;
+            bool created = (file_stat.st_size == 0);
+            std::string error_str = resize(created ? std::min(max_size, static_cast<uint64_t>(kInitialSize)) : static_cast<uint64_t>(file_stat.st_size));
+            if(error_str.empty() && created)
+            {
+                FileHeader header;
+                memset(&header, 0, sizeof(header));
+                memcpy(header.magic, kFileMagic, sizeof(header.magic));
+                header.head = sizeof(FileHeader);
+                header.sequence = 1;
+                memcpy(mapped, &header, sizeof(header));
+                syncRange(0, sizeof(FileHeader));
+            }
+            if(error_str.empty())
+            {
+                error_str = recover();
+            }
+            if(!error_str.empty())
+            {
+                unmap();
+                return error_str;
+            }
+            stopping = false;
+            abort_requests.reset();
+            thread = std::thread(&SpoolJournal::run, this);
+            return "";
+        }
+
+        /// Stop the drainer and close the file, the pending jobs stay in it
+        void close()
+        {
+            std::lock_guard<std::mutex> control_lock(control_mutex);
+            closeJournal();
+        }
+
+        /** Append a job, it is sent by the drainer thread
+         * @param oSequence sequence number of the job in the journal
+         * @return error string.
+         */
+        std::string append(SpoolJob &iJob, uint64_t &oSequence)
+        {
+            SpoolEncoder sizer;
+            sizer.encode(iJob);
+            uint64_t payload_size = sizer.getSize();
+            uint64_t record_size = getRecordSize(payload_size);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if(mapped == NULL)
+            {
+                return "The spool is not open, see setSpoolOptions";
+            }
+            std::string error_str = reserve(record_size);
+            if(!error_str.empty())
+            {
+                return error_str;
+            }
+            char *record = mapped + tail;
+            SpoolEncoder encoder(record + sizeof(RecordHeader));
+            encoder.encode(iJob);
+            RecordHeader header;
+            header.magic = kRecordMagic;
+            header.sequence = next_sequence;
+            header.size = payload_size;
+            header.crc = checksum(header, record + sizeof(RecordHeader));
+            memcpy(record, &header, sizeof(header));
+
+            uint64_t offset = tail;
+            oSequence = next_sequence++;
+            tail += record_size;
+            ++pending;
+            pending_bytes += payload_size;
+            ++appended;
+            wakeup.notify_all();
+            if(sync)
+            {
+                // the flush waits for the disk: other producers and the drainer go on meanwhile,
+                // sync_mutex only keeps the mapping from being replaced under it
+                std::lock_guard<std::mutex> sync_lock(sync_mutex);
+                char *address = mapped;
+                lock.unlock();
+                syncRange(address, offset, record_size);
+            }
+            return "";
+        }
+
+        Stats getStats()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Stats stats = { (mapped != NULL) ? path : std::string(), pending, pending_bytes, appended, submitted,
+                            rejected, retries, compactions, mapped_size, last_error };
+            return stats;
+        }
+
+    private:
+        static const uint64_t kInitialSize = 1024 * 1024;
+        static const uint32_t kRecordMagic = 0x5253504e; // "NPSR"
+        static const uint32_t kDoneMagic = 0x4453504e; // "NPSD", record sent before the ones preceding it
+
+        struct FileHeader {
+            char magic[8];
+            uint64_t head;      // offset of the first job not sent yet
+            uint64_t sequence;  // lowest sequence number of the records from head
+            uint64_t reserved[5];
+        };
+
+        struct RecordHeader {
+            uint32_t magic;     // not part of the crc: kRecordMagic is replaced by kDoneMagic once the job is sent
+            uint32_t crc;       // of sequence, size and payload
+            uint64_t sequence;
+            uint64_t size;      // of the payload
+        };
+
+        static const char kFileMagic[8];
+
+        SpoolJournal(): fd(-1), mapped(NULL), mapped_size(0), max_size(0), retry_interval(0), sync(false),
+            tail(0), next_sequence(1), stopping(false),
+            pending(0), pending_bytes(0), appended(0), submitted(0), rejected(0), retries(0), compactions(0)
+        {
+            // the drainer leases connections until the journal is destroyed, so the pool must outlive it
+            HttpPool::instance();
+        }
+
+        ~SpoolJournal()
+        {
+            close();
+        }
+
+        static uint64_t getRecordSize(uint64_t iPayloadSize)
+        {
+            return (sizeof(RecordHeader) + iPayloadSize + 7) & ~static_cast<uint64_t>(7);
+        }
+
+        static uint32_t checksum(const RecordHeader &iHeader, const char *iPayload)
+        {
+            uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(&iHeader.sequence), sizeof(iHeader.sequence) + sizeof(iHeader.size));
+            // crc32 takes at most 4GB at once
+            for(uint64_t offset = 0; offset < iHeader.size; )
+            {
+                uInt length = static_cast<uInt>(std::min<uint64_t>(iHeader.size - offset, 1 << 30));
+                crc = crc32(crc, reinterpret_cast<const Bytef*>(iPayload + offset), length);
+                offset += length;
+            }
+            return static_cast<uint32_t>(crc);
+        }
+
+        FileHeader* getHeader() { return reinterpret_cast<FileHeader*>(mapped); }
+
+        /// Stop the drainer and unmap the file, control_mutex must be locked
+        void closeJournal()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                wakeup.notify_all();
+            }
+            // a job being sent to an unreachable or slow server would hold the join for the HTTP timeout:
+            // it stays in the spool and is sent again on the next open
+            abort_requests.abort();
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            unmap();
+        }
+
+        /// mutex must be locked
+        void unmap()
+        {
+            if(mapped != NULL)
+            {
+                std::lock_guard<std::mutex> sync_lock(sync_mutex);
+                msync(mapped, static_cast<size_t>(mapped_size), MS_SYNC);
+                munmap(mapped, static_cast<size_t>(mapped_size));
+                mapped = NULL;
+                mapped_size = 0;
+            }
+            if(fd >= 0)
+            {
+                // releases the lock of the file
+                ::close(fd);
+                fd = -1;
+            }
+            pending = 0;
+            pending_bytes = 0;
+        }
+
+        /** Resize the file and map it again, mutex must be locked.
+         * The current mapping is kept on failure.
+         * @return error string.
+         */
+        std::string resize(uint64_t iSize)
+        {
+            if(iSize > mapped_size)
+            {
+                if(ftruncate(fd, static_cast<off_t>(iSize)) != 0)
+                {
+                    return "Unable to resize the spool " + path + ": " + strerror(errno);
+                }
+#ifdef __linux__
+                // allocate the blocks now: a full disk is an append error, not a SIGBUS when the pages are written
+                int result = posix_fallocate(fd, static_cast<off_t>(mapped_size), static_cast<off_t>(iSize - mapped_size));
+                if(result != 0 && result != EINVAL && result != EOPNOTSUPP)
+                {
+                    return "Unable to resize the spool " + path + ": " + strerror(result);
+                }
+#endif
+            }
+            void *address = mmap(NULL, static_cast<size_t>(iSize), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(address == MAP_FAILED)
+            {
+                return "Unable to map the spool " + path + ": " + strerror(errno);
+            }
+            if(mapped != NULL)
+            {
+                std::lock_guard<std::mutex> sync_lock(sync_mutex);
+                munmap(mapped, static_cast<size_t>(mapped_size));
+            }
+            if(iSize < mapped_size && ftruncate(fd, static_cast<off_t>(iSize)) != 0)
+            {
+                // the file keeps its size, it is only mapped partially
+            }
+            mapped = static_cast<char*>(address);
+            mapped_size = iSize;
+            return "";
+        }
+
+        /// Check the header and find the pending records, mutex must be locked. @return error string.
+        std::string recover()
+        {
+            FileHeader *header = getHeader();
+            if(mapped_size < sizeof(FileHeader) || memcmp(header->magic, kFileMagic, sizeof(header->magic)) != 0
+               || header->head < sizeof(FileHeader) || header->head > mapped_size)
+            {
+                return path + " is not a spool journal";
+            }
+            uint64_t position = header->head;
+            uint64_t sequence = header->sequence;
+            bool first = true;
+            pending = 0;
+            pending_bytes = 0;
+            while(mapped_size - position >= sizeof(RecordHeader))
+            {
+                RecordHeader record;
+                memcpy(&record, mapped + position, sizeof(record));
+                if((record.magic != kRecordMagic && record.magic != kDoneMagic) || record.size > mapped_size - position - sizeof(RecordHeader)
+                   || (first ? record.sequence < sequence : record.sequence != sequence)
+                   || record.crc != checksum(record, mapped + position + sizeof(RecordHeader)))
+                {
+                    break;
+                }
+                first = false;
+                sequence = record.sequence + 1;
+                position = std::min(position + getRecordSize(record.size), mapped_size);
+                if(record.magic == kRecordMagic)
+                {
+                    ++pending;
+                    pending_bytes += record.size;
+                }
+            }
+            tail = position;
+            next_sequence = sequence;
+            return "";
+        }
+
+        /// Flush a range of the mapping to the disk when sync is set, mutex must be locked
+        void syncRange(uint64_t iOffset, uint64_t iSize)
+        {
+            if(sync)
+            {
+                syncRange(mapped, iOffset, iSize);
+            }
+        }
+
+        /// Flush a range of iMapped to the disk, either mutex or sync_mutex must be locked
+        static void syncRange(char *iMapped, uint64_t iOffset, uint64_t iSize)
+        {
+            // msync needs a page aligned address
+            static const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            uint64_t start = iOffset / page_size * page_size;
+            msync(iMapped + start, static_cast<size_t>(iOffset + iSize - start), MS_SYNC);
+        }
+
+        /// Make room for iSize bytes at the tail, mutex must be locked. @return error string.
+        std::string reserve(uint64_t iSize)
+        {
+            if(mapped_size - tail >= iSize)
+            {
+                return "";
+            }
+            if(compact() && mapped_size - tail >= iSize)
+            {
+                return "";
+            }
+            uint64_t new_size = mapped_size;
+            while(new_size - tail < iSize && new_size < max_size)
+            {
+                new_size = std::min(new_size * 2, max_size);
+            }
+            if(new_size - tail < iSize)
+            {
+                return "The spool is full";
+            }
+            return resize(new_size);
+        }
+
+        /** Move the pending records to the start of the file, when they do not overlap their
+         * new place, so that the records are intact at any time. Mutex must be locked
+         * @return true if some space was freed
+         */
+        bool compact()
+        {
+            FileHeader *header = getHeader();
+            uint64_t start = sizeof(FileHeader);
+            uint64_t live = tail - header->head;
+            if(header->head == start || header->head - start < live)
+            {
+                return false;
+            }
+            memcpy(mapped + start, mapped + header->head, static_cast<size_t>(live));
+            syncRange(start, live);
+            // the moved records keep their sequence numbers: the header one stays below them
+            header->head = start;
+            syncRange(0, sizeof(FileHeader));
+            tail = start + live;
+            ++compactions;
+            return true;
+        }
+
+        /// Start again from the beginning of the file once all the jobs are sent, mutex must be locked
+        void reset()
+        {
+            FileHeader *header = getHeader();
+            // sequence first: records before the head stay below it if the head is written and not the sequence
+            header->sequence = next_sequence;
+            header->head = sizeof(FileHeader);
+            syncRange(0, sizeof(FileHeader));
+            tail = sizeof(FileHeader);
+            if(mapped_size > kInitialSize && max_size >= kInitialSize)
+            {
+                // give back the space taken during an outage
+                std::string error_str = resize(kInitialSize);
+                if(!error_str.empty())
+                {
+                    last_error = error_str;
+                }
+            }
+        }
+
+        /** Send a job
+         * @return false if it should be sent again later: the server can not be reached or fails
+         */
+        bool submit(SpoolJob &iJob, std::string &oError)
+        {
+            ipp_status_t status = IPP_STATUS_OK;
+            int job_id = printDirectData(iJob.printername.c_str(), iJob.docname.c_str(), iJob.format.c_str(), iJob.options,
+                                         iJob.data.data(), iJob.data.size(), iJob.compression, oError, &status, &abort_requests);
+            if(job_id != 0)
+            {
+                return true;
+            }
+            // client errors (unknown printer, bad attributes, ...) will not go away: the job is dropped
+            return status >= IPP_STATUS_ERROR_BAD_REQUEST && status < IPP_STATUS_ERROR_INTERNAL
+                   && status != IPP_STATUS_ERROR_TIMEOUT && status != IPP_STATUS_ERROR_NOT_AUTHENTICATED;
+        }
+
+        typedef std::map<std::string, std::chrono::steady_clock::time_point> BlockedPrintersType;
+
+        /** First job to send, mutex must be locked: the first pending one whose printer is not waiting
+         * for its retry time
+         * @param oPosition offset of its record
+         * @param oRetryAt earliest retry time of the skipped printers, when no job is found
+         * @return false if no job can be sent now
+         */
+        bool findNext(BlockedPrintersType &ioBlocked, uint64_t &oPosition, std::chrono::steady_clock::time_point &oRetryAt)
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            oRetryAt = std::chrono::steady_clock::time_point::max();
+            std::string printername;
+            for(uint64_t position = getHeader()->head; position < tail; )
+            {
+                RecordHeader record;
+                memcpy(&record, mapped + position, sizeof(record));
+                uint64_t next = position + getRecordSize(record.size);
+                if(record.magic == kDoneMagic)
+                {
+                    position = next;
+                    continue;
+                }
+                if(ioBlocked.empty() || !SpoolDecoder(mapped + position + sizeof(RecordHeader), record.size).decodePrinterName(printername))
+                {
+                    // an invalid job is dropped by the caller
+                    oPosition = position;
+                    return true;
+                }
+                BlockedPrintersType::iterator itBlocked = ioBlocked.find(printername);
+                if(itBlocked != ioBlocked.end() && itBlocked->second > now)
+                {
+                    oRetryAt = std::min(oRetryAt, itBlocked->second);
+                    position = next;
+                    continue;
+                }
+                if(itBlocked != ioBlocked.end())
+                {
+                    ioBlocked.erase(itBlocked);
+                }
+                oPosition = position;
+                return true;
+            }
+            return false;
+        }
+
+        /// The job at iPosition is sent or dropped, mutex must be locked
+        void markDone(uint64_t iPosition)
+        {
+            FileHeader *header = getHeader();
+            if(iPosition != header->head)
+            {
+                // sent before the jobs of other printers
+                reinterpret_cast<RecordHeader*>(mapped + iPosition)->magic = kDoneMagic;
+                syncRange(iPosition, sizeof(uint32_t));
+                return;
+            }
+            uint64_t head = header->head;
+            do
+            {
+                head += getRecordSize(reinterpret_cast<const RecordHeader*>(mapped + head)->size);
+            } while(head < tail && reinterpret_cast<const RecordHeader*>(mapped + head)->magic == kDoneMagic);
+            header->head = head;
+            syncRange(0, sizeof(FileHeader));
+        }
+
+        /// Drainer thread, sends the jobs of each printer in order. Does not touch v8
+        void run()
+        {
+            BlockedPrintersType blocked;
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!stopping)
+            {
+                uint64_t position = 0;
+                std::chrono::steady_clock::time_point retry_at;
+                if(pending == 0)
+                {
+                    blocked.clear();
+                    wakeup.wait(lock);
+                    continue;
+                }
+                if(!findNext(blocked, position, retry_at))
+                {
+                    // only jobs of printers waiting for their retry, new jobs wake up the drainer too
+                    if(retry_at == std::chrono::steady_clock::time_point::max())
+                    {
+                        wakeup.wait(lock);
+                    }
+                    else
+                    {
+                        wakeup.wait_until(lock, retry_at);
+                    }
+                    continue;
+                }
+                // the job is copied: the file may be remapped or compacted while it is sent.
+                // Compaction moves the records together, so the job keeps its place relative to the head
+                uint64_t from_head = position - getHeader()->head;
+                RecordHeader record;
+                memcpy(&record, mapped + position, sizeof(record));
+                SpoolJob job;
+                bool valid = SpoolDecoder(mapped + position + sizeof(RecordHeader), record.size).decode(job);
+                lock.unlock();
+
+                std::string error_str;
+                bool done = !valid;
+                if(valid)
+                {
+                    StatsTimer timer(STATS_METRIC("spool:submit"));
+                    timer.addBytes(job.data.size());
+                    done = submit(job, error_str);
+                    timer.setError(!error_str.empty());
+                }
+                else
+                {
+                    error_str = "Invalid job in the spool";
+                }
+
+                lock.lock();
+                if(!done && stopping)
+                {
+                    // aborted by closeJournal
+                    continue;
+                }
+                if(!error_str.empty())
+                {
+                    last_error = error_str;
+                }
+                if(!done)
+                {
+                    // the next jobs of this printer wait too, to keep their order
+                    ++retries;
+                    blocked[job.printername] = std::chrono::steady_clock::now() + std::chrono::milliseconds(retry_interval);
+                    continue;
+                }
+                markDone(getHeader()->head + from_head);
+                --pending;
+                pending_bytes -= record.size;
+                if(error_str.empty())
+                {
+                    ++submitted;
+                }
+                else
+                {
+                    ++rejected;
+                }
+                if(pending == 0)
+                {
+                    reset();
+                }
+            }
+        }
+
+        std::mutex control_mutex; // open and close
+        std::mutex mutex;
+        std::mutex sync_mutex; // msync of an append outside of mutex, and munmap
+        std::condition_variable wakeup;
+        HttpAbort abort_requests; // of the drainer
+        std::thread thread;
+        int fd;
+        std::string path;
+        char *mapped;
+        uint64_t mapped_size;
+        uint64_t max_size;
+        int retry_interval;
+        bool sync;
+        uint64_t tail;
+        uint64_t next_sequence;
+        bool stopping;
+        // stats
+        uint64_t pending;
+        uint64_t pending_bytes;
+        uint64_t appended;
+        uint64_t submitted;
+        uint64_t rejected;
+        uint64_t retries;
+        uint64_t compactions;
+        std::string last_error;
+    };
+
+    const char SpoolJournal::kFileMagic[8] = { 'N', 'P', 'S', 'P', 'O', 'O', 'L', '1' };
+
+    /// printDirect({spool: true}) worker: the job is appended to the spool journal outside of the event loop
+    class SpoolWorker: public Nan::AsyncWorker {
+    public:
+        SpoolWorker(Nan::Callback *iCallback, const char *iPrinterName, const char *iDocName, const std::string &iFormat,
+                    v8::Local<v8::Object> iV8Options, const Compression &iCompression):
+            Nan::AsyncWorker(iCallback, "printer:printSpool"), job(iV8Options), sequence(0)
+        {
+            job.printername = iPrinterName;
+            job.docname = iDocName;
+            job.format = iFormat;
+            job.compression = iCompression;
+        }
+
+        /// Data to append. The v8 source value should be saved to persistent
+        PrintData& getData() { return job.data; }
+
+        void Execute() {
+            StatsTimer timer(STATS_METRIC("worker:printSpool"));
+            timer.addBytes(job.data.size());
+            std::string error_str = SpoolJournal::instance().append(job, sequence);
+            if(!error_str.empty())
+            {
+                timer.setError();
+                SetErrorMessage(error_str.c_str());
+            }
+        }
+
+        void HandleOKCallback() {
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = { Nan::Null(), Nan::New<v8::Number>(static_cast<double>(sequence)) };
+            callback->Call(2, argv, async_resource);
+        }
+    private:
+        SpoolJob job;
+        uint64_t sequence;
+    };
+
+    /** Reader of a whole file, chunk by chunk, into a reused buffer. Does not touch v8.
+     * The file is not mapped in memory: a concurrent truncation would make reading the mapping fault (SIGBUS),
+     * while pread just reaches the end of the file earlier.
+     */
+    class FileReader {
+    public:
+        /// Chunk size
+        static const size_t kChunkSize = 1024 * 1024;
+
+        FileReader(): fd(-1), size(-1), regular(false), offset(0) {}
+        ~FileReader()
+        {
+            if(fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+
+        /// @return error string.
+        std::string open(const char *iFilename)
+        {
+            do
+            {
+                fd = ::open(iFilename, O_RDONLY);
+            } while(fd < 0 && errno == EINTR);
+            if(fd < 0)
+            {
+                return std::string("Unable to open ") + iFilename + ": " + strerror(errno);
+            }
+            struct stat file_stat;
+            if(fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+            {
+                size = static_cast<int64_t>(file_stat.st_size);
+                regular = true;
+#ifdef POSIX_FADV_SEQUENTIAL
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+            }
+            return "";
+        }
+
+        /// @return size in bytes, -1 if unknown
+        int64_t getSize() const { return size; }
+
+        /** Next chunk, valid until the next call
+         * @param oSize size of the chunk, 0 at the end of the file
+         * @return error string.
+         */
+        std::string next(const char *&oData, size_t &oSize)
+        {
+            if(buffer.empty())
+            {
+                buffer.resize(kChunkSize);
+            }
+            ssize_t count;
+            do
+            {
+                // other files (e.g. pipes) are not seekable
+                count = regular ? pread(fd, &buffer[0], buffer.size(), static_cast<off_t>(offset))
+                                : read(fd, &buffer[0], buffer.size());
+            } while(count < 0 && errno == EINTR);
+            if(count < 0)
+            {
+                return std::string("Unable to read the file: ") + strerror(errno);
+            }
+            oData = &buffer[0];
+            oSize = static_cast<size_t>(count);
+            offset += oSize;
+            return "";
+        }
+    private:
+        FileReader(const FileReader&);
+        FileReader& operator=(const FileReader&);
+
+        int fd;
+        int64_t size;
+        bool regular;
+        uint64_t offset;
+        std::vector<char> buffer;
+    };
+
+    /// Cancellation request shared by a job handle and its worker
+    typedef std::shared_ptr<std::atomic<bool> > CancelFlagPtr;
+
+    /// JS handle of a file being printed, with a cancel method
+    class PrintFileJob: public Nan::ObjectWrap {
+    public:
+        static v8::Local<v8::Object> NewInstance(const CancelFlagPtr &iCancelled)
+        {
+            Nan::EscapableHandleScope scope;
+            static PerIsolate<IsolateFunctionTemplate> function_template;
+            IsolateFunctionTemplate &constructor = function_template.get();
+            if(constructor.isEmpty())
+            {
+                v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+                tpl->SetClassName(Nan::New("PrintFileJob").ToLocalChecked());
+                tpl->InstanceTemplate()->SetInternalFieldCount(1);
+                Nan::SetPrototypeMethod(tpl, "cancel", Cancel);
+                constructor.reset(tpl);
+            }
+            v8::Local<v8::Object> result = Nan::NewInstance(constructor.getFunction()).ToLocalChecked();
+            PrintFileJob *wrapper = new PrintFileJob(iCancelled);
+            wrapper->Wrap(result);
+            return scope.Escape(result);
+        }
+    private:
+        explicit PrintFileJob(const CancelFlagPtr &iCancelled): cancelled(iCancelled) {}
+
+        /// Stop sending the file and cancel the job, the print callback gets an error
+        static MY_NODE_MODULE_CALLBACK(Cancel)
+        {
+            Nan::HandleScope scope;
+            PrintFileJob *wrapper = Nan::ObjectWrap::Unwrap<PrintFileJob>(iArgs.Holder());
+            wrapper->cancelled->store(true);
+            MY_NODE_MODULE_RETURN_UNDEFINED();
+        }
+
+        CancelFlagPtr cancelled;
+    };
+
+    /// Bytes of a file sent so far
+    struct FileProgress {
+        uint64_t sent;
+        int64_t total;
+    };
+
+    /** printFile worker: the file is read and sent in chunks through create-job/send-document,
+     * reporting the progress after each chunk
+     */
+    class PrintFileWorker: public Nan::AsyncProgressWorkerBase<FileProgress> {
+    public:
+        PrintFileWorker(Nan::Callback *iCallback, Nan::Callback *iProgress, const char *iFilename, const char *iDocName,
+                        const char *iPrinterName, const std::string &iFormat, v8::Local<v8::Object> iV8Options,
+                        const Compression &iCompression, const CancelFlagPtr &iCancelled):
+            Nan::AsyncProgressWorkerBase<FileProgress>(iCallback, "printer:printFile"), progress(iProgress),
+            filename(iFilename), docname(iDocName), printername(iPrinterName), format(iFormat),
+            options(iV8Options), compression(iCompression), cancelled(iCancelled), job_id(0) {}
+
+        ~PrintFileWorker() { delete progress; }
+
+        void Execute(const ExecutionProgress &iProgress) {
+            StatsTimer timer(STATS_METRIC("worker:printFile"));
+            std::string error_str = sendFile(iProgress, timer);
+            if(!error_str.empty())
+            {
+                timer.setError();
+                SetErrorMessage(error_str.c_str());
+            }
+        }
+
+        void HandleProgressCallback(const FileProgress *iData, size_t iCount) {
+            if(progress == NULL || iData == NULL || iCount == 0)
+            {
+                return;
+            }
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = {
+                Nan::New<v8::Number>(static_cast<double>(iData->sent)),
+                (iData->total < 0) ? v8::Local<v8::Value>(Nan::Null()) : v8::Local<v8::Value>(Nan::New<v8::Number>(static_cast<double>(iData->total)))
+            };
+            progress->Call(2, argv, async_resource);
+        }
+
+        void HandleOKCallback() {
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = { Nan::Null(), Nan::New<v8::Number>(job_id) };
+            callback->Call(2, argv, async_resource);
+        }
+    private:
+        /// @return error string.
+        std::string sendFile(const ExecutionProgress &iProgress, StatsTimer &ioTimer)
+        {
+            FileReader reader;
+            std::string error_str = reader.open(filename.c_str());
+            if(!error_str.empty())
+            {
+                return error_str;
+            }
+            if(cancelled->load())
+            {
+                return "Print job cancelled";
+            }
+            HttpLease http;
+            job_id = createJob(http.get(), printername.c_str(), docname.c_str(), options.getNumOptions(), options.get(), options.getAttributes());
+            if(job_id == 0)
+            {
+                return cupsLastErrorString();
+            }
+            if(HTTP_CONTINUE != startDocument(http.get(), printername.c_str(), job_id, docname.c_str(), format.c_str(), 1 /*last document*/,
+                                              compression.getName()))
+            {
+                error_str = cupsLastErrorString();
+            }
+            DocumentWriter writer(compression);
+            FileProgress file_progress = { 0, reader.getSize() };
+            while(error_str.empty())
+            {
+                const char *data = NULL;
+                size_t size = 0;
+                if(cancelled->load())
+                {
+                    error_str = "Print job cancelled";
+                    break;
+                }
+                if(!(error_str = reader.next(data, size)).empty())
+                {
+                    break;
+                }
+                if(size == 0)
+                {
+                    if(HTTP_CONTINUE != writer.finish(http.get()))
+                    {
+                        error_str = writer.getError();
+                    }
+                    break;
+                }
+                if(HTTP_CONTINUE != writer.write(http.get(), data, size))
+                {
+                    error_str = writer.getError();
+                    break;
+                }
+                file_progress.sent += size;
+                ioTimer.addBytes(size);
+                iProgress.Send(&file_progress, 1);
+            }
+            if(error_str.empty())
+            {
+                if(finishDocument(http.get(), printername.c_str()) > IPP_STATUS_OK_CONFLICTING)
+                {
+                    error_str = cupsLastErrorString();
+                }
+                else
+                {
+                    return "";
+                }
+            }
+            // interrupted document: the connection state is unknown
+            http.discard();
+            http.release();
+            HttpLease cancel_http;
+            cancelJob(cancel_http.get(), printername.c_str(), job_id);
+            return error_str;
+        }
+
+        Nan::Callback *progress;
+        std::string filename;
+        std::string docname;
+        std::string printername;
+        std::string format;
+        CupsOptions options;
+        Compression compression;
+        CancelFlagPtr cancelled;
+        int job_id;
+    };
+
+    /** Streamed print job: the document is sent chunk by chunk.
+     * Leases a pooled connection for the whole job, since each chunk may be written from another
+     * worker thread and CUPS_HTTP_DEFAULT is a per-thread connection.
+     * Does not touch v8.
+     */
+    class StreamJob {
+    public:
+        explicit StreamJob(const Compression &iCompression): http(NULL), job_id(0), compression(iCompression) {}
+        ~StreamJob() { close(); }
+
+        /// Connect, create the job and start its (single) document
+        bool open(const char *iPrinterName, const char *iDocName, const char *iFormat, CupsOptions &iOptions)
+        {
+            printername = iPrinterName;
+            http = HttpPool::instance().acquire();
+            if(http == NULL)
+            {
+                error_str = "Unable to connect to CUPS server: ";
+                error_str += cupsLastErrorString();
+                return false;
+            }
+            job_id = createJob(http, iPrinterName, iDocName, iOptions.getNumOptions(), iOptions.get(), iOptions.getAttributes());
+            if(job_id == 0)
+            {
+                error_str = cupsLastErrorString();
+                return false;
+            }
+            if(HTTP_CONTINUE != startDocument(http, iPrinterName, job_id, iDocName, iFormat, 1 /*last document*/, compression.getName()))
+            {
+                error_str = cupsLastErrorString();
+                return false;
+            }
+            writer.reset(new DocumentWriter(compression));
+            return true;
+        }
+
+        bool write(const char *iData, size_t iSize)
+        {
+            if(http == NULL || !writer)
+            {
+                error_str = "Print stream is already closed";
+                return false;
+            }
+            if(HTTP_CONTINUE != writer->write(http, iData, iSize))
+            {
+                error_str = writer->getError();
+                return false;
+            }
+            return true;
+        }
+
+        /// Finish the document and close the connection
+        bool finish()
+        {
+            if(http == NULL || !writer)
+            {
+                error_str = "Print stream is already closed";
+                return false;
+            }
+            if(HTTP_CONTINUE != writer->finish(http))
+            {
+                error_str = writer->getError();
+                finishDocument(http, printername.c_str());
+                close();
+                return false;
+            }
+            bool ok = (finishDocument(http, printername.c_str()) <= IPP_STATUS_OK_CONFLICTING);
+            if(!ok)
+            {
+                error_str = cupsLastErrorString();
+            }
+            close(true);
+            return ok;
+        }
+
+        /// Drop the unfinished document and cancel the job
+        void cancel()
+        {
+            close();
+            if(job_id != 0)
+            {
+                HttpLease lease;
+                cancelJob(lease.get(), printername.c_str(), job_id);
+            }
+        }
+
+        /// Give back the connection, it is reusable only once the document is finished
+        void close(bool iReusable = false)
+        {
+            writer.reset();
+            if(http != NULL)
+            {
+                HttpPool::instance().release(http, iReusable);
+                http = NULL;
+            }
+        }
+
+        int getJobId() const { return job_id; }
+        const std::string& getError() const { return error_str; }
+
+        /// Data of the current write: only one write at a time, so string chunks reuse the same buffer
+        PrintData& getChunk() { return chunk; }
+    private:
+        PrintData chunk;
+        http_t *http;
+        std::string printername;
+        int job_id;
+        std::string error_str;
+        Compression compression;
+        std::unique_ptr<DocumentWriter> writer;
+    };
+
+    /// JS handle of a StreamJob with write/finish/cancel methods
+    class PrintStreamJob: public Nan::ObjectWrap {
+    public:
+        /// Wrap iJob (ownership is taken) in a new JS object
+        static v8::Local<v8::Object> NewInstance(StreamJob *iJob)
+        {
+            Nan::EscapableHandleScope scope;
+            static PerIsolate<IsolateFunctionTemplate> function_template;
+            IsolateFunctionTemplate &constructor = function_template.get();
+            if(constructor.isEmpty())
+            {
+                v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+                tpl->SetClassName(Nan::New("PrintStreamJob").ToLocalChecked());
+                tpl->InstanceTemplate()->SetInternalFieldCount(1);
+                Nan::SetPrototypeMethod(tpl, "write", Write);
+                Nan::SetPrototypeMethod(tpl, "finish", Finish);
+                Nan::SetPrototypeMethod(tpl, "cancel", Cancel);
+                constructor.reset(tpl);
+            }
+            v8::Local<v8::Object> result = Nan::NewInstance(constructor.getFunction()).ToLocalChecked();
+            PrintStreamJob *wrapper = new PrintStreamJob(iJob);
+            wrapper->Wrap(result);
+            return scope.Escape(result);
+        }
+
+        StreamJob* getJob() { return job; }
+        /// only one operation at a time could run on the connection
+        bool isBusy() const { return busy; }
+        void setBusy(bool iBusy) { busy = iBusy; }
+    private:
+        explicit PrintStreamJob(StreamJob *iJob): job(iJob), busy(false) {}
+        ~PrintStreamJob() { delete job; }
+
+        static MY_NODE_MODULE_CALLBACK(Write);
+        static MY_NODE_MODULE_CALLBACK(Finish);
+        static MY_NODE_MODULE_CALLBACK(Cancel);
+
+        StreamJob *job;
+        bool busy;
+    };
+
+    /// Runs one operation of a streamed job on a worker thread
+    class PrintStreamWorker: public Nan::AsyncWorker {
+    public:
+        enum Operation { OPEN, WRITE, FINISH, CANCEL };
+
+        PrintStreamWorker(Nan::Callback *iCallback, Operation iOperation, StreamJob *iJob, PrintStreamJob *iWrapper):
+            Nan::AsyncWorker(iCallback, "printer:printStream"), operation(iOperation), job(iJob), wrapper(iWrapper), options(NULL) {}
+        ~PrintStreamWorker() {
+            // job is owned by the worker until it is wrapped
+            if(wrapper == NULL)
+            {
+                delete job;
+            }
+            delete options;
+        }
+
+        /// data of OPEN operation
+        void setOpenData(const char *iPrinterName, const char *iDocName, const std::string &iFormat, v8::Local<v8::Object> iV8Options)
+        {
+            printername = iPrinterName;
+            docname = iDocName;
+            format = iFormat;
+            options = new CupsOptions(iV8Options);
+        }
+
+        void Execute() {
+            bool ok = true;
+            switch(operation)
+            {
+            case OPEN:
+                ok = job->open(printername.c_str(), docname.c_str(), format.c_str(), *options);
+                if(!ok)
+                {
+                    // do not leave an empty job in the queue, cancelling blocks on the server so it stays off the event loop
+                    std::string error = job->getError();
+                    job->cancel();
+                    SetErrorMessage(error.c_str());
+                    return;
+                }
+                break;
+            case WRITE:
+                ok = job->write(job->getChunk().data(), job->getChunk().size());
+                break;
+            case FINISH:
+                ok = job->finish();
+                break;
+            case CANCEL:
+                job->cancel();
+                break;
+            }
+            if(!ok)
+            {
+                SetErrorMessage(job->getError().c_str());
+            }
+        }
+
+        void HandleOKCallback() {
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = { Nan::Null(), Nan::Undefined() };
+            if(operation == OPEN)
+            {
+                wrapper = NULL;
+                argv[1] = PrintStreamJob::NewInstance(job);
+                job = NULL;
+            }
+            else if(operation == FINISH)
+            {
+                argv[1] = Nan::New<v8::Number>(job->getJobId());
+            }
+            release();
+            callback->Call(2, argv, async_resource);
+        }
+
+        void HandleErrorCallback() {
+            Nan::HandleScope scope;
+            release();
+            v8::Local<v8::Value> argv[] = { Nan::Error(ErrorMessage()) };
+            callback->Call(1, argv, async_resource);
+        }
+    private:
+        void release()
+        {
+            if(wrapper != NULL)
+            {
+                wrapper->setBusy(false);
+            }
+        }
+
+        Operation operation;
+        StreamJob *job;
+        PrintStreamJob *wrapper;
+        std::string printername;
+        std::string docname;
+        std::string format;
+        CupsOptions *options;
+    };
+
+    /// Queue an operation on the job behind iArgs.This()
+    void queuePrintStreamOperation(const Nan::FunctionCallbackInfo<v8::Value>& iArgs, PrintStreamWorker::Operation iOperation, int iCallbackIndex)
+    {
+        MY_NODE_MODULE_HANDLESCOPE;
+        if(iArgs.Length() <= iCallbackIndex || !iArgs[iCallbackIndex]->IsFunction())
+        {
+            RETURN_EXCEPTION_STR("Callback argument must be a function");
+        }
+        v8::Local<v8::Function> callback = v8::Local<v8::Function>::Cast(iArgs[iCallbackIndex]);
+        PrintStreamJob *wrapper = Nan::ObjectWrap::Unwrap<PrintStreamJob>(iArgs.This());
+        if(wrapper->isBusy())
+        {
+            RETURN_EXCEPTION_STR("Another operation is in progress on this print stream");
+        }
+
+        if(iOperation == PrintStreamWorker::WRITE && !getStringOrBufferFromV8Value(iArgs[0], wrapper->getJob()->getChunk()))
+        {
+            RETURN_EXCEPTION_STR("Argument 0 must be a string or Buffer");
+        }
+
+        PrintStreamWorker *worker = new PrintStreamWorker(new Nan::Callback(callback), iOperation, wrapper->getJob(), wrapper);
+        // keep the job alive while the worker is running
+        worker->SaveToPersistent("job", iArgs.This());
+        if(iOperation == PrintStreamWorker::WRITE)
+        {
+            // the chunk is referenced in place
+            worker->SaveToPersistent("data", iArgs[0]);
+        }
+        wrapper->setBusy(true);
+        Nan::AsyncQueueWorker(worker);
+    }
+
+    MY_NODE_MODULE_CALLBACK(PrintStreamJob::Write)
+    {
+        queuePrintStreamOperation(iArgs, PrintStreamWorker::WRITE, 1);
+    }
+
+    MY_NODE_MODULE_CALLBACK(PrintStreamJob::Finish)
+    {
+        queuePrintStreamOperation(iArgs, PrintStreamWorker::FINISH, 0);
+    }
+
+    MY_NODE_MODULE_CALLBACK(PrintStreamJob::Cancel)
+    {
+        queuePrintStreamOperation(iArgs, PrintStreamWorker::CANCEL, 0);
+    }
+    /** Watcher of printer and job events through an IPP pull subscription (ippget).
+     * A native thread creates the subscription (Create-Printer-Subscriptions, or Create-Job-Subscriptions
+     * for one job) and polls Get-Notifications on its own connection, events are handed to the event loop
+     * with an uv_async_t. The connection is shut down by stop(), which ends a pending long poll at once.
+     * A subscription refused by the server (4xx) is reported once and ends the watcher.
+     */
+    class NotificationWatcher: public Nan::ObjectWrap {
+    public:
+        typedef std::vector<std::pair<std::string, std::string> > AttributesType;
+
+        struct Event {
+            std::string name;
+            int sequence_number;
+            AttributesType attributes;
+        };
+
+        /// Create the JS handle and start watching
+        static v8::Local<v8::Object> NewInstance(const std::string &iPrinterName, int iJobId, const std::vector<std::string> &iEvents,
+                                                 int iLeaseDuration, int iInterval, v8::Local<v8::Function> iCallback)
+        {
+            Nan::EscapableHandleScope scope;
+            static PerIsolate<IsolateFunctionTemplate> function_template;
+            IsolateFunctionTemplate &constructor = function_template.get();
+            if(constructor.isEmpty())
+            {
+                v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+                tpl->SetClassName(Nan::New("PrinterWatcher").ToLocalChecked());
+                tpl->InstanceTemplate()->SetInternalFieldCount(1);
+                Nan::SetPrototypeMethod(tpl, "close", Close);
+                constructor.reset(tpl);
+            }
+            v8::Local<v8::Object> result = Nan::NewInstance(constructor.getFunction()).ToLocalChecked();
+            NotificationWatcher *watcher = new NotificationWatcher(iPrinterName, iJobId, iEvents, iLeaseDuration, iInterval, iCallback);
+            watcher->Wrap(result);
+            watcher->start();
+            return scope.Escape(result);
+        }
+
+        /** The isolate environment ends (worker thread exit): stop the thread without calling back.
+         * The subscription is cancelled, the wrapper is left to the isolate
+         */
+        void shutdown()
+        {
+            stop();
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+            uv_close(reinterpret_cast<uv_handle_t*>(&async), NULL);
+        }
+
+    private:
+        NotificationWatcher(const std::string &iPrinterName, int iJobId, const std::vector<std::string> &iEvents,
+                            int iLeaseDuration, int iInterval, v8::Local<v8::Function> iCallback):
+            printername(iPrinterName), job_id(iJobId), events(iEvents),
+            // a job subscription lasts as long as the job, it has no lease
+            lease_duration(iJobId > 0 ? 0 : iLeaseDuration), interval(iInterval),
+            callback(iCallback), async_resource("printer:watch"),
+            stopping(false), finished(false), http_in_use(NULL), http_shut_down(false),
+            subscription_id(0), last_sequence_number(0) {}
+
+        ~NotificationWatcher() {}
+
+        void start()
+        {
+            async.data = this;
+            uv_async_init(Nan::GetCurrentEventLoop(), &async, onAsync);
+            // alive until the thread is over and the async handle closed
+            Ref();
+            getWatchers().get().add(this);
+            thread = std::thread(&NotificationWatcher::run, this);
+        }
+
+        /// Watchers of each isolate, shut down with it
+        static PerIsolate<IsolateObjects<NotificationWatcher> >& getWatchers()
+        {
+            static PerIsolate<IsolateObjects<NotificationWatcher> > watchers;
+            return watchers;
+        }
+
+        /// Ask the thread to stop, it will cancel the subscription
+        void stop()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            if(http_in_use != NULL && !http_shut_down)
+            {
+                // wakes up a request blocked in the long poll, the connection can only be closed by the thread
+                httpShutdown(http_in_use);
+                http_shut_down = true;
+            }
+            wakeup.notify_all();
+        }
+
+        /// Publish the connection of the thread to stop(), NULL before closing it
+        void setHttp(http_t *iHttp)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            http_in_use = iHttp;
+            if(iHttp != NULL && stopping)
+            {
+                httpShutdown(iHttp);
+                http_shut_down = true;
+            }
+            else if(iHttp == NULL)
+            {
+                http_shut_down = false;
+            }
+        }
+
+        bool isShutDown()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return http_shut_down;
+        }
+
+        /// Watcher thread, does not touch v8
+        void run()
+        {
+            http_t *http = NULL;
+            time_t renew_at = 0;
+            while(!isStopping())
+            {
+                std::string error_str;
+                if(http == NULL)
+                {
+                    http = connectToServer();
+                    setHttp(http);
+                }
+                if(http == NULL)
+                {
+                    error_str = "Unable to connect to CUPS server: ";
+                    error_str += cupsLastErrorString();
+                }
+                else if(subscription_id == 0)
+                {
+                    ipp_status_t status = IPP_STATUS_OK;
+                    if(subscribe(http, error_str, status))
+                    {
+                        renew_at = time(NULL) + lease_duration / 2;
+                    }
+                    else if(status >= IPP_STATUS_ERROR_BAD_REQUEST && status < IPP_STATUS_ERROR_INTERNAL)
+                    {
+                        // unknown printer or job, unsupported event...: asking again will not help
+                        pushError(error_str);
+                        break;
+                    }
+                }
+                else if(lease_duration > 0 && time(NULL) >= renew_at)
+                {
+                    renew(http);
+                    renew_at = time(NULL) + lease_duration / 2;
+                }
+                if(error_str.empty() && subscription_id != 0)
+                {
+                    if(!poll(http, error_str))
+                    {
+                        // the job is over, and its subscription with it
+                        break;
+                    }
+                }
+                if(!error_str.empty() && !isStopping())
+                {
+                    pushError(error_str);
+                    if(http != NULL)
+                    {
+                        // reconnect on next round
+                        setHttp(NULL);
+                        httpClose(http);
+                        http = NULL;
+                    }
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait_for(lock, std::chrono::milliseconds(interval), [this] { return stopping; });
+            }
+            if(http != NULL && isShutDown())
+            {
+                // interrupted by stop(): cancel on a new connection
+                setHttp(NULL);
+                httpClose(http);
+                http = (subscription_id != 0) ? connectToServer() : NULL;
+            }
+            if(http != NULL)
+            {
+                cancelSubscription(http);
+                setHttp(NULL);
+                httpClose(http);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished = true;
+            }
+            uv_async_send(&async);
+        }
+
+        bool isStopping()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stopping;
+        }
+
+        /// @param oStatus status of the refused request
+        bool subscribe(http_t *http, std::string &error_str, ipp_status_t &oStatus)
+        {
+            std::vector<const char*> notify_events;
+            for(std::vector<std::string>::const_iterator itEvent = events.begin(); itEvent != events.end(); ++itEvent)
+            {
+                notify_events.push_back(itEvent->c_str());
+            }
+            ipp_t *request;
+            if(job_id > 0)
+            {
+                request = newPrinterRequest(IPP_OP_CREATE_JOB_SUBSCRIPTIONS, printername.c_str());
+                ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "notify-job-id", job_id);
+            }
+            else
+            {
+                request = newPrinterRequest(IPP_OP_CREATE_PRINTER_SUBSCRIPTIONS, printername.c_str());
+            }
+            ippAddStrings(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_KEYWORD, "notify-events",
+                          static_cast<int>(notify_events.size()), NULL, &notify_events[0]);
+            ippAddString(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_KEYWORD, "notify-pull-method", NULL, "ippget");
+            if(job_id <= 0)
+            {
+                ippAddInteger(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_INTEGER, "notify-lease-duration", lease_duration);
+            }
+            ipp_t *response = cupsDoRequest(http, request, "/");
+            ipp_attribute_t *attr = (response != NULL) ? ippFindAttribute(response, "notify-subscription-id", IPP_TAG_INTEGER) : NULL;
+            if(attr == NULL)
+            {
+                error_str = "Unable to create subscription: ";
+                error_str += cupsLastErrorString();
+                // a subscription group may be refused with a successful operation status
+                oStatus = (response != NULL && ippGetStatusCode(response) > IPP_STATUS_OK_CONFLICTING)
+                    ? ippGetStatusCode(response) : cupsLastError();
+            }
+            else
+            {
+                subscription_id = ippGetInteger(attr, 0);
+                last_sequence_number = 0;
+            }
+            ippDelete(response);
+            return subscription_id != 0;
+        }
+
+        void renew(http_t *http)
+        {
+            ipp_t *request = newPrinterRequest(IPP_OP_RENEW_SUBSCRIPTION, NULL);
+            ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "notify-subscription-id", subscription_id);
+            ippAddInteger(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_INTEGER, "notify-lease-duration", lease_duration);
+            ippDelete(cupsDoRequest(http, request, "/"));
+        }
+
+        void cancelSubscription(http_t *http)
+        {
+            if(subscription_id == 0)
+            {
+                return;
+            }
+            ipp_t *request = newPrinterRequest(IPP_OP_CANCEL_SUBSCRIPTION, NULL);
+            ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "notify-subscription-id", subscription_id);
+            ippDelete(cupsDoRequest(http, request, "/"));
+            subscription_id = 0;
+        }
+
+        /** Get-Notifications since the last received event
+         * @return false once the subscription of a job is gone with it
+         */
+        bool poll(http_t *http, std::string &error_str)
+        {
+            ipp_t *request = newPrinterRequest(IPP_OP_GET_NOTIFICATIONS, NULL);
+            ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "notify-subscription-ids", subscription_id);
+            ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER, "notify-sequence-numbers", last_sequence_number + 1);
+            ippAddBoolean(request, IPP_TAG_OPERATION, "notify-wait", 1);
+            ipp_t *response = cupsDoRequest(http, request, "/");
+            if(response == NULL)
+            {
+                error_str = cupsLastErrorString();
+                return true;
+            }
+            ipp_status_t status = ippGetStatusCode(response);
+            if(status == IPP_STATUS_ERROR_NOT_FOUND)
+            {
+                // subscription expired, subscribe again, unless it ended with its job
+                subscription_id = 0;
+                if(job_id > 0)
+                {
+                    ippDelete(response);
+                    return false;
+                }
+            }
+            else if(status > IPP_STATUS_OK_EVENTS_COMPLETE)
+            {
+                error_str = cupsLastErrorString();
+            }
+            else
+            {
+                std::vector<Event> received;
+                Event *current = NULL;
+                char value[1024];
+                for(ipp_attribute_t *attr = ippFirstAttribute(response); attr != NULL; attr = ippNextAttribute(response))
+                {
+                    const char *name = ippGetName(attr);
+                    if(ippGetGroupTag(attr) != IPP_TAG_EVENT_NOTIFICATION || name == NULL)
+                    {
+                        current = NULL;
+                        continue;
+                    }
+                    if(current == NULL)
+                    {
+                        received.push_back(Event());
+                        current = &received.back();
+                        current->sequence_number = 0;
+                    }
+                    std::string key(name);
+                    if(key == "notify-subscribed-event")
+                    {
+                        current->name = ippGetString(attr, 0, NULL);
+                    }
+                    else if(key == "notify-sequence-number")
+                    {
+                        current->sequence_number = ippGetInteger(attr, 0);
+                        if(current->sequence_number > last_sequence_number)
+                        {
+                            last_sequence_number = current->sequence_number;
+                        }
+                    }
+                    ippAttributeString(attr, value, sizeof(value));
+                    current->attributes.push_back(std::make_pair(key, std::string(value)));
+                }
+                if(!received.empty())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        queue.insert(queue.end(), received.begin(), received.end());
+                    }
+                    uv_async_send(&async);
+                }
+            }
+            ippDelete(response);
+            return true;
+        }
+
+        void pushError(const std::string &iError)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                errors.push_back(iError);
+            }
+            uv_async_send(&async);
+        }
+
+        /// Deliver queued events and errors on the event loop
+        static void onAsync(uv_async_t *handle)
+        {
+            NotificationWatcher *watcher = static_cast<NotificationWatcher*>(handle->data);
+            std::vector<Event> events;
+            std::vector<std::string> errors;
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(watcher->mutex);
+                events.swap(watcher->queue);
+                errors.swap(watcher->errors);
+                finished = watcher->finished;
+            }
+
+            Nan::HandleScope scope;
+            MY_NODE_MODULE_ISOLATE_DECL
+            for(std::vector<std::string>::const_iterator itError = errors.begin(); itError != errors.end(); ++itError)
+            {
+                v8::Local<v8::Value> argv[] = { Nan::Error(itError->c_str()) };
+                watcher->callback.Call(1, argv, &watcher->async_resource);
+            }
+            if(!events.empty())
+            {
+                v8::Local<v8::Array> result = V8_VALUE_NEW(Array, static_cast<int>(events.size()));
+                for(size_t i = 0; i < events.size(); ++i)
+                {
+                    v8::Local<v8::Object> result_event = V8_VALUE_NEW_DEFAULT(Object);
+                    Nan::Set(result_event, V8_STRING_NEW_UTF8("event"), V8_STRING_NEW_UTF8(events[i].name.c_str()));
+                    Nan::Set(result_event, V8_STRING_NEW_UTF8("sequenceNumber"), V8_VALUE_NEW(Number, events[i].sequence_number));
+                    v8::Local<v8::Object> result_attributes = V8_VALUE_NEW_DEFAULT(Object);
+                    for(AttributesType::const_iterator itAttr = events[i].attributes.begin(); itAttr != events[i].attributes.end(); ++itAttr)
+                    {
+                        Nan::Set(result_attributes, V8_STRING_NEW_UTF8(itAttr->first.c_str()), V8_STRING_NEW_UTF8(itAttr->second.c_str()));
+                    }
+                    Nan::Set(result_event, V8_STRING_NEW_UTF8("attributes"), result_attributes);
+                    Nan::Set(result, static_cast<uint32_t>(i), result_event);
+                }
+                v8::Local<v8::Value> argv[] = { Nan::Null(), result };
+                watcher->callback.Call(2, argv, &watcher->async_resource);
+            }
+            if(finished && watcher->thread.joinable())
+            {
+                watcher->thread.join();
+                getWatchers().get().remove(watcher);
+                uv_close(reinterpret_cast<uv_handle_t*>(&watcher->async), onClose);
+            }
+        }
+
+        static void onClose(uv_handle_t *handle)
+        {
+            NotificationWatcher *watcher = static_cast<NotificationWatcher*>(handle->data);
+            watcher->Unref();
+        }
+
+        static MY_NODE_MODULE_CALLBACK(Close)
+        {
+            Nan::HandleScope scope;
+            NotificationWatcher *watcher = Nan::ObjectWrap::Unwrap<NotificationWatcher>(iArgs.This());
+            watcher->stop();
+            MY_NODE_MODULE_RETURN_UNDEFINED();
+        }
+
+        // configuration, read only for the thread
+        std::string printername;
+        int job_id;
+        std::vector<std::string> events;
+        int lease_duration;
+        int interval;
+
+        // event loop side
+        Nan::Callback callback;
+        Nan::AsyncResource async_resource;
+        uv_async_t async;
+        std::thread thread;
+
+        // shared, protected by mutex
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool stopping;
+        bool finished;
+        std::vector<Event> queue;
+        std::vector<std::string> errors;
+        http_t *http_in_use;
+        bool http_shut_down;
+
+        // watcher thread side
+        int subscription_id;
+        int last_sequence_number;
+    };
+
+    /** Raw TCP printing to socket://host:port devices (AppSocket/JetDirect), without cupsd.
+     * One native I/O thread drives all the devices with non-blocking sockets and poll():
+     * the connection of a device is kept open between jobs, and the queued jobs of a device
+     * are written back to back on it (pipelined) with one sendmsg. A job is done once all its
+     * bytes are accepted by the kernel: AppSocket has no acknowledge. A job which makes no
+     * progress during its timeout fails, and its connection is closed.
+     * Host names are resolved by a resolver thread, so a slow DNS does not stall the other devices.
+     */
+    class SocketBackend {
+    public:
+        /// Called from the I/O thread with the error string, empty on success
+        typedef std::function<void(const std::string&)> DoneType;
+
+        /// Data of a job, owned or a shared backing store: not the memory of an isolate
+        typedef std::shared_ptr<const PrintData> DataPtr;
+
+        static SocketBackend& instance()
+        {
+            static SocketBackend backend;
+            return backend;
+        }
+
+        /** Queue a job. The data is referenced, not copied: it must not depend on the memory of an
+         * isolate, which may end (worker exit) while the job is still queued
+         * @param iTimeout ms without progress (connection or write) after which the job fails
+         * @param iIdleTimeout ms the connection is kept open once the device has no more jobs
+         */
+        void send(const std::string &iHost, int iPort, DataPtr iData,
+                  int iTimeout, int iIdleTimeout, DoneType iDone)
+        {
+            Job job = { iHost, iPort, std::move(iData), 0, iTimeout, iIdleTimeout, iDone };
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!thread.joinable())
+                {
+                    thread = std::thread(&SocketBackend::run, this);
+                }
+                incoming.push_back(std::move(job));
+            }
+            wakeUp();
+        }
+
+    private:
+        static const size_t kMaxPipelinedJobs = 16;
+        static const int kMaxPollMs = 1000;
+
+        typedef std::shared_ptr<addrinfo> AddressesPtr;
+
+        struct Job
+        {
+            std::string host;
+            int port;
+            DataPtr data;
+            size_t offset;
+            int timeout;
+            int idle_timeout;
+            DoneType done;
+        };
+
+        /// A device, only used by the I/O thread
+        struct Device
+        {
+            Device(): fd(-1), connected(false), resolving(false), deadline(0), idle_since(0), idle_timeout(0) {}
+
+            int fd;
+            bool connected;
+            bool resolving;
+            std::deque<Job> jobs;
+            uint64_t deadline; // uv_hrtime ns, progress deadline of the first job
+            uint64_t idle_since; // uv_hrtime ns
+            int idle_timeout;
+        };
+        typedef std::map<std::string, Device> DeviceMapType;
+
+        /// Host name resolution of a device, asked by the I/O thread to the resolver thread
+        struct Resolution
+        {
+            std::string key;
+            std::string host;
+            int port;
+            AddressesPtr addresses;
+            std::string error;
+        };
+
+        SocketBackend(): stopping(false)
+        {
+            wake_fds[0] = wake_fds[1] = -1;
+            if(pipe(wake_fds) == 0)
+            {
+                fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+                fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+            }
+        }
+
+        ~SocketBackend()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeUp();
+            resolver_wake.notify_one();
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+            if(resolver.joinable())
+            {
+                resolver.join();
+            }
+            close(wake_fds[0]);
+            close(wake_fds[1]);
+        }
+
+        void wakeUp()
+        {
+            char c = 0;
+            if(::write(wake_fds[1], &c, 1) < 0)
+            {
+                // the pipe is full: the thread is already woken up
+            }
+        }
+
+        static uint64_t msToNs(int iMs) { return static_cast<uint64_t>(iMs) * 1000000; }
+
+        /// I/O thread, does not touch v8
+        void run()
+        {
+            DeviceMapType devices;
+            std::vector<pollfd> fds;
+            std::vector<Device*> polled;
+            std::vector<Resolution> resolutions;
+            while(true)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(stopping)
+                    {
+                        break;
+                    }
+                    for(std::vector<Job>::iterator itJob = incoming.begin(); itJob != incoming.end(); ++itJob)
+                    {
+                        std::ostringstream key;
+                        key << itJob->host << ':' << itJob->port;
+                        Device &device = devices[key.str()];
+                        if(device.jobs.empty() && device.connected)
+                        {
+                            device.deadline = uv_hrtime() + msToNs(itJob->timeout);
+                        }
+                        device.jobs.push_back(std::move(*itJob));
+                    }
+                    incoming.clear();
+                    resolutions.swap(resolved);
+                }
+                uint64_t now = uv_hrtime();
+                for(std::vector<Resolution>::iterator itResolution = resolutions.begin(); itResolution != resolutions.end(); ++itResolution)
+                {
+                    DeviceMapType::iterator itDevice = devices.find(itResolution->key);
+                    // the jobs may have timed out meanwhile
+                    if(itDevice == devices.end() || !itDevice->second.resolving)
+                    {
+                        continue;
+                    }
+                    Device &device = itDevice->second;
+                    device.resolving = false;
+                    if(device.jobs.empty())
+                    {
+                        continue;
+                    }
+                    if(!itResolution->error.empty())
+                    {
+                        failAll(device, itResolution->error);
+                        continue;
+                    }
+                    connect(device, itResolution->addresses.get());
+                }
+                resolutions.clear();
+
+                uint64_t next_deadline = now + msToNs(kMaxPollMs);
+                pollfd wake = { wake_fds[0], POLLIN, 0 };
+                fds.assign(1, wake);
+                polled.clear();
+                for(DeviceMapType::iterator itDevice = devices.begin(); itDevice != devices.end(); ++itDevice)
+                {
+                    Device &device = itDevice->second;
+                    if(device.fd < 0 && !device.jobs.empty() && !device.resolving)
+                    {
+                        resolve(itDevice->first, device, now);
+                    }
+                    if(device.fd < 0)
+                    {
+                        if(device.resolving && !device.jobs.empty())
+                        {
+                            next_deadline = std::min(next_deadline, device.deadline);
+                        }
+                        continue;
+                    }
+                    pollfd entry = { device.fd, POLLIN, 0 };
+                    if(!device.connected || !device.jobs.empty())
+                    {
+                        entry.events |= POLLOUT;
+                    }
+                    fds.push_back(entry);
+                    polled.push_back(&device);
+                    uint64_t deadline = device.jobs.empty() ? device.idle_since + msToNs(device.idle_timeout) : device.deadline;
+                    next_deadline = std::min(next_deadline, deadline);
+                }
+
+                int timeout = (next_deadline > now) ? static_cast<int>((next_deadline - now) / 1000000) + 1 : 0;
+                if(poll(&fds[0], fds.size(), timeout) < 0 && errno != EINTR)
+                {
+                    // nothing sensible to do but retry later
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                char buffer[256];
+                while(read(wake_fds[0], buffer, sizeof(buffer)) > 0)
+                {
+                }
+
+                now = uv_hrtime();
+                for(size_t i = 0; i < polled.size(); ++i)
+                {
+                    handleEvents(*polled[i], fds[i + 1].revents, now);
+                }
+                for(DeviceMapType::iterator itDevice = devices.begin(); itDevice != devices.end();)
+                {
+                    Device &device = itDevice->second;
+                    if(!device.jobs.empty() && now >= device.deadline)
+                    {
+                        failFirst(device, device.connected ? "Write timeout" : "Connection timeout");
+                        if(device.resolving && !device.jobs.empty())
+                        {
+                            // the next job waits for the same resolution
+                            device.deadline = now + msToNs(device.jobs.front().timeout);
+                        }
+                    }
+                    else if(device.jobs.empty() && device.fd >= 0 && now >= device.idle_since + msToNs(device.idle_timeout))
+                    {
+                        disconnect(device);
+                    }
+                    if(device.fd < 0 && device.jobs.empty())
+                    {
+                        devices.erase(itDevice++);
+                    }
+                    else
+                    {
+                        ++itDevice;
+                    }
+                }
+            }
+            for(DeviceMapType::iterator itDevice = devices.begin(); itDevice != devices.end(); ++itDevice)
+            {
+                disconnect(itDevice->second);
+                failAll(itDevice->second, "Socket backend stopped");
+            }
+        }
+
+        /// Ask the resolver thread for the addresses of the host of the first job, the connection timeout starts
+        void resolve(const std::string &iKey, Device &device, uint64_t iNow)
+        {
+            const Job &job = device.jobs.front();
+            Resolution resolution = { iKey, job.host, job.port, AddressesPtr(), std::string() };
+            device.resolving = true;
+            device.connected = false;
+            device.deadline = iNow + msToNs(job.timeout);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!resolver.joinable())
+                {
+                    resolver = std::thread(&SocketBackend::runResolver, this);
+                }
+                to_resolve.push_back(std::move(resolution));
+            }
+            resolver_wake.notify_one();
+        }
+
+        /// Resolver thread: getaddrinfo blocks, possibly for seconds
+        void runResolver()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true)
+            {
+                resolver_wake.wait(lock, [this]() { return stopping || !to_resolve.empty(); });
+                if(stopping)
+                {
+                    break;
+                }
+                Resolution resolution = std::move(to_resolve.front());
+                to_resolve.pop_front();
+                lock.unlock();
+
+                StatsTimer timer(STATS_METRIC("socket:resolve"));
+                addrinfo hints;
+                memset(&hints, 0, sizeof(hints));
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                std::ostringstream port;
+                port << resolution.port;
+                addrinfo *addresses = NULL;
+                int status = getaddrinfo(resolution.host.c_str(), port.str().c_str(), &hints, &addresses);
+                if(status != 0)
+                {
+                    timer.setError();
+                    resolution.error = std::string("Unable to resolve ") + resolution.host + ": " + gai_strerror(status);
+                }
+                else
+                {
+                    resolution.addresses.reset(addresses, freeaddrinfo);
+                }
+
+                lock.lock();
+                resolved.push_back(std::move(resolution));
+                wakeUp();
+            }
+        }
+
+        /// Start a non-blocking connection to the resolved host of the first job
+        void connect(Device &device, const addrinfo *addresses)
+        {
+            const Job &job = device.jobs.front();
+            StatsTimer timer(STATS_METRIC("socket:connect"));
+            int error = 0;
+            for(const addrinfo *address = addresses; address != NULL && device.fd < 0; address = address->ai_next)
+            {
+                int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+                if(fd < 0)
+                {
+                    error = errno;
+                    continue;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+                if(::connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS)
+                {
+                    device.fd = fd;
+                }
+                else
+                {
+                    error = errno;
+                    close(fd);
+                }
+            }
+            if(device.fd < 0)
+            {
+                timer.setError();
+                failAll(device, std::string("Unable to connect to ") + job.host + ": " + strerror(error));
+            }
+        }
+
+        void disconnect(Device &device)
+        {
+            if(device.fd >= 0)
+            {
+                close(device.fd);
+            }
+            device.fd = -1;
+            device.connected = false;
+        }
+
+        void handleEvents(Device &device, short iEvents, uint64_t iNow)
+        {
+            if(!device.connected)
+            {
+                if((iEvents & (POLLOUT | POLLERR | POLLHUP)) == 0)
+                {
+                    return;
+                }
+                int error = 0;
+                socklen_t length = sizeof(error);
+                if(getsockopt(device.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0)
+                {
+                    error = errno;
+                }
+                if(error != 0)
+                {
+                    disconnect(device);
+                    failAll(device, std::string("Unable to connect: ") + strerror(error));
+                    return;
+                }
+                device.connected = true;
+                if(!device.jobs.empty())
+                {
+                    device.deadline = iNow + msToNs(device.jobs.front().timeout);
+                }
+            }
+            if(iEvents & (POLLIN | POLLERR | POLLHUP))
+            {
+                // printers may send status bytes back: they are dropped
+                char buffer[4096];
+                ssize_t received = recv(device.fd, buffer, sizeof(buffer), 0);
+                if(received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    // closed by the printer: a job partly written is lost, the others go on a new connection
+                    std::string error_str = (received == 0) ? "Connection closed by the printer" : strerror(errno);
+                    disconnect(device);
+                    if(!device.jobs.empty() && device.jobs.front().offset > 0)
+                    {
+                        failFirst(device, error_str);
+                    }
+                    return;
+                }
+            }
+            if((iEvents & POLLOUT) && !device.jobs.empty())
+            {
+                writeJobs(device, iNow);
+            }
+        }
+
+        /// Write as much as possible of the queued jobs with one sendmsg
+        void writeJobs(Device &device, uint64_t iNow)
+        {
+            iovec iov[kMaxPipelinedJobs];
+            size_t count = 0;
+            for(std::deque<Job>::iterator itJob = device.jobs.begin(); itJob != device.jobs.end() && count < kMaxPipelinedJobs; ++itJob)
+            {
+                iov[count].iov_base = const_cast<char*>(itJob->data->data() + itJob->offset);
+                iov[count].iov_len = itJob->data->size() - itJob->offset;
+                ++count;
+            }
+            msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            StatsTimer timer(STATS_METRIC("socket:write"));
+            ssize_t sent = sendmsg(device.fd, &message, MSG_NOSIGNAL);
+            if(sent < 0)
+            {
+                if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    return;
+                }
+                timer.setError();
+                std::string error_str = strerror(errno);
+                disconnect(device);
+                failFirst(device, error_str);
+                return;
+            }
+            timer.addBytes(sent);
+            size_t remaining = static_cast<size_t>(sent);
+            while(!device.jobs.empty())
+            {
+                Job &job = device.jobs.front();
+                size_t written = std::min(remaining, job.data->size() - job.offset);
+                job.offset += written;
+                remaining -= written;
+                if(job.offset < job.data->size())
+                {
+                    break;
+                }
+                DoneType done = job.done;
+                device.idle_timeout = job.idle_timeout;
+                device.jobs.pop_front();
+                done("");
+            }
+            device.idle_since = iNow;
+            if(!device.jobs.empty())
+            {
+                device.deadline = iNow + msToNs(device.jobs.front().timeout);
+            }
+        }
+
+        /// Fail the first job, closing the connection which holds its partial data
+        void failFirst(Device &device, const std::string &iError)
+        {
+            disconnect(device);
+            DoneType done = device.jobs.front().done;
+            device.jobs.pop_front();
+            done(iError);
+        }
+
+        void failAll(Device &device, const std::string &iError)
+        {
+            std::deque<Job> jobs;
+            jobs.swap(device.jobs);
+            for(std::deque<Job>::iterator itJob = jobs.begin(); itJob != jobs.end(); ++itJob)
+            {
+                itJob->done(iError);
+            }
+        }
+
+        int wake_fds[2];
+        std::thread thread;
+        std::thread resolver;
+        std::condition_variable resolver_wake;
+
+        // shared, protected by mutex
+        std::mutex mutex;
+        bool stopping;
+        std::vector<Job> incoming;
+        std::deque<Resolution> to_resolve;
+        std::vector<Resolution> resolved;
+    };
+
+    /** Parse socket://host[:port][/...], the port defaults to 9100. The scheme is case insensitive
+     * @return false if iUri is not a socket URI
+     */
+    bool parseSocketUri(const std::string &iUri, std::string &oHost, int &oPort)
+    {
+        static const char kScheme[] = "socket://";
+        if(strncasecmp(iUri.c_str(), kScheme, sizeof(kScheme) - 1) != 0)
+        {
+            return false;
+        }
+        std::string address = iUri.substr(sizeof(kScheme) - 1);
+        address = address.substr(0, address.find('/'));
+        oPort = 9100;
+        size_t port_start = std::string::npos;
+        if(!address.empty() && address[0] == '[')
+        {
+            size_t end = address.find(']');
+            if(end == std::string::npos)
+            {
+                return false;
+            }
+            oHost = address.substr(1, end - 1);
+            if(end + 1 < address.size() && address[end + 1] == ':')
+            {
+                port_start = end + 2;
+            }
+        }
+        else
+        {
+            size_t colon = address.find(':');
+            oHost = address.substr(0, colon);
+            if(colon != std::string::npos)
+            {
+                port_start = colon + 1;
+            }
+        }
+        if(port_start != std::string::npos)
+        {
+            oPort = atoi(address.c_str() + port_start);
+        }
+        return !oHost.empty() && oPort > 0 && oPort < 65536;
+    }
+
+    /** A job sent with the socket backend, seen from the event loop:
+     * the result comes back from the I/O thread with an uv_async_t
+     */
+    class SocketPrintRequest {
+    public:
+        SocketPrintRequest(v8::Local<v8::Function> iCallback, int iJobId):
+            data(std::make_shared<PrintData>()), callback(iCallback), async_resource("printer:printSocket"), completion(std::make_shared<Completion>()),
+            job_id(iJobId), size(0), start(uv_hrtime())
+        {
+            completion->request = this;
+        }
+
+        ~SocketPrintRequest()
+        {
+            std::lock_guard<std::mutex> lock(completion->mutex);
+            completion->request = NULL;
+        }
+
+        PrintData& getData() { return *data; }
+
+        /** Queue the job, the request is freed once the callback is called.
+         * The data is handed over to the backend without a copy: strings are already transcoded into
+         * an owned buffer and binary data references its backing store, not the JS value
+         */
+        void send(const std::string &iHost, int iPort, int iTimeout, int iIdleTimeout)
+        {
+            async.data = this;
+            uv_async_init(Nan::GetCurrentEventLoop(), &async, onAsync);
+            getRequests().get().add(this);
+            size = data->size();
+            std::shared_ptr<Completion> job_completion = completion;
+            SocketBackend::instance().send(iHost, iPort, std::move(data), iTimeout, iIdleTimeout,
+                                           [job_completion](const std::string &iError) {
+                                               std::lock_guard<std::mutex> lock(job_completion->mutex);
+                                               if(job_completion->request != NULL)
+                                               {
+                                                   job_completion->request->done(iError);
+                                               }
+                                           });
+        }
+
+        /// The isolate environment ends: the job goes on without callback, its result is dropped
+        void shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> lock(completion->mutex);
+                completion->request = NULL;
+            }
+            uv_close(reinterpret_cast<uv_handle_t*>(&async), onClose);
+        }
+
+    private:
+        /// Link from the I/O thread to the request, cut when the request is shut down
+        struct Completion
+        {
+            Completion(): request(NULL) {}
+
+            std::mutex mutex;
+            SocketPrintRequest *request;
+        };
+
+        static PerIsolate<IsolateObjects<SocketPrintRequest> >& getRequests()
+        {
+            static PerIsolate<IsolateObjects<SocketPrintRequest> > requests;
+            return requests;
+        }
+
+        /// Called from the I/O thread, under the completion lock
+        void done(const std::string &iError)
+        {
+            error_str = iError;
+            uv_async_send(&async);
+        }
+
+        static void onAsync(uv_async_t *handle)
+        {
+            SocketPrintRequest *request = static_cast<SocketPrintRequest*>(handle->data);
+            STATS_METRIC("worker:printSocket").record(uv_hrtime() - request->start, !request->error_str.empty(), request->size);
+            getRequests().get().remove(request);
+            Nan::HandleScope scope;
+            MY_NODE_MODULE_ISOLATE_DECL
+            if(request->error_str.empty())
+            {
+                v8::Local<v8::Value> argv[] = { Nan::Null(), V8_VALUE_NEW(Number, request->job_id) };
+                request->callback.Call(2, argv, &request->async_resource);
+            }
+            else
+            {
+                v8::Local<v8::Value> argv[] = { Nan::Error(request->error_str.c_str()) };
+                request->callback.Call(1, argv, &request->async_resource);
+            }
+            uv_close(reinterpret_cast<uv_handle_t*>(&request->async), onClose);
+        }
+
+        static void onClose(uv_handle_t *handle)
+        {
+            delete static_cast<SocketPrintRequest*>(handle->data);
+        }
+
+        std::shared_ptr<PrintData> data;
+        Nan::Callback callback;
+        Nan::AsyncResource async_resource;
+        uv_async_t async;
+        std::shared_ptr<Completion> completion;
+        int job_id;
+        size_t size;
+        uint64_t start;
+        std::string error_str; // written by the I/O thread before uv_async_send
+    };
+}
+
+MY_NODE_MODULE_CALLBACK(getPrinters)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    JobsMode jobs_mode;
+    if(!getJobsMode(iArgs[0], jobs_mode))
+    {
+        RETURN_EXCEPTION_STR("jobs must be one of none, lazy, eager");
+    }
+    RequestedAttributes attributes;
+    if(!attributes.parse(iArgs[1]))
+    {
+        RETURN_EXCEPTION_STR("attributes must be an array of strings");
+    }
+    // servers to query, the default one if not given
+    ServerInventoryListType inventories;
+    bool tag_server = !iArgs[2]->IsUndefined();
+    if(tag_server)
+    {
+        if(!iArgs[2]->IsArray())
+        {
+            RETURN_EXCEPTION_STR("servers must be an array of strings");
+        }
+        v8::Local<v8::Array> servers = v8::Local<v8::Array>::Cast(iArgs[2]);
+        for(uint32_t i = 0; i < servers->Length(); ++i)
+        {
+            std::string server;
+            if(!getServer(Nan::Get(servers, i).ToLocalChecked(), server) || server.empty())
+            {
+                RETURN_EXCEPTION_STR("servers must be an array of strings");
+            }
+            inventories.push_back(ServerInventory(server));
+        }
+    }
+    else
+    {
+        inventories.push_back(ServerInventory());
+    }
+
+    fetchInventories(inventories, jobs_mode, attributes);
+
+    RecordKeys &keys = RecordKeys::get();
+    v8::Local<v8::Array> result = V8_VALUE_NEW_DEFAULT(Array);
+    v8::Local<v8::Array> errors = V8_VALUE_NEW_DEFAULT(Array);
+    uint32_t printers_count = 0;
+    uint32_t errors_count = 0;
+    std::string error_str;
+    for(ServerInventoryListType::iterator itInventory = inventories.begin(); itInventory != inventories.end(); ++itInventory)
+    {
+        error_str = itInventory->getError();
+        if(error_str.empty())
+        {
+            error_str = itInventory->convert(keys, jobs_mode, result, printers_count, tag_server);
+        }
+        if(error_str.empty())
+        {
+            continue;
+        }
+        if(!tag_server)
+        {
+            // got an error? return the error then
+            RETURN_EXCEPTION_STR(error_str.c_str());
+        }
+        // the printers of the other servers are returned, with the errors
+        v8::Local<v8::Object> error = V8_VALUE_NEW_DEFAULT(Object);
+        Nan::Set(error, keys.key(RecordKeys::SERVER), V8_STRING_NEW_UTF8(itInventory->getServer().c_str()));
+        Nan::Set(error, V8_STRING_NEW_UTF8("message"), V8_STRING_NEW_UTF8(error_str.c_str()));
+        Nan::Set(errors, errors_count++, error);
+    }
+    if(errors_count > 0)
+    {
+        if(errors_count == inventories.size())
+        {
+            // no server answered
+            error_str = inventories.front().getServer() + ": " + (inventories.front().getError().empty() ? error_str : inventories.front().getError());
+            RETURN_EXCEPTION_STR(error_str.c_str());
+        }
+        Nan::DefineOwnProperty(result, V8_STRING_NEW_UTF8("errors"), errors, v8::DontEnum);
+    }
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
+
+MY_NODE_MODULE_CALLBACK(getPrintersDelta)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    std::string since;
+    if(!iArgs[0]->IsUndefined() && !iArgs[0]->IsNull())
+    {
+        if(!iArgs[0]->IsString())
+        {
+            RETURN_EXCEPTION_STR("sinceVersion must be the version string of a previous result");
+        }
+        since = *Nan::Utf8String(iArgs[0]);
+    }
+
+    CupsDestsPtr dests = DestCache::instance().get();
+    // an unreachable server must not look like removed printers
+    if(!dests->getError().empty())
+    {
+        RETURN_EXCEPTION_STR(dests->getError().c_str());
+    }
+    CupsJobs jobs(NULL, CUPS_WHICHJOBS_ACTIVE);
+    if(!jobs.getError().empty())
+    {
+        RETURN_EXCEPTION_STR(jobs.getError().c_str());
+    }
+
+    PrintersSnapshot::PrinterTableType::HashMapType printer_hashes;
+    std::map<std::string, const cups_dest_t*> printers_by_key;
+    cups_dest_t *printer = dests->get();
+    for(int i = 0; i < dests->getNumDests(); ++i, ++printer)
+    {
+        std::string key = getPrinterKey(printer);
+        printer_hashes[key] = hashPrinter(printer);
+        printers_by_key[key] = printer;
+    }
+    PrintersSnapshot::JobTableType::HashMapType job_hashes;
+    std::map<int, const cups_job_t*> jobs_by_id;
+    cups_job_t *job = jobs.get();
+    for(int i = 0; i < jobs.getNumJobs(); ++i, ++job)
+    {
+        job_hashes[job->id] = hashJob(job);
+        jobs_by_id[job->id] = job;
+    }
+
+    PrintersSnapshot::Delta delta;
+    PrintersSnapshot::instance().update(printer_hashes, job_hashes, since, delta);
+
+    // convert only the records of the delta
+    RecordKeys &keys = RecordKeys::get();
+    v8::Local<v8::Array> added_printers = V8_VALUE_NEW(Array, static_cast<int>(delta.added_printers.size()));
+    for(size_t i = 0; i < delta.added_printers.size(); ++i)
+    {
+        v8::Local<v8::Object> result_printer = keys.newPrinter();
+        parsePrinterInfo(keys, printers_by_key[delta.added_printers[i]], result_printer);
+        Nan::Set(added_printers, static_cast<uint32_t>(i), result_printer);
+    }
+    v8::Local<v8::Array> changed_printers = V8_VALUE_NEW(Array, static_cast<int>(delta.changed_printers.size()));
+    for(size_t i = 0; i < delta.changed_printers.size(); ++i)
+    {
+        v8::Local<v8::Object> result_printer = keys.newPrinter();
+        parsePrinterInfo(keys, printers_by_key[delta.changed_printers[i]], result_printer);
+        Nan::Set(changed_printers, static_cast<uint32_t>(i), result_printer);
+    }
+    v8::Local<v8::Array> removed_printers = V8_VALUE_NEW(Array, static_cast<int>(delta.removed_printers.size()));
+    for(size_t i = 0; i < delta.removed_printers.size(); ++i)
+    {
+        Nan::Set(removed_printers, static_cast<uint32_t>(i), V8_STRING_NEW_UTF8(delta.removed_printers[i].c_str()));
+    }
+    v8::Local<v8::Array> added_jobs = V8_VALUE_NEW(Array, static_cast<int>(delta.added_jobs.size()));
+    for(size_t i = 0; i < delta.added_jobs.size(); ++i)
+    {
+        v8::Local<v8::Object> result_printer_job = keys.newJob();
+        parseJobObject(keys, jobs_by_id[delta.added_jobs[i]], result_printer_job);
+        Nan::Set(added_jobs, static_cast<uint32_t>(i), result_printer_job);
+    }
+    v8::Local<v8::Array> changed_jobs = V8_VALUE_NEW(Array, static_cast<int>(delta.changed_jobs.size()));
+    for(size_t i = 0; i < delta.changed_jobs.size(); ++i)
+    {
+        v8::Local<v8::Object> result_printer_job = keys.newJob();
+        parseJobObject(keys, jobs_by_id[delta.changed_jobs[i]], result_printer_job);
+        Nan::Set(changed_jobs, static_cast<uint32_t>(i), result_printer_job);
+    }
+    v8::Local<v8::Array> removed_jobs = V8_VALUE_NEW(Array, static_cast<int>(delta.removed_jobs.size()));
+    for(size_t i = 0; i < delta.removed_jobs.size(); ++i)
+    {
+        Nan::Set(removed_jobs, static_cast<uint32_t>(i), V8_VALUE_NEW(Number, delta.removed_jobs[i]));
+    }
+
+    v8::Local<v8::Object> result_printers = V8_VALUE_NEW_DEFAULT(Object);
+    Nan::Set(result_printers, V8_STRING_NEW_UTF8("added"), added_printers);
+    Nan::Set(result_printers, V8_STRING_NEW_UTF8("changed"), changed_printers);
+    Nan::Set(result_printers, V8_STRING_NEW_UTF8("removed"), removed_printers);
+    v8::Local<v8::Object> result_jobs = V8_VALUE_NEW_DEFAULT(Object);
+    Nan::Set(result_jobs, V8_STRING_NEW_UTF8("added"), added_jobs);
+    Nan::Set(result_jobs, V8_STRING_NEW_UTF8("changed"), changed_jobs);
+    Nan::Set(result_jobs, V8_STRING_NEW_UTF8("removed"), removed_jobs);
+    v8::Local<v8::Object> result = V8_VALUE_NEW_DEFAULT(Object);
+    Nan::Set(result, V8_STRING_NEW_UTF8("version"), V8_STRING_NEW_UTF8(delta.version.c_str()));
+    Nan::Set(result, V8_STRING_NEW_UTF8("full"), V8_VALUE_NEW(Boolean, delta.full));
+    Nan::Set(result, V8_STRING_NEW_UTF8("printers"), result_printers);
+    Nan::Set(result, keys.key(RecordKeys::JOBS), result_jobs);
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
+
+MY_NODE_MODULE_CALLBACK(setDestinationCacheOptions)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 2);
+    if(!iArgs[0]->IsNumber() || !iArgs[1]->IsNumber())
+    {
+        RETURN_EXCEPTION_STR("ttl and checkInterval must be numbers");
+    }
+    DestCache::instance().configure(Nan::To<double>(iArgs[0]).FromJust(), Nan::To<double>(iArgs[1]).FromJust());
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(refreshDestinationCache)
+{
+    Nan::HandleScope scope;
+    DestCache::instance().refresh();
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(invalidateDestinationCache)
+{
+    Nan::HandleScope scope;
+    DestCache::instance().invalidate();
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(setConnectionPoolOptions)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 3);
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 0, size);
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 2, idle_timeout);
+    HttpPool::instance().configure(size, Nan::To<bool>(iArgs[1]).FromJust(), idle_timeout);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
 }
 
-MY_NODE_MODULE_CALLBACK(getPrinters)
+MY_NODE_MODULE_CALLBACK(getConnectionPoolStats)
 {
     MY_NODE_MODULE_HANDLESCOPE;
+    HttpPool::Stats stats = HttpPool::instance().getStats();
+    v8::Local<v8::Object> result = V8_VALUE_NEW_DEFAULT(Object);
+    Nan::Set(result, V8_STRING_NEW_UTF8("active"), V8_VALUE_NEW(Number, static_cast<double>(stats.active)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("idle"), V8_VALUE_NEW(Number, static_cast<double>(stats.idle)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("created"), V8_VALUE_NEW(Number, static_cast<double>(stats.created)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("reused"), V8_VALUE_NEW(Number, static_cast<double>(stats.reused)));
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
 
-    cups_dest_t *printers = NULL;
-    int printers_size = cupsGetDests(&printers);
-    v8::Local<v8::Array> result = V8_VALUE_NEW(Array, printers_size);
-    cups_dest_t *printer = printers;
-    std::string error_str;
-    for(int i = 0; i < printers_size; ++i, ++printer)
+MY_NODE_MODULE_CALLBACK(setSpoolOptions)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 4);
+    if(iArgs[0]->IsNull() || iArgs[0]->IsUndefined())
     {
-        v8::Local<v8::Object> result_printer = V8_VALUE_NEW_DEFAULT(Object);
-        error_str = parsePrinterInfo(printer, result_printer);
-        if(!error_str.empty())
-        {
-            // got an error? break then
-            break;
-        }
-        Nan::Set(result, i, result_printer);
+        SpoolJournal::instance().close();
+        MY_NODE_MODULE_RETURN_UNDEFINED();
+    }
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, path);
+    if(!iArgs[1]->IsNumber() || Nan::To<double>(iArgs[1]).FromJust() < 65536)
+    {
+        RETURN_EXCEPTION_STR("maxSize must be a number of bytes, at least 65536");
+    }
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 2, retry_interval);
+    if(retry_interval <= 0)
+    {
+        RETURN_EXCEPTION_STR("retryInterval must be positive");
     }
-    cupsFreeDests(printers_size, printers);
+    std::string error_str = SpoolJournal::instance().open(*path, static_cast<uint64_t>(Nan::To<double>(iArgs[1]).FromJust()),
+                                                          retry_interval, Nan::To<bool>(iArgs[3]).FromJust());
     if(!error_str.empty())
     {
-        // got an error? return the error then
         RETURN_EXCEPTION_STR(error_str.c_str());
     }
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(getSpoolStats)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    SpoolJournal::Stats stats = SpoolJournal::instance().getStats();
+    v8::Local<v8::Object> result = V8_VALUE_NEW_DEFAULT(Object);
+    if(stats.path.empty())
+    {
+        Nan::Set(result, V8_STRING_NEW_UTF8("path"), Nan::Null());
+    }
+    else
+    {
+        Nan::Set(result, V8_STRING_NEW_UTF8("path"), V8_STRING_NEW_UTF8(stats.path.c_str()));
+    }
+    Nan::Set(result, V8_STRING_NEW_UTF8("pending"), V8_VALUE_NEW(Number, static_cast<double>(stats.pending)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("pendingBytes"), V8_VALUE_NEW(Number, static_cast<double>(stats.pending_bytes)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("appended"), V8_VALUE_NEW(Number, static_cast<double>(stats.appended)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("submitted"), V8_VALUE_NEW(Number, static_cast<double>(stats.submitted)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("rejected"), V8_VALUE_NEW(Number, static_cast<double>(stats.rejected)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("retries"), V8_VALUE_NEW(Number, static_cast<double>(stats.retries)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("compactions"), V8_VALUE_NEW(Number, static_cast<double>(stats.compactions)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("fileSize"), V8_VALUE_NEW(Number, static_cast<double>(stats.file_size)));
+    Nan::Set(result, V8_STRING_NEW_UTF8("lastError"), V8_STRING_NEW_UTF8(stats.last_error.c_str()));
     MY_NODE_MODULE_RETURN_VALUE(result);
 }
 
@@ -326,21 +5323,72 @@ MY_NODE_MODULE_CALLBACK(getPrinter)
     MY_NODE_MODULE_HANDLESCOPE;
     REQUIRE_ARGUMENTS(iArgs, 1);
     REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
+    JobsMode jobs_mode;
+    if(!getJobsMode(iArgs[1], jobs_mode))
+    {
+        RETURN_EXCEPTION_STR("jobs must be one of none, lazy, eager");
+    }
+    RequestedAttributes attributes;
+    if(!attributes.parse(iArgs[2]))
+    {
+        RETURN_EXCEPTION_STR("attributes must be an array of strings");
+    }
+    std::string server;
+    if(!getServer(iArgs[3], server))
+    {
+        RETURN_EXCEPTION_STR("server must be a string");
+    }
 
-    cups_dest_t *printers = NULL, *printer = NULL;
-    int printers_size = cupsGetDests(&printers);
-    printer = cupsGetDest(*printername, NULL, printers_size, printers);
-    v8::Local<v8::Object> result_printer = V8_VALUE_NEW_DEFAULT(Object);
-    if(printer != NULL)
+    RecordKeys &keys = RecordKeys::get();
+    v8::Local<v8::Object> result_printer = keys.newPrinter();
+    const char *printer_name = NULL;
+    CupsDestsPtr dests;
+    IppPrinterListType ipp_printers;
+    if(!attributes.empty())
     {
-        parsePrinterInfo(printer, result_printer);
+        std::string error_str = getPrintersAttributes(*printername, attributes, server, ipp_printers);
+        if(!error_str.empty())
+        {
+            RETURN_EXCEPTION_STR(error_str.c_str());
+        }
+        if(!ipp_printers.empty())
+        {
+            parseIppPrinterInfo(keys, ipp_printers.front(), result_printer);
+            printer_name = ipp_printers.front().name.c_str();
+        }
     }
-    cupsFreeDests(printers_size, printers);
-    if(printer == NULL)
+    else
+    {
+        // the destinations of other servers are not cached
+        dests = server.empty() ? DestCache::instance().get() : CupsDestsPtr(new CupsDests(server));
+        if(!server.empty() && !dests->getError().empty())
+        {
+            RETURN_EXCEPTION_STR(dests->getError().c_str());
+        }
+        cups_dest_t *printer = dests->find(*printername);
+        if(printer != NULL)
+        {
+            parsePrinterInfo(keys, printer, result_printer);
+            printer_name = printer->name;
+        }
+    }
+    if(printer_name == NULL)
     {
         // printer not found
         RETURN_EXCEPTION_STR("Printer not found");
     }
+    CupsJobsPtr jobs;
+    JobListType printer_jobs;
+    if(jobs_mode != JOBS_NONE)
+    {
+        jobs.reset(new CupsJobs(printer_name, CUPS_WHICHJOBS_ACTIVE, server));
+        jobs->getList(printer_jobs);
+    }
+    setPrinterJobs(keys, result_printer, jobs_mode, jobs, printer_jobs);
+    if(!server.empty())
+    {
+        Nan::Set(result_printer, keys.key(RecordKeys::SERVER), V8_STRING_NEW_UTF8(server.c_str()));
+    }
     MY_NODE_MODULE_RETURN_VALUE(result_printer);
 }
 
@@ -350,15 +5398,13 @@ MY_NODE_MODULE_CALLBACK(getPrinterDriverOptions)
     REQUIRE_ARGUMENTS(iArgs, 1);
     REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
 
-    cups_dest_t *printers = NULL, *printer = NULL;
-    int printers_size = cupsGetDests(&printers);
-    printer = cupsGetDest(*printername, NULL, printers_size, printers);
+    CupsDestsPtr dests = DestCache::instance().get();
+    cups_dest_t *printer = dests->find(*printername);
     v8::Local<v8::Object> driver_options = V8_VALUE_NEW_DEFAULT(Object);
     if(printer != NULL)
     {
-        parseDriverOptions(printer, driver_options);
+        parseDriverOptions(*dests, printer, driver_options);
     }
-    cupsFreeDests(printers_size, printers);
     if(printer == NULL)
     {
         // printer not found
@@ -373,36 +5419,107 @@ MY_NODE_MODULE_CALLBACK(getJob)
     REQUIRE_ARGUMENTS(iArgs, 2);
     REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
     REQUIRE_ARGUMENT_INTEGER(iArgs, 1, jobId);
+    RequestedAttributes attributes;
+    if(!attributes.parse(iArgs[2]))
+    {
+        RETURN_EXCEPTION_STR("attributes must be an array of strings");
+    }
+    std::string server;
+    if(!getServer(iArgs[3], server))
+    {
+        RETURN_EXCEPTION_STR("server must be a string");
+    }
 
-    v8::Local<v8::Object> result_printer_job = V8_VALUE_NEW_DEFAULT(Object);
-    // Get printer jobs
-    cups_job_t *jobs = NULL, *jobFound = NULL;
-    int totalJobs = cupsGetJobs(&jobs, *printername, 0 /*0 means all users*/, CUPS_WHICHJOBS_ALL);
-    if(totalJobs > 0)
+    // Get-Job-Attributes of this job only
+    std::vector<int> job_ids(1, jobId);
+    IppJobListType jobs;
+    std::string error_str = getJobsById(*printername, job_ids, attributes, server, jobs);
+    if(!error_str.empty())
     {
-        int jobi =0;
-        cups_job_t * job = jobs;
-        for(; jobi < totalJobs; ++jobi, ++job)
-        {
-            if(job->id != jobId)
-            {
-                continue;
-            }
-            // Job Found
-            jobFound = job;
-            parseJobObject(job, result_printer_job);
-            break;
-        }
+        RETURN_EXCEPTION_STR(error_str.c_str());
     }
-    cupsFreeJobs(totalJobs, jobs);
-    if(jobFound == NULL)
+    if(jobs.empty())
     {
         // printer not found
         RETURN_EXCEPTION_STR("Printer job not found");
     }
+    RecordKeys &keys = RecordKeys::get();
+    if(attributes.empty())
+    {
+        v8::Local<v8::Object> result_printer_job = keys.newJob();
+        parseJobObject(keys, jobs.front().get(), result_printer_job);
+        MY_NODE_MODULE_RETURN_VALUE(result_printer_job);
+    }
+    // only the requested properties, other attributes by their IPP name
+    v8::Local<v8::Object> result_printer_job = V8_VALUE_NEW_DEFAULT(Object);
+    parseJobObject(keys, jobs.front().get(), result_printer_job, attributes.getJobFields());
+    const AttributeListType &others = jobs.front().getOthers();
+    for(AttributeListType::const_iterator itAttribute = others.begin(); itAttribute != others.end(); ++itAttribute)
+    {
+        Nan::Set(result_printer_job, keys.intern(itAttribute->first.c_str()), V8_STRING_NEW_UTF8(itAttribute->second.c_str()));
+    }
     MY_NODE_MODULE_RETURN_VALUE(result_printer_job);
 }
 
+MY_NODE_MODULE_CALLBACK(getJobs)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 2);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
+    if(!iArgs[1]->IsArray())
+    {
+        RETURN_EXCEPTION_STR("Argument 1 must be an array of job ids");
+    }
+    v8::Local<v8::Array> ids = v8::Local<v8::Array>::Cast(iArgs[1]);
+    std::vector<int> job_ids;
+    for(uint32_t i = 0; i < ids->Length(); ++i)
+    {
+        v8::Local<v8::Value> id = Nan::Get(ids, i).ToLocalChecked();
+        if(!id->IsInt32())
+        {
+            RETURN_EXCEPTION_STR("Job ids must be integers");
+        }
+        job_ids.push_back(Nan::To<int32_t>(id).FromJust());
+    }
+    std::string server;
+    if(!getServer(iArgs[2], server))
+    {
+        RETURN_EXCEPTION_STR("server must be a string");
+    }
+
+    IppJobListType jobs;
+    std::string error_str;
+    if(!job_ids.empty())
+    {
+        error_str = getJobsById(*printername, job_ids, RequestedAttributes(), server, jobs);
+    }
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+    std::map<int, IppJob*> jobs_by_id;
+    for(IppJobListType::iterator itJob = jobs.begin(); itJob != jobs.end(); ++itJob)
+    {
+        jobs_by_id[itJob->getId()] = &(*itJob);
+    }
+    // same order as the requested ids, null for unknown jobs
+    RecordKeys &keys = RecordKeys::get();
+    v8::Local<v8::Array> result = V8_VALUE_NEW(Array, static_cast<int>(job_ids.size()));
+    for(size_t i = 0; i < job_ids.size(); ++i)
+    {
+        std::map<int, IppJob*>::iterator itJob = jobs_by_id.find(job_ids[i]);
+        if(itJob == jobs_by_id.end())
+        {
+            Nan::Set(result, static_cast<uint32_t>(i), Nan::Null());
+            continue;
+        }
+        v8::Local<v8::Object> result_printer_job = keys.newJob();
+        parseJobObject(keys, itJob->second->get(), result_printer_job);
+        Nan::Set(result, static_cast<uint32_t>(i), result_printer_job);
+    }
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
+
 MY_NODE_MODULE_CALLBACK(setJob)
 {
     MY_NODE_MODULE_HANDLESCOPE;
@@ -418,7 +5535,8 @@ MY_NODE_MODULE_CALLBACK(setJob)
     bool result_ok = false;
     if(jobCommandStr == "CANCEL")
     {
-        result_ok = (cupsCancelJob(*printername, jobId) == 1);
+        HttpLease http;
+        result_ok = (cancelJob(http.get(), *printername, jobId) <= IPP_STATUS_OK_CONFLICTING);
     }
     else
     {
@@ -448,6 +5566,14 @@ MY_NODE_MODULE_CALLBACK(getSupportedPrintFormats)
     MY_NODE_MODULE_RETURN_VALUE(result);
 }
 
+MY_NODE_MODULE_CALLBACK(createPrintProfile)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 1);
+    REQUIRE_ARGUMENT_OBJECT(iArgs, 0, print_options);
+    MY_NODE_MODULE_RETURN_VALUE(PrintProfile::NewInstance(print_options));
+}
+
 MY_NODE_MODULE_CALLBACK(PrintDirect)
 {
     MY_NODE_MODULE_HANDLESCOPE;
@@ -459,7 +5585,7 @@ MY_NODE_MODULE_CALLBACK(PrintDirect)
         RETURN_EXCEPTION_STR("Argument 0 missing");
     }
 
-    std::string data;
+    PrintData data;
     v8::Local<v8::Value> arg0(iArgs[0]);
     if (!getStringOrBufferFromV8Value(arg0, data))
     {
@@ -479,27 +5605,188 @@ MY_NODE_MODULE_CALLBACK(PrintDirect)
     }
     type_str = itFormat->second;
 
+    Compression compression;
+    std::string error_str = getCompression(iArgs[5], iArgs[6], compression);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
     CupsOptions options(print_options);
 
-    int job_id = cupsCreateJob(CUPS_HTTP_DEFAULT, *printername, *docname, options.getNumOptions(), options.get());
+    int job_id = printDirectData(*printername, *docname, type_str.c_str(), options, data.data(), data.size(), compression, error_str);
     if(job_id == 0) {
-        RETURN_EXCEPTION_STR(cupsLastErrorString());
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
+    MY_NODE_MODULE_RETURN_VALUE(V8_VALUE_NEW(Number, job_id));
+}
+
+MY_NODE_MODULE_CALLBACK(PrintDirectAsync)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 6);
+    REQUIRE_ARGUMENT_STRING(iArgs, 1, printername);
+    REQUIRE_ARGUMENT_STRING(iArgs, 2, docname);
+    REQUIRE_ARGUMENT_STRING(iArgs, 3, type);
+    REQUIRE_ARGUMENT_OBJECT(iArgs, 4, print_options);
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 5, callback);
+
+    std::string type_str(*type);
+    FormatMapType::const_iterator itFormat = getPrinterFormatMap().find(type_str);
+    if(itFormat == getPrinterFormatMap().end())
+    {
+        RETURN_EXCEPTION_STR("unsupported format type");
+    }
+    Compression compression;
+    std::string error_str = getCompression(iArgs[6], iArgs[7], compression);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
+    PrintDirectWorker *worker = new PrintDirectWorker(new Nan::Callback(callback), *printername, *docname, itFormat->second, print_options, compression);
+    if (!getStringOrBufferFromV8Value(iArgs[0], worker->getData()))
+    {
+        delete worker;
+        RETURN_EXCEPTION_STR("Argument 0 must be a string or Buffer");
     }
+    // the data is referenced in place: keep it alive until the job is sent
+    worker->SaveToPersistent("data", iArgs[0]);
+    Nan::AsyncQueueWorker(worker);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(PrintSocket)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 5);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, uri);
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 2, timeout);
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 3, idle_timeout);
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 4, callback);
 
-    if(HTTP_CONTINUE != cupsStartDocument(CUPS_HTTP_DEFAULT, *printername, job_id, *docname, type_str.c_str(), 1 /*last document*/)) {
-        RETURN_EXCEPTION_STR(cupsLastErrorString());
+    std::string host;
+    int port = 0;
+    if(!parseSocketUri(*uri, host, port))
+    {
+        RETURN_EXCEPTION_STR("printer must be socket://host[:port]");
+    }
+    if(timeout <= 0 || idle_timeout < 0)
+    {
+        RETURN_EXCEPTION_STR("timeout must be positive");
     }
 
-    /* cupsWriteRequestData can be called as many times as needed */
-    //TODO: to split big buffer
-    if (HTTP_CONTINUE != cupsWriteRequestData(CUPS_HTTP_DEFAULT, data.c_str(), data.size())) {
-        cupsFinishDocument(CUPS_HTTP_DEFAULT, *printername);
-        RETURN_EXCEPTION_STR(cupsLastErrorString());
+    static std::atomic<int> last_job_id(0);
+    SocketPrintRequest *request = new SocketPrintRequest(callback, ++last_job_id);
+    if(!getStringOrBufferFromV8Value(iArgs[1], request->getData()))
+    {
+        delete request;
+        RETURN_EXCEPTION_STR("Argument 1 must be a string or Buffer");
     }
+    request->send(host, port, timeout, idle_timeout);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
 
-    cupsFinishDocument(CUPS_HTTP_DEFAULT, *printername);
+MY_NODE_MODULE_CALLBACK(PrintSpool)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 6);
+    REQUIRE_ARGUMENT_STRING(iArgs, 1, printername);
+    REQUIRE_ARGUMENT_STRING(iArgs, 2, docname);
+    REQUIRE_ARGUMENT_STRING(iArgs, 3, type);
+    REQUIRE_ARGUMENT_OBJECT(iArgs, 4, print_options);
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 5, callback);
 
-    MY_NODE_MODULE_RETURN_VALUE(V8_VALUE_NEW(Number, job_id));
+    std::string type_str(*type);
+    FormatMapType::const_iterator itFormat = getPrinterFormatMap().find(type_str);
+    if(itFormat == getPrinterFormatMap().end())
+    {
+        RETURN_EXCEPTION_STR("unsupported format type");
+    }
+    Compression compression;
+    std::string error_str = getCompression(iArgs[6], iArgs[7], compression);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
+    SpoolWorker *worker = new SpoolWorker(new Nan::Callback(callback), *printername, *docname, itFormat->second, print_options, compression);
+    if (!getStringOrBufferFromV8Value(iArgs[0], worker->getData()))
+    {
+        delete worker;
+        RETURN_EXCEPTION_STR("Argument 0 must be a string or Buffer");
+    }
+    // referenced in place until it is copied into the journal
+    worker->SaveToPersistent("data", iArgs[0]);
+    Nan::AsyncQueueWorker(worker);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(PrintBatch)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 5);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
+    REQUIRE_ARGUMENT_STRING(iArgs, 1, jobname);
+    REQUIRE_ARGUMENT_OBJECT(iArgs, 2, print_options);
+    if(!iArgs[3]->IsArray())
+    {
+        RETURN_EXCEPTION_STR("Argument 3 must be an array of documents");
+    }
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 4, callback);
+
+    v8::Local<v8::Array> documents_v8 = v8::Local<v8::Array>::Cast(iArgs[3]);
+    if(documents_v8->Length() == 0)
+    {
+        RETURN_EXCEPTION_STR("At least one document is required");
+    }
+    Compression compression;
+    std::string error_str = getCompression(iArgs[5], iArgs[6], compression);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
+    PrintBatchWorker *worker = new PrintBatchWorker(new Nan::Callback(callback), *printername, *jobname, print_options, documents_v8->Length(),
+                                                    compression);
+    PrintDocumentListType &documents = worker->getDocuments();
+    for(uint32_t i = 0; i < documents_v8->Length(); ++i)
+    {
+        v8::Local<v8::Value> document_v8 = Nan::Get(documents_v8, i).ToLocalChecked();
+        if(!document_v8->IsObject())
+        {
+            delete worker;
+            RETURN_EXCEPTION_STR("Each document must be an object");
+        }
+        v8::Local<v8::Object> document_obj = document_v8.As<v8::Object>();
+        v8::Local<v8::Value> data = Nan::Get(document_obj, V8_STRING_NEW_UTF8("data")).ToLocalChecked();
+        v8::Local<v8::Value> type = Nan::Get(document_obj, V8_STRING_NEW_UTF8("type")).ToLocalChecked();
+        v8::Local<v8::Value> docname = Nan::Get(document_obj, V8_STRING_NEW_UTF8("docname")).ToLocalChecked();
+
+        std::string type_str("RAW");
+        if(type->IsString())
+        {
+            type_str = *Nan::Utf8String(type);
+        }
+        FormatMapType::const_iterator itFormat = getPrinterFormatMap().find(type_str);
+        if(itFormat == getPrinterFormatMap().end())
+        {
+            delete worker;
+            RETURN_EXCEPTION_STR("unsupported format type");
+        }
+        documents[i].format = itFormat->second;
+        documents[i].docname = docname->IsString() ? *Nan::Utf8String(docname) : *jobname;
+        if(!getStringOrBufferFromV8Value(data, documents[i].data))
+        {
+            delete worker;
+            RETURN_EXCEPTION_STR("Document data must be a string or Buffer");
+        }
+        // the data is referenced in place: keep it alive until the job is sent
+        worker->SaveToPersistent(i, data);
+    }
+    Nan::AsyncQueueWorker(worker);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
 }
 
 MY_NODE_MODULE_CALLBACK(PrintFile)
@@ -520,7 +5807,13 @@ MY_NODE_MODULE_CALLBACK(PrintFile)
 
     CupsOptions options(print_options);
 
-    int job_id = cupsPrintFile(*printer, *filename, *docname, options.getNumOptions(), options.get());
+    HttpLease http;
+    int job_id;
+    {
+        StatsTimer timer(STATS_METRIC("cupsPrintFile"));
+        job_id = cupsPrintFile2(http.get(), *printer, *filename, *docname, options.getNumOptions(), options.get());
+        timer.setError(job_id == 0);
+    }
 
     if(job_id == 0){
         MY_NODE_MODULE_RETURN_VALUE(V8_STRING_NEW_UTF8(cupsLastErrorString()));
@@ -528,3 +5821,102 @@ MY_NODE_MODULE_CALLBACK(PrintFile)
         MY_NODE_MODULE_RETURN_VALUE(V8_VALUE_NEW(Number, job_id));
     }
 }
+
+MY_NODE_MODULE_CALLBACK(PrintFileAsync)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 7);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, filename);
+    REQUIRE_ARGUMENT_STRING(iArgs, 1, docname);
+    REQUIRE_ARGUMENT_STRING(iArgs, 2, printername);
+    REQUIRE_ARGUMENT_STRING(iArgs, 3, type);
+    REQUIRE_ARGUMENT_OBJECT(iArgs, 4, print_options);
+    if(!iArgs[5]->IsFunction() && !iArgs[5]->IsNull() && !iArgs[5]->IsUndefined())
+    {
+        RETURN_EXCEPTION_STR("Argument 5 must be a progress function or null");
+    }
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 6, callback);
+
+    // the server detects the format of the file by default
+    std::string format(CUPS_FORMAT_AUTO);
+    if(**type != '\0')
+    {
+        FormatMapType::const_iterator itFormat = getPrinterFormatMap().find(*type);
+        if(itFormat == getPrinterFormatMap().end())
+        {
+            RETURN_EXCEPTION_STR("unsupported format type");
+        }
+        format = itFormat->second;
+    }
+    Compression compression;
+    std::string error_str = getCompression(iArgs[7], iArgs[8], compression);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
+    Nan::Callback *progress = iArgs[5]->IsFunction() ? new Nan::Callback(iArgs[5].As<v8::Function>()) : NULL;
+    CancelFlagPtr cancelled(new std::atomic<bool>(false));
+    PrintFileWorker *worker = new PrintFileWorker(new Nan::Callback(callback), progress, *filename, *docname, *printername,
+                                                  format, print_options, compression, cancelled);
+    Nan::AsyncQueueWorker(worker);
+    MY_NODE_MODULE_RETURN_VALUE(PrintFileJob::NewInstance(cancelled));
+}
+
+MY_NODE_MODULE_CALLBACK(PrintStreamStart)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 5);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
+    REQUIRE_ARGUMENT_STRING(iArgs, 1, docname);
+    REQUIRE_ARGUMENT_STRING(iArgs, 2, type);
+    REQUIRE_ARGUMENT_OBJECT(iArgs, 3, print_options);
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 4, callback);
+
+    std::string type_str(*type);
+    FormatMapType::const_iterator itFormat = getPrinterFormatMap().find(type_str);
+    if(itFormat == getPrinterFormatMap().end())
+    {
+        RETURN_EXCEPTION_STR("unsupported format type");
+    }
+    Compression compression;
+    std::string error_str = getCompression(iArgs[5], iArgs[6], compression);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+
+    PrintStreamWorker *worker = new PrintStreamWorker(new Nan::Callback(callback), PrintStreamWorker::OPEN, new StreamJob(compression), NULL);
+    worker->setOpenData(*printername, *docname, itFormat->second, print_options);
+    Nan::AsyncQueueWorker(worker);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(watchNotifications)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 5);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, printername);
+    if(!iArgs[1]->IsArray())
+    {
+        RETURN_EXCEPTION_STR("Argument 1 must be an array of event names");
+    }
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 2, lease_duration);
+    REQUIRE_ARGUMENT_INTEGER(iArgs, 3, interval);
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 4, callback);
+    int job_id = (iArgs.Length() > 5 && iArgs[5]->IsNumber()) ? Nan::To<int32_t>(iArgs[5]).FromJust() : 0;
+
+    v8::Local<v8::Array> events_v8 = v8::Local<v8::Array>::Cast(iArgs[1]);
+    std::vector<std::string> events;
+    for(uint32_t i = 0; i < events_v8->Length(); ++i)
+    {
+        Nan::Utf8String event(Nan::Get(events_v8, i).ToLocalChecked());
+        events.push_back(*event);
+    }
+    if(events.empty())
+    {
+        RETURN_EXCEPTION_STR("At least one event is required");
+    }
+
+    MY_NODE_MODULE_RETURN_VALUE(NotificationWatcher::NewInstance(*printername, job_id, events, lease_duration, interval, callback));
+}
@@ -0,0 +1,111 @@
+#include "node_printer.hpp"
+#include "node_printer_stats.hpp"
+
+#include <mutex>
+
+namespace
+{
+    std::mutex& getRegistryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::vector<StatsMetric*>& getRegistry()
+    {
+        static std::vector<StatsMetric*> registry;
+        return registry;
+    }
+}
+
+const uint64_t StatsMetric::kBucketBounds[StatsMetric::kBucketsCount - 1] = {
+    50, 100, 250, 500,
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000
+};
+
+StatsMetric::StatsMetric(const char *iName): name(iName), calls(0), errors(0), bytes(0), latency_sum_ns(0)
+{
+    for(size_t i = 0; i < kBucketsCount; ++i)
+    {
+        counts[i] = 0;
+    }
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    getRegistry().push_back(this);
+}
+
+void StatsMetric::snapshot(Snapshot &oSnapshot) const
+{
+    oSnapshot.calls = calls.load(std::memory_order_relaxed);
+    oSnapshot.errors = errors.load(std::memory_order_relaxed);
+    oSnapshot.bytes = bytes.load(std::memory_order_relaxed);
+    oSnapshot.latency_sum_ns = latency_sum_ns.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < kBucketsCount; ++i)
+    {
+        oSnapshot.counts[i] = counts[i].load(std::memory_order_relaxed);
+    }
+}
+
+void StatsMetric::reset()
+{
+    calls = 0;
+    errors = 0;
+    bytes = 0;
+    latency_sum_ns = 0;
+    for(size_t i = 0; i < kBucketsCount; ++i)
+    {
+        counts[i] = 0;
+    }
+}
+
+std::vector<StatsMetric*> StatsMetric::getAll()
+{
+    std::lock_guard<std::mutex> lock(getRegistryMutex());
+    return getRegistry();
+}
+
+MY_NODE_MODULE_CALLBACK(getStats)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    v8::Local<v8::Object> result = V8_VALUE_NEW_DEFAULT(Object);
+
+    v8::Local<v8::Array> bounds = V8_VALUE_NEW(Array, static_cast<int>(StatsMetric::kBucketsCount - 1));
+    for(size_t i = 0; i < StatsMetric::kBucketsCount - 1; ++i)
+    {
+        Nan::Set(bounds, static_cast<uint32_t>(i), V8_VALUE_NEW(Number, StatsMetric::kBucketBounds[i] / 1000.0));
+    }
+    Nan::Set(result, V8_STRING_NEW_UTF8("latencyBuckets"), bounds);
+
+    v8::Local<v8::Object> result_metrics = V8_VALUE_NEW_DEFAULT(Object);
+    std::vector<StatsMetric*> metrics = StatsMetric::getAll();
+    StatsMetric::Snapshot snapshot;
+    for(std::vector<StatsMetric*>::const_iterator itMetric = metrics.begin(); itMetric != metrics.end(); ++itMetric)
+    {
+        (*itMetric)->snapshot(snapshot);
+        v8::Local<v8::Object> result_metric = V8_VALUE_NEW_DEFAULT(Object);
+        Nan::Set(result_metric, V8_STRING_NEW_UTF8("calls"), V8_VALUE_NEW(Number, static_cast<double>(snapshot.calls)));
+        Nan::Set(result_metric, V8_STRING_NEW_UTF8("errors"), V8_VALUE_NEW(Number, static_cast<double>(snapshot.errors)));
+        Nan::Set(result_metric, V8_STRING_NEW_UTF8("bytes"), V8_VALUE_NEW(Number, static_cast<double>(snapshot.bytes)));
+        Nan::Set(result_metric, V8_STRING_NEW_UTF8("latencySum"), V8_VALUE_NEW(Number, snapshot.latency_sum_ns / 1e6));
+        v8::Local<v8::Array> counts = V8_VALUE_NEW(Array, static_cast<int>(StatsMetric::kBucketsCount));
+        for(size_t i = 0; i < StatsMetric::kBucketsCount; ++i)
+        {
+            Nan::Set(counts, static_cast<uint32_t>(i), V8_VALUE_NEW(Number, static_cast<double>(snapshot.counts[i])));
+        }
+        Nan::Set(result_metric, V8_STRING_NEW_UTF8("latencyCounts"), counts);
+        Nan::Set(result_metrics, V8_STRING_NEW_UTF8((*itMetric)->getName()), result_metric);
+    }
+    Nan::Set(result, V8_STRING_NEW_UTF8("metrics"), result_metrics);
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
+
+MY_NODE_MODULE_CALLBACK(resetStats)
+{
+    Nan::HandleScope scope;
+    std::vector<StatsMetric*> metrics = StatsMetric::getAll();
+    for(std::vector<StatsMetric*>::const_iterator itMetric = metrics.begin(); itMetric != metrics.end(); ++itMetric)
+    {
+        (*itMetric)->reset();
+    }
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
@@ -0,0 +1,133 @@
+#ifndef NODE_PRINTER_STATS_HPP
+#define NODE_PRINTER_STATS_HPP
+
+#include "macros.hh"
+
+#include <nan.h>
+#include <uv.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Counters and latency histogram of an operation: native method, worker or libcups call.
+ * Updates are lock free and may come from any thread.
+ * Instances must have static storage duration, they register themselves (see STATS_METRIC).
+ */
+class StatsMetric
+{
+public:
+    /// Upper bounds in microseconds of the latency buckets, the last bucket is unbounded
+    static const size_t kBucketsCount = 18;
+    static const uint64_t kBucketBounds[kBucketsCount - 1];
+
+    struct Snapshot
+    {
+        uint64_t calls;
+        uint64_t errors;
+        uint64_t bytes;
+        uint64_t latency_sum_ns;
+        uint64_t counts[kBucketsCount];
+    };
+
+    explicit StatsMetric(const char *iName);
+
+    void record(uint64_t iNanoseconds, bool iError, uint64_t iBytes)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        if(iError)
+        {
+            errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        if(iBytes != 0)
+        {
+            bytes.fetch_add(iBytes, std::memory_order_relaxed);
+        }
+        latency_sum_ns.fetch_add(iNanoseconds, std::memory_order_relaxed);
+        uint64_t us = iNanoseconds / 1000;
+        size_t bucket = 0;
+        while(bucket < kBucketsCount - 1 && us > kBucketBounds[bucket])
+        {
+            ++bucket;
+        }
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Count bytes without a call, for a metric giving another size of the calls of a metric
+    void addBytes(uint64_t iBytes)
+    {
+        bytes.fetch_add(iBytes, std::memory_order_relaxed);
+    }
+
+    const char* getName() const { return name; }
+    void snapshot(Snapshot &oSnapshot) const;
+    void reset();
+
+    /// All metrics, in registration order
+    static std::vector<StatsMetric*> getAll();
+
+private:
+    StatsMetric(const StatsMetric&);
+    StatsMetric& operator=(const StatsMetric&);
+
+    const char *name;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> latency_sum_ns;
+    std::atomic<uint64_t> counts[kBucketsCount];
+};
+
+/// Static metric defined in place, e.g. StatsTimer timer(STATS_METRIC("cupsGetDests"));
+#define STATS_METRIC(name) ([]() -> StatsMetric& { static StatsMetric metric(name); return metric; }())
+
+/// Record the duration of the enclosing scope into a metric
+class StatsTimer
+{
+public:
+    explicit StatsTimer(StatsMetric &iMetric): metric(iMetric), start(uv_hrtime()), error(false), bytes(0) {}
+    ~StatsTimer() { metric.record(uv_hrtime() - start, error, bytes); }
+
+    void setError(bool iError = true) { error = iError; }
+    void addBytes(uint64_t iBytes) { bytes += iBytes; }
+private:
+    StatsTimer(const StatsTimer&);
+    StatsTimer& operator=(const StatsTimer&);
+
+    StatsMetric &metric;
+    uint64_t start;
+    bool error;
+    uint64_t bytes;
+};
+
+typedef void (*NativeMethodType)(const Nan::FunctionCallbackInfo<v8::Value>&);
+
+/// Metric of a native method, named on its first use (registration)
+template<NativeMethodType Method>
+StatsMetric& getMethodMetric(const char *iName = NULL)
+{
+    static StatsMetric metric(iName);
+    return metric;
+}
+
+/// Native method wrapper counting calls, thrown exceptions as errors, and latency
+template<NativeMethodType Method>
+MY_NODE_MODULE_CALLBACK(instrumentedMethod)
+{
+    StatsTimer timer(getMethodMetric<Method>());
+    Nan::TryCatch try_catch;
+    Method(iArgs);
+    if(try_catch.HasCaught())
+    {
+        timer.setError();
+        try_catch.ReThrow();
+    }
+}
+
+/// Register an instrumented native method
+#define MY_MODULE_SET_INSTRUMENTED_METHOD(exports, name, method) \
+    getMethodMetric<method>(name);                                \
+    MY_MODULE_SET_METHOD(exports, name, instrumentedMethod<method>)
+
+#endif
@@ -0,0 +1,461 @@
+#include "node_printer.hpp"
+#include "node_printer_stats.hpp"
+#include "node_printer_isolate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    /// Escaping of field values, by printer language
+    enum TemplateLanguage {
+        LANGUAGE_RAW,   // values are inserted as is
+        LANGUAGE_ZPL,   // ^ ~ _ as field hex escapes (_5E _7E _5F), the field needs ^FH
+        LANGUAGE_EPL    // " and \ escaped with \, line breaks replaced by spaces
+    };
+
+    bool getTemplateLanguage(const std::string &iName, TemplateLanguage &oLanguage)
+    {
+        if(iName.empty() || iName == "raw")
+        {
+            oLanguage = LANGUAGE_RAW;
+        }
+        else if(iName == "zpl")
+        {
+            oLanguage = LANGUAGE_ZPL;
+        }
+        else if(iName == "epl")
+        {
+            oLanguage = LANGUAGE_EPL;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    /// Error of a render stopped by a JS exception (throwing getter, Symbol value...), which is left pending
+    const char kPendingException[] = "JS exception";
+
+    /// Growing malloc'ed output, handed over to a Buffer without copy
+    class OutputBuffer {
+    public:
+        explicit OutputBuffer(size_t iCapacity): data(static_cast<char*>(malloc(iCapacity > 0 ? iCapacity : 1))),
+            size(0), capacity(iCapacity > 0 ? iCapacity : 1) {}
+        ~OutputBuffer() { free(data); }
+
+        /// @return space for iSize more bytes at the end, NULL if out of memory
+        char* reserve(size_t iSize)
+        {
+            if(size + iSize > capacity)
+            {
+                size_t new_capacity = std::max(capacity * 2, size + iSize);
+                char *new_data = static_cast<char*>(realloc(data, new_capacity));
+                if(new_data == NULL)
+                {
+                    return NULL;
+                }
+                data = new_data;
+                capacity = new_capacity;
+            }
+            return data + size;
+        }
+
+        bool append(const char *iData, size_t iSize)
+        {
+            char *end = reserve(iSize);
+            if(end == NULL)
+            {
+                return false;
+            }
+            memcpy(end, iData, iSize);
+            size += iSize;
+            return true;
+        }
+
+        void commit(size_t iSize) { size += iSize; }
+
+        char* getData() { return data; }
+        size_t getSize() const { return size; }
+
+        /// Give up the memory, to be freed with free()
+        char* release()
+        {
+            char *result = data;
+            data = NULL;
+            size = capacity = 0;
+            return result;
+        }
+    private:
+        OutputBuffer(const OutputBuffer&);
+        OutputBuffer& operator=(const OutputBuffer&);
+
+        char *data;
+        size_t size;
+        size_t capacity;
+    };
+
+    /** Label template compiled once: literal parts and {{field}} placeholders.
+     * Rendering appends literals and field values to one buffer, field values are
+     * transcoded in place and escaped for the printer language.
+     */
+    class LabelTemplate: public Nan::ObjectWrap {
+    public:
+        /// @return error string, empty on success
+        static std::string NewInstance(const std::string &iSource, TemplateLanguage iLanguage, v8::Local<v8::Object> &oResult)
+        {
+            LabelTemplate *wrapper = new LabelTemplate(iSource, iLanguage);
+            std::string error_str = wrapper->parse();
+            if(!error_str.empty())
+            {
+                delete wrapper;
+                return error_str;
+            }
+            oResult = Nan::NewInstance(Nan::GetFunction(getFunctionTemplate()).ToLocalChecked()).ToLocalChecked();
+            wrapper->Wrap(oResult);
+
+            MY_NODE_MODULE_ISOLATE_DECL
+            v8::Local<v8::Array> fields = V8_VALUE_NEW(Array, static_cast<int>(wrapper->field_names.size()));
+            for(size_t i = 0; i < wrapper->field_names.size(); ++i)
+            {
+                v8::Local<v8::String> name = V8_STRING_NEW_INTERNALIZED(wrapper->field_names[i].c_str());
+                wrapper->field_keys[i].Reset(name);
+                Nan::Set(fields, static_cast<uint32_t>(i), name);
+            }
+            Nan::DefineOwnProperty(oResult, V8_STRING_NEW_UTF8("fields"), fields, v8::ReadOnly);
+            return "";
+        }
+
+        /// @return the template of a handle returned by compileTemplate, NULL for any other value
+        static LabelTemplate* Unwrap(v8::Local<v8::Value> iValue)
+        {
+            if(!iValue->IsObject() || !getFunctionTemplate()->HasInstance(iValue))
+            {
+                return NULL;
+            }
+            return Nan::ObjectWrap::Unwrap<LabelTemplate>(Nan::To<v8::Object>(iValue).ToLocalChecked());
+        }
+
+        /** Render the records one after the other
+         * @return error string, empty on success, kPendingException if JS threw
+         */
+        std::string render(v8::Local<v8::Array> iRecords, OutputBuffer &ioOutput)
+        {
+            std::vector<v8::Local<v8::String> > keys(field_names.size());
+            for(size_t i = 0; i < field_names.size(); ++i)
+            {
+                keys[i] = Nan::New(field_keys[i]);
+            }
+            for(uint32_t r = 0; r < iRecords->Length(); ++r)
+            {
+                v8::Local<v8::Value> record_value;
+                if(!Nan::Get(iRecords, r).ToLocal(&record_value))
+                {
+                    return kPendingException;
+                }
+                if(!record_value->IsObject())
+                {
+                    return "records must be objects";
+                }
+                v8::Local<v8::Object> record = record_value.As<v8::Object>();
+                for(std::vector<Segment>::const_iterator itSegment = segments.begin(); itSegment != segments.end(); ++itSegment)
+                {
+                    if(itSegment->size > 0 && !ioOutput.append(source.data() + itSegment->offset, itSegment->size))
+                    {
+                        return "Out of memory";
+                    }
+                    if(itSegment->field < 0)
+                    {
+                        continue;
+                    }
+                    v8::Local<v8::Value> value;
+                    if(!Nan::Get(record, keys[itSegment->field]).ToLocal(&value))
+                    {
+                        return kPendingException;
+                    }
+                    std::string error_str = appendValue(value, ioOutput);
+                    if(!error_str.empty())
+                    {
+                        return error_str;
+                    }
+                }
+            }
+            return "";
+        }
+
+        /// Expected output size of iRecords records, from the previous renderings
+        size_t estimateSize(uint32_t iRecords) const
+        {
+            size_t per_record = (record_size > 0) ? record_size : literals_size + 16 * field_names.size();
+            return per_record * iRecords;
+        }
+
+        void setRecordSize(size_t iSize) { record_size = iSize; }
+
+    private:
+        /// Literal part source[offset, offset + size) followed by a field, -1 for none
+        struct Segment
+        {
+            size_t offset;
+            size_t size;
+            int field;
+        };
+
+        static v8::Local<v8::FunctionTemplate> getFunctionTemplate()
+        {
+            static PerIsolate<IsolateFunctionTemplate> function_template;
+            IsolateFunctionTemplate &constructor = function_template.get();
+            if(constructor.isEmpty())
+            {
+                v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+                tpl->SetClassName(Nan::New("LabelTemplate").ToLocalChecked());
+                tpl->InstanceTemplate()->SetInternalFieldCount(1);
+                constructor.reset(tpl);
+            }
+            return constructor.get();
+        }
+
+        LabelTemplate(const std::string &iSource, TemplateLanguage iLanguage):
+            source(iSource), language(iLanguage), literals_size(0), record_size(0) {}
+
+        ~LabelTemplate()
+        {
+            for(size_t i = 0; i < field_names.size(); ++i)
+            {
+                field_keys[i].Reset();
+            }
+        }
+
+        /// Split the source on {{name}} placeholders, a field used twice is read twice
+        std::string parse()
+        {
+            size_t offset = 0;
+            while(offset <= source.size())
+            {
+                size_t open = source.find("{{", offset);
+                Segment segment = { offset, ((open == std::string::npos) ? source.size() : open) - offset, -1 };
+                literals_size += segment.size;
+                if(open == std::string::npos)
+                {
+                    segments.push_back(segment);
+                    break;
+                }
+                size_t close = source.find("}}", open + 2);
+                if(close == std::string::npos)
+                {
+                    return "Unclosed placeholder in template";
+                }
+                std::string name = source.substr(open + 2, close - open - 2);
+                size_t first = name.find_first_not_of(" \t");
+                size_t last = name.find_last_not_of(" \t");
+                if(first == std::string::npos)
+                {
+                    return "Empty placeholder in template";
+                }
+                name = name.substr(first, last - first + 1);
+                std::vector<std::string>::iterator itName = std::find(field_names.begin(), field_names.end(), name);
+                segment.field = static_cast<int>(itName - field_names.begin());
+                if(itName == field_names.end())
+                {
+                    field_names.push_back(name);
+                }
+                segments.push_back(segment);
+                offset = close + 2;
+            }
+            field_keys.reset(new Nan::Persistent<v8::String>[field_names.size()]);
+            return "";
+        }
+
+        /** Append a field value: strings are transcoded in place, numbers formatted on the stack
+         * @return error string, kPendingException if the conversion of the value to a string threw
+         */
+        std::string appendValue(v8::Local<v8::Value> iValue, OutputBuffer &ioOutput)
+        {
+            if(iValue->IsUndefined() || iValue->IsNull())
+            {
+                return "";
+            }
+            size_t start = ioOutput.getSize();
+            // NaN and Infinity are written by their JS names, through the string conversion below
+            if(iValue->IsNumber() && std::isfinite(Nan::To<double>(iValue).FromJust()))
+            {
+                char number[32];
+                double value = Nan::To<double>(iValue).FromJust();
+                // only integers in the range of long long are converted to it
+                bool integer = (value > -9223372036854775808.0 && value < 9223372036854775808.0
+                                && value == std::floor(value));
+                int length = integer
+                    ? snprintf(number, sizeof(number), "%lld", static_cast<long long>(value))
+                    : snprintf(number, sizeof(number), "%.15g", value);
+                if(!ioOutput.append(number, static_cast<size_t>(length)))
+                {
+                    return "Out of memory";
+                }
+            }
+            else
+            {
+                v8::Local<v8::Value> text = iValue;
+                if(!iValue->IsString())
+                {
+                    v8::Local<v8::String> converted;
+                    if(!Nan::To<v8::String>(iValue).ToLocal(&converted))
+                    {
+                        return kPendingException;
+                    }
+                    text = converted;
+                }
+                ssize_t size = Nan::DecodeBytes(text, Nan::UTF8);
+                char *end = (size > 0) ? ioOutput.reserve(static_cast<size_t>(size)) : NULL;
+                if(size > 0 && end == NULL)
+                {
+                    return "Out of memory";
+                }
+                if(size > 0)
+                {
+                    Nan::DecodeWrite(end, size, text, Nan::UTF8);
+                    ioOutput.commit(static_cast<size_t>(size));
+                }
+            }
+            return escape(ioOutput, start) ? "" : "Out of memory";
+        }
+
+        /// Escape the value at the end of ioOutput, from iStart, in place
+        bool escape(OutputBuffer &ioOutput, size_t iStart)
+        {
+            if(language == LANGUAGE_RAW)
+            {
+                return true;
+            }
+            // extra bytes of the escaped value
+            size_t extra = 0;
+            char *data = ioOutput.getData();
+            size_t size = ioOutput.getSize();
+            for(size_t i = iStart; i < size; ++i)
+            {
+                if(language == LANGUAGE_ZPL && (data[i] == '^' || data[i] == '~' || data[i] == '_'))
+                {
+                    extra += 2;
+                }
+                else if(language == LANGUAGE_EPL && (data[i] == '"' || data[i] == '\\'))
+                {
+                    extra += 1;
+                }
+                else if(language == LANGUAGE_EPL && (data[i] == '\r' || data[i] == '\n'))
+                {
+                    data[i] = ' ';
+                }
+            }
+            if(extra == 0)
+            {
+                return true;
+            }
+            if(ioOutput.reserve(extra) == NULL)
+            {
+                return false;
+            }
+            ioOutput.commit(extra);
+            // expand from the end, so that every byte is moved once
+            data = ioOutput.getData();
+            size_t to = size + extra;
+            for(size_t from = size; from > iStart; --from)
+            {
+                char c = data[from - 1];
+                if(language == LANGUAGE_ZPL && (c == '^' || c == '~' || c == '_'))
+                {
+                    static const char kHex[] = "0123456789ABCDEF";
+                    data[--to] = kHex[static_cast<unsigned char>(c) & 0x0F];
+                    data[--to] = kHex[static_cast<unsigned char>(c) >> 4];
+                    data[--to] = '_';
+                }
+                else if(language == LANGUAGE_EPL && (c == '"' || c == '\\'))
+                {
+                    data[--to] = c;
+                    data[--to] = '\\';
+                }
+                else
+                {
+                    data[--to] = c;
+                }
+            }
+            return true;
+        }
+
+        std::string source;
+        TemplateLanguage language;
+        std::vector<Segment> segments;
+        std::vector<std::string> field_names;
+        std::unique_ptr<Nan::Persistent<v8::String>[]> field_keys; // same order as field_names
+        size_t literals_size;
+        size_t record_size;
+    };
+}
+
+MY_NODE_MODULE_CALLBACK(compileTemplate)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 1);
+    REQUIRE_ARGUMENT_STRING(iArgs, 0, source);
+    TemplateLanguage language = LANGUAGE_RAW;
+    if(!iArgs[1]->IsUndefined() && !getTemplateLanguage(*Nan::Utf8String(iArgs[1]), language))
+    {
+        RETURN_EXCEPTION_STR("language must be one of raw, zpl, epl");
+    }
+    v8::Local<v8::Object> result;
+    std::string error_str = LabelTemplate::NewInstance(std::string(*source, source.length()), language, result);
+    if(!error_str.empty())
+    {
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
+
+MY_NODE_MODULE_CALLBACK(renderTemplate)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 2);
+    LabelTemplate *label_template = LabelTemplate::Unwrap(iArgs[0]);
+    if(label_template == NULL)
+    {
+        RETURN_EXCEPTION_STR("Argument 0 must be a compiled template");
+    }
+    if(!iArgs[1]->IsArray())
+    {
+        RETURN_EXCEPTION_STR("Argument 1 must be an array of records");
+    }
+    v8::Local<v8::Array> records = v8::Local<v8::Array>::Cast(iArgs[1]);
+
+    StatsTimer timer(STATS_METRIC("template:render"));
+    OutputBuffer output(label_template->estimateSize(records->Length()));
+    std::string error_str = label_template->render(records, output);
+    if(!error_str.empty())
+    {
+        timer.setError();
+        if(error_str == kPendingException)
+        {
+            // let the exception of the getter or the conversion propagate
+            return;
+        }
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+    if(records->Length() > 0)
+    {
+        label_template->setRecordSize(output.getSize() / records->Length() + 1);
+    }
+    timer.addBytes(output.getSize());
+    size_t size = output.getSize();
+    // Nan::NewBuffer takes a 32 bits length
+    if(size > std::min<size_t>(node::Buffer::kMaxLength, 0xFFFFFFFFu))
+    {
+        timer.setError();
+        RETURN_EXCEPTION_STR("Rendered data is larger than the maximum Buffer size");
+    }
+    // the Buffer takes the memory over
+    MY_NODE_MODULE_RETURN_VALUE(Nan::NewBuffer(output.release(), static_cast<uint32_t>(size)).ToLocalChecked());
+}
@@ -65,14 +65,9 @@ namespace{
         BOOL _ok;
     };
 
-    const StatusMapType& getStatusMap()
+    StatusMapType buildStatusMap()
     {
-        static StatusMapType result;
-        if(!result.empty())
-        {
-            return result;
-        }
-        // add only first time
+        StatusMapType result;
 #define STATUS_PRINTER_ADD(value, type) result.insert(std::make_pair(value, type))
         STATUS_PRINTER_ADD("BUSY", PRINTER_STATUS_BUSY);
         STATUS_PRINTER_ADD("DOOR-OPEN", PRINTER_STATUS_DOOR_OPEN);
@@ -103,14 +98,16 @@ namespace{
         return result;
     }
 
-    const StatusMapType& getJobStatusMap()
+    /// Immutable table built on first use: a local static is initialized once, even from several threads
+    const StatusMapType& getStatusMap()
     {
-        static StatusMapType result;
-        if(!result.empty())
-        {
-            return result;
-        }
-        // add only first time
+        static const StatusMapType result = buildStatusMap();
+        return result;
+    }
+
+    StatusMapType buildJobStatusMap()
+    {
+        StatusMapType result;
 #define STATUS_PRINTER_ADD(value, type) result.insert(std::make_pair(value, type))
         // Common statuses
         STATUS_PRINTER_ADD("PRINTING", JOB_STATUS_PRINTING);
@@ -139,14 +136,15 @@ namespace{
         return result;
     }
 
-    const StatusMapType& getAttributeMap()
+    const StatusMapType& getJobStatusMap()
     {
-        static StatusMapType result;
-        if(!result.empty())
-        {
-            return result;
-        }
-        // add only first time
+        static const StatusMapType result = buildJobStatusMap();
+        return result;
+    }
+
+    StatusMapType buildAttributeMap()
+    {
+        StatusMapType result;
 #define ATTRIBUTE_PRINTER_ADD(value, type) result.insert(std::make_pair(value, type))
         ATTRIBUTE_PRINTER_ADD("DIRECT", PRINTER_ATTRIBUTE_DIRECT);
         ATTRIBUTE_PRINTER_ADD("DO-COMPLETE-FIRST", PRINTER_ATTRIBUTE_DO_COMPLETE_FIRST);
@@ -179,14 +177,15 @@ namespace{
         return result;
     }
 
-    const StatusMapType& getJobCommandMap()
+    const StatusMapType& getAttributeMap()
     {
-        static StatusMapType result;
-        if(!result.empty())
-        {
-            return result;
-        }
-        // add only first time
+        static const StatusMapType result = buildAttributeMap();
+        return result;
+    }
+
+    StatusMapType buildJobCommandMap()
+    {
+        StatusMapType result;
 #define COMMAND_JOB_ADD(value, type) result.insert(std::make_pair(value, type))
         COMMAND_JOB_ADD("CANCEL", JOB_CONTROL_CANCEL);
         COMMAND_JOB_ADD("PAUSE", JOB_CONTROL_PAUSE);
@@ -205,6 +204,12 @@ namespace{
         return result;
     }
 
+    const StatusMapType& getJobCommandMap()
+    {
+        static const StatusMapType result = buildJobCommandMap();
+        return result;
+    }
+
     void parseJobObject(JOB_INFO_2W *job, v8::Local<v8::Object> result_printer_job)
     {
         MY_NODE_MODULE_ISOLATE_DECL
@@ -304,6 +309,94 @@ namespace{
     	return s.str();
     }
 
+    /** Send raw data to printer through the spooler.
+     * Does not touch v8, so it can run on a worker thread.
+     * @return job id, 0 on failure and error_str is filled
+     */
+    DWORD printDirectData(LPWSTR iPrinterName, LPWSTR iDocName, LPWSTR iType, const PrintData &iData, std::string &error_str)
+    {
+        BOOL     bStatus = true;
+        // Open a handle to the printer.
+        PrinterHandle printerHandle(iPrinterName);
+        DOC_INFO_1W DocInfo;
+        DWORD      dwJob = 0L;
+        DWORD      dwBytesWritten = 0L;
+
+        if (!printerHandle)
+        {
+            error_str = "error on PrinterHandle: ";
+            error_str += getLastErrorCodeAndMessage();
+            return 0;
+        }
+
+        // Fill in the structure with info about this "document."
+        DocInfo.pDocName = iDocName;
+        DocInfo.pOutputFile =  NULL;
+        DocInfo.pDatatype = iType;
+
+        // Inform the spooler the document is beginning.
+        dwJob = StartDocPrinterW(*printerHandle, 1, (LPBYTE)&DocInfo );
+        if (dwJob > 0) {
+            // Start a page.
+            bStatus = StartPagePrinter(*printerHandle);
+            if (bStatus) {
+                // Send the data to the printer.
+                //TODO: check with sizeof(LPTSTR) is the same as sizeof(char)
+                bStatus = WritePrinter( *printerHandle, (LPVOID)(iData.data()), (DWORD)iData.size(), &dwBytesWritten);
+                EndPagePrinter(*printerHandle);
+            }else{
+                error_str = "StartPagePrinter error: ";
+                error_str += getLastErrorCodeAndMessage();
+                return 0;
+            }
+            // Inform the spooler that the document is ending.
+            EndDocPrinter(*printerHandle);
+        }else{
+            error_str = "StartDocPrinterW error: ";
+            error_str += getLastErrorCodeAndMessage();
+            return 0;
+        }
+        // Check to see if correct number of bytes were written.
+        if (dwBytesWritten != iData.size()) {
+            error_str = "not sent all bytes";
+            return 0;
+        }
+        return dwJob;
+    }
+
+    /// printDirect worker: the spooler calls run outside of the event loop
+    class PrintDirectWorker: public Nan::AsyncWorker {
+    public:
+        PrintDirectWorker(Nan::Callback *iCallback, const wchar_t *iPrinterName,
+                          const wchar_t *iDocName, const wchar_t *iType):
+            Nan::AsyncWorker(iCallback, "printer:printDirect"),
+            printername(iPrinterName), docname(iDocName), type(iType), job_id(0) {}
+
+        /// Data to send. The v8 source value should be saved to persistent
+        PrintData& getData() { return data; }
+
+        void Execute() {
+            std::string error_str;
+            job_id = printDirectData((LPWSTR)printername.c_str(), (LPWSTR)docname.c_str(), (LPWSTR)type.c_str(), data, error_str);
+            if(job_id == 0)
+            {
+                SetErrorMessage(error_str.c_str());
+            }
+        }
+
+        void HandleOKCallback() {
+            Nan::HandleScope scope;
+            v8::Local<v8::Value> argv[] = { Nan::Null(), Nan::New<v8::Number>(job_id) };
+            callback->Call(2, argv, async_resource);
+        }
+    private:
+        PrintData data;
+        std::wstring printername;
+        std::wstring docname;
+        std::wstring type;
+        DWORD job_id;
+    };
+
     std::string retrieveAndParseJobs(const LPWSTR iPrinterName,
                                      const DWORD& iTotalJobs,
                                      v8::Local<v8::Object> result_printer_jobs,
@@ -545,6 +638,54 @@ MY_NODE_MODULE_CALLBACK(getPrinterDriverOptions)
     RETURN_EXCEPTION_STR("not supported on windows");
 }
 
+MY_NODE_MODULE_CALLBACK(getPrintersDelta)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(setDestinationCacheOptions)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(setConnectionPoolOptions)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(getConnectionPoolStats)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(setSpoolOptions)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(getSpoolStats)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(refreshDestinationCache)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(invalidateDestinationCache)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
 MY_NODE_MODULE_CALLBACK(getJob)
 {
     MY_NODE_MODULE_HANDLESCOPE;
@@ -582,6 +723,49 @@ MY_NODE_MODULE_CALLBACK(getJob)
     MY_NODE_MODULE_RETURN_VALUE(result_printer_job);
 }
 
+MY_NODE_MODULE_CALLBACK(getJobs)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 2);
+    REQUIRE_ARGUMENT_STRINGW(iArgs, 0, printername);
+    if(!iArgs[1]->IsArray())
+    {
+        RETURN_EXCEPTION_STR("Argument 1 must be an array of job ids");
+    }
+    v8::Local<v8::Array> ids = v8::Local<v8::Array>::Cast(iArgs[1]);
+    // Open a handle to the printer, once for all jobs
+    PrinterHandle printerHandle((LPWSTR)(*printername));
+    if(!printerHandle)
+    {
+        std::string error_str("error on PrinterHandle: ");
+        error_str += getLastErrorCodeAndMessage();
+        RETURN_EXCEPTION_STR(error_str.c_str());
+    }
+    // same order as the requested ids, null for unknown jobs
+    v8::Local<v8::Array> result = V8_VALUE_NEW(Array, ids->Length());
+    for(uint32_t i = 0; i < ids->Length(); ++i)
+    {
+        v8::Local<v8::Value> id = Nan::Get(ids, i).ToLocalChecked();
+        if(!id->IsInt32() || Nan::To<int32_t>(id).FromJust() < 0)
+        {
+            RETURN_EXCEPTION_STR("Job ids must be positive integers");
+        }
+        DWORD jobId = static_cast<DWORD>(Nan::To<int32_t>(id).FromJust());
+        DWORD size_bytes = 0, dummyBytes = 0;
+        GetJobW(*printerHandle, jobId, 2, NULL, size_bytes, &size_bytes);
+        MemValue<JOB_INFO_2W> job(size_bytes);
+        if(!job || !GetJobW(*printerHandle, jobId, 2, (LPBYTE)job.get(), size_bytes, &dummyBytes))
+        {
+            Nan::Set(result, i, Nan::Null());
+            continue;
+        }
+        v8::Local<v8::Object> result_printer_job = V8_VALUE_NEW_DEFAULT(Object);
+        parseJobObject(job.get(), result_printer_job);
+        Nan::Set(result, i, result_printer_job);
+    }
+    MY_NODE_MODULE_RETURN_VALUE(result);
+}
+
 MY_NODE_MODULE_CALLBACK(setJob)
 {
     MY_NODE_MODULE_HANDLESCOPE;
@@ -672,6 +856,12 @@ MY_NODE_MODULE_CALLBACK(getSupportedPrintFormats)
     MY_NODE_MODULE_RETURN_VALUE(result);
 }
 
+MY_NODE_MODULE_CALLBACK(createPrintProfile)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
 MY_NODE_MODULE_CALLBACK(PrintDirect)
 {
     MY_NODE_MODULE_HANDLESCOPE;
@@ -684,7 +874,7 @@ MY_NODE_MODULE_CALLBACK(PrintDirect)
         RETURN_EXCEPTION_STR("Argument 0 missing");
     }
 
-    std::string data;
+    PrintData data;
     v8::Local<v8::Value> arg0(iArgs[0]);
     if (!getStringOrBufferFromV8Value(arg0, data))
     {
@@ -695,52 +885,64 @@ MY_NODE_MODULE_CALLBACK(PrintDirect)
     REQUIRE_ARGUMENT_STRINGW(iArgs, 2, docname);
     REQUIRE_ARGUMENT_STRINGW(iArgs, 3, type);
 
-    BOOL     bStatus = true;
-    // Open a handle to the printer.
-    PrinterHandle printerHandle((LPWSTR)(*printername));
-    DOC_INFO_1W DocInfo;
-    DWORD      dwJob = 0L;
-    DWORD      dwBytesWritten = 0L;
-
-    if (!printerHandle)
-    {
-        std::string error_str("error on PrinterHandle: ");
-        error_str += getLastErrorCodeAndMessage();
+    std::string error_str;
+    DWORD dwJob = printDirectData((LPWSTR)(*printername), (LPWSTR)(*docname), (LPWSTR)(*type), data, error_str);
+    if (dwJob == 0) {
         RETURN_EXCEPTION_STR(error_str.c_str());
     }
+    MY_NODE_MODULE_RETURN_VALUE(V8_VALUE_NEW(Number, dwJob));
+}
 
-    // Fill in the structure with info about this "document."
-    DocInfo.pDocName = (LPWSTR)(*docname);
-    DocInfo.pOutputFile =  NULL;
-    DocInfo.pDatatype = (LPWSTR)(*type);
-
-    // Inform the spooler the document is beginning.
-    dwJob = StartDocPrinterW(*printerHandle, 1, (LPBYTE)&DocInfo );
-    if (dwJob > 0) {
-        // Start a page.
-        bStatus = StartPagePrinter(*printerHandle);
-        if (bStatus) {
-            // Send the data to the printer.
-            //TODO: check with sizeof(LPTSTR) is the same as sizeof(char)
-            bStatus = WritePrinter( *printerHandle, (LPVOID)(data.c_str()), (DWORD)data.size(), &dwBytesWritten);
-            EndPagePrinter(*printerHandle);
-        }else{
-            std::string error_str("StartPagePrinter error: ");
-    	    error_str += getLastErrorCodeAndMessage();
-            RETURN_EXCEPTION_STR(error_str.c_str());
-        }
-        // Inform the spooler that the document is ending.
-        EndDocPrinter(*printerHandle);
-    }else{
-    	std::string error_str("StartDocPrinterW error: ");
-    	error_str += getLastErrorCodeAndMessage();
-        RETURN_EXCEPTION_STR(error_str.c_str());
-    }
-    // Check to see if correct number of bytes were written.
-    if (dwBytesWritten != data.size()) {
-        RETURN_EXCEPTION_STR("not sent all bytes");
+MY_NODE_MODULE_CALLBACK(PrintDirectAsync)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    REQUIRE_ARGUMENTS(iArgs, 6);
+    REQUIRE_ARGUMENT_STRINGW(iArgs, 1, printername);
+    REQUIRE_ARGUMENT_STRINGW(iArgs, 2, docname);
+    REQUIRE_ARGUMENT_STRINGW(iArgs, 3, type);
+    REQUIRE_ARGUMENT_FUNCTION(iArgs, 5, callback);
+
+    PrintDirectWorker *worker = new PrintDirectWorker(new Nan::Callback(callback),
+        (wchar_t*)(*printername), (wchar_t*)(*docname), (wchar_t*)(*type));
+    if (!getStringOrBufferFromV8Value(iArgs[0], worker->getData()))
+    {
+        delete worker;
+        RETURN_EXCEPTION_STR("Argument 0 must be a string or Buffer");
     }
-    MY_NODE_MODULE_RETURN_VALUE(V8_VALUE_NEW(Number, dwJob));
+    // the data is referenced in place: keep it alive until the job is sent
+    worker->SaveToPersistent("data", iArgs[0]);
+    Nan::AsyncQueueWorker(worker);
+    MY_NODE_MODULE_RETURN_UNDEFINED();
+}
+
+MY_NODE_MODULE_CALLBACK(PrintSocket)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(PrintSpool)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(PrintBatch)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(PrintStreamStart)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
+}
+
+MY_NODE_MODULE_CALLBACK(watchNotifications)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("not supported on windows");
 }
 
 MY_NODE_MODULE_CALLBACK(PrintFile)
@@ -748,3 +950,9 @@ MY_NODE_MODULE_CALLBACK(PrintFile)
     MY_NODE_MODULE_HANDLESCOPE;
     RETURN_EXCEPTION_STR("Not yet implemented on Windows");
 }
+
+MY_NODE_MODULE_CALLBACK(PrintFileAsync)
+{
+    MY_NODE_MODULE_HANDLESCOPE;
+    RETURN_EXCEPTION_STR("Not yet implemented on Windows");
+}
@@ -11,4 +11,60 @@ exports.testGetprinters = function(test) {
   test.done();
 }
 
+exports.testGetprintersAttributes = function(test) {
+  printer = require("../");
+  if(process.platform === 'win32') {
+    return test.done();
+  }
+  var all = {};
+  printer.getPrinters().forEach(function(p) {
+    all[p.name] = p;
+  });
+  // requested attributes give the same status and dates as the destinations
+  printer.getPrinters({attributes: ['printer-state', 'printer-state-change-time']}).forEach(function(p) {
+    test.ok(['IDLE', 'PRINTING', 'STOPPED'].indexOf(p.status) >= 0, p.name + ' status ' + p.status);
+    var changed = p.options['printer-state-change-time'];
+    test.ok(changed instanceof Date && !isNaN(changed.getTime()), p.name + ' printer-state-change-time');
+    if(all[p.name]) {
+      test.equal(p.status, all[p.name].status);
+    }
+  });
+  test.done();
+}
+
+function isEmptyDelta(records) {
+  return records.added.length === 0 && records.changed.length === 0 && records.removed.length === 0;
+}
+
+exports.testGetprintersDelta = function(test) {
+  printer = require("../");
+  if(process.platform === 'win32') {
+    return test.done();
+  }
+  var first = printer.getPrintersDelta();
+  // "epoch.version", the epoch is drawn for each process
+  test.ok(/^[0-9a-f]+\.[0-9]+$/.test(first.version), first.version);
+  test.ok(first.full);
+  test.equal(first.printers.changed.length + first.printers.removed.length, 0);
+  test.equal(first.jobs.changed.length + first.jobs.removed.length, 0);
+
+  // nothing changed on the server meanwhile
+  var again = printer.getPrintersDelta(first.version);
+  test.equal(again.version, first.version);
+  test.ok(!again.full);
+  test.ok(isEmptyDelta(again.printers));
+  test.ok(isEmptyDelta(again.jobs));
+
+  var epoch = first.version.split('.')[0],
+      foreign = (epoch.charAt(0) === '0' ? '1' : '0') + epoch.substring(1);
+  [undefined, null, '', 'nonsense', foreign + '.' + first.version.split('.')[1], epoch + '.', epoch + '.1x', epoch + '.99999999999'].forEach(function(since) {
+    var delta = printer.getPrintersDelta(since);
+    test.ok(delta.full, 'full snapshot since ' + since);
+    test.equal(delta.printers.added.length, first.printers.added.length);
+    test.equal(delta.jobs.added.length, first.jobs.added.length);
+  });
+  test.throws(function() { printer.getPrintersDelta(1); });
+  test.done();
+}
+
 // TODO: add more tests
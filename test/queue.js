@@ -0,0 +1,146 @@
+var PrintQueue = require("../lib/queue").PrintQueue;
+
+// printer module whose jobs complete when the test says so
+function fakePrinter() {
+  var printer = {started: []};
+  printer.printDirect = function(parameters) {
+    printer.started.push(parameters);
+  };
+  printer.complete = function(index, err) {
+    var parameters = printer.started[index];
+    if(err) {
+      parameters.error(err);
+    } else {
+      parameters.success(100 + index);
+    }
+  };
+  return printer;
+}
+
+function names(printer) {
+  return printer.started.map(function(parameters) { return parameters.docname; });
+}
+
+exports.testPriorityOrder = function(test) {
+  var printer = fakePrinter(),
+      queue = new PrintQueue(printer);
+  queue.printDirect({printer: 'p', data: 'a', docname: 'low', success: function(){}});
+  queue.printDirect({printer: 'p', data: 'b', docname: 'high', priority: 5, success: function(){}});
+  queue.printDirect({printer: 'p', data: 'c', docname: 'middle', priority: 1, success: function(){}});
+  queue.printDirect({printer: 'p', data: 'd', docname: 'middle2', priority: 1, success: function(){}});
+  setImmediate(function() {
+    test.deepEqual(names(printer), ['high']);
+    printer.complete(0);
+    setImmediate(function() {
+      printer.complete(1);
+      setImmediate(function() {
+        printer.complete(2);
+        setImmediate(function() {
+          test.deepEqual(names(printer), ['high', 'middle', 'middle2', 'low']);
+          test.done();
+        });
+      });
+    });
+  });
+};
+
+exports.testConcurrency = function(test) {
+  var printer = fakePrinter(),
+      queue = new PrintQueue(printer, {concurrency: 2});
+  ['a', 'b', 'c'].forEach(function(name) {
+    queue.printDirect({printer: 'p1', data: name, docname: name, success: function(){}});
+  });
+  queue.printDirect({printer: 'p2', data: 'd', docname: 'd', success: function(){}});
+  setImmediate(function() {
+    // two jobs per printer
+    test.deepEqual(names(printer).sort(), ['a', 'b', 'd']);
+    test.equal(queue.getStats().printers.p1.queued, 1);
+    printer.complete(0);
+    setImmediate(function() {
+      test.deepEqual(names(printer).sort(), ['a', 'b', 'c', 'd']);
+      test.done();
+    });
+  });
+};
+
+exports.testMaxInFlightBytes = function(test) {
+  var printer = fakePrinter(),
+      queue = new PrintQueue(printer, {concurrency: 10, maxInFlightBytes: 10});
+  queue.printDirect({printer: 'p', data: 'aaaaaa', docname: 'a', success: function(){}});
+  queue.printDirect({printer: 'p', data: 'bbbb', docname: 'b', success: function(){}});
+  queue.printDirect({printer: 'p', data: new Array(101).join('x'), docname: 'big', success: function(){}});
+  queue.printDirect({printer: 'p', data: 'c', docname: 'c', success: function(){}});
+  setImmediate(function() {
+    test.deepEqual(names(printer), ['a', 'b']);
+    test.equal(queue.getStats().inFlightBytes, 10);
+    printer.complete(0);
+    printer.complete(1);
+    setImmediate(function() {
+      // a job bigger than the limit is sent alone
+      test.deepEqual(names(printer), ['a', 'b', 'big']);
+      printer.complete(2);
+      setImmediate(function() {
+        test.deepEqual(names(printer), ['a', 'b', 'big', 'c']);
+        test.done();
+      });
+    });
+  });
+};
+
+exports.testCancel = function(test) {
+  var printer = fakePrinter(),
+      queue = new PrintQueue(printer),
+      first = queue.printDirect({printer: 'p', data: 'a', docname: 'a', success: function(){}}),
+      second = queue.printDirect({printer: 'p', data: 'b', docname: 'b', error: function(err) {
+        test.equal(err.code, 'ECANCELED');
+        test.equal(second.state, 'failed');
+      }});
+  setImmediate(function() {
+    test.equal(first.cancel(), false);
+    test.equal(second.cancel(), true);
+    test.equal(second.cancel(), false);
+    printer.complete(0);
+    setImmediate(function() {
+      test.deepEqual(names(printer), ['a']);
+      test.equal(first.state, 'printed');
+      test.equal(first.jobId, 100);
+      test.expect(8);
+      test.done();
+    });
+  });
+};
+
+exports.testDrainAndIdle = function(test) {
+  var printer = fakePrinter(),
+      queue = new PrintQueue(printer, {maxQueued: 1}),
+      events = [];
+  queue.on('drain', function() { events.push('drain'); });
+  queue.on('idle', function() {
+    events.push('idle');
+    test.deepEqual(events.slice(0, 2).sort(), ['drain', 'full']);
+    test.equal(events[2], 'idle');
+    test.done();
+  });
+  queue.printDirect({printer: 'p', data: 'a', docname: 'a', success: function(){}});
+  test.ok(queue.isFull());
+  queue.printDirect({printer: 'p', data: 'b', docname: 'b', error: function(err) {
+    events.push(err.code === 'EQUEUEFULL' ? 'full' : err.message);
+  }});
+  setImmediate(function() {
+    test.ok(!queue.isFull());
+    printer.complete(0);
+  });
+};
+
+exports.testSynchronousErrors = function(test) {
+  var count = 20000,
+      failed = 0,
+      queue = new PrintQueue({printDirect: function() { throw new Error('no printer'); }}, {maxQueued: count});
+  queue.on('idle', function() {
+    test.equal(failed, count);
+    test.done();
+  });
+  for(var i = 0; i < count; ++i) {
+    queue.printDirect({printer: 'p', data: 'x', error: function() { ++failed; }});
+  }
+};
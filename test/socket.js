@@ -0,0 +1,114 @@
+var net = require("net");
+
+// socket:// printers are POSIX only
+function skip(test) {
+  if(process.platform === 'win32') {
+    test.done();
+    return true;
+  }
+  return false;
+}
+
+function listen(onConnection, callback) {
+  var server = net.createServer(onConnection);
+  server.listen(0, '127.0.0.1', function() {
+    callback(server, server.address().port);
+  });
+}
+
+exports.testPipelining = function(test) {
+  if(skip(test)) return;
+  var printer = require("../"),
+      server,
+      connections = 0,
+      printed = 0,
+      received = '';
+  listen(function(socket) {
+    ++connections;
+    socket.on('data', function(chunk) { received += chunk; });
+    // closed by the backend once idle
+    socket.on('end', function() {
+      test.equal(connections, 1);
+      test.equal(printed, 5);
+      test.equal(received, 'job0;job1;job2;job3;job4;');
+      server.close();
+      test.done();
+    });
+  }, function(listening, port) {
+    server = listening;
+    for(var i = 0; i < 5; ++i) {
+      printer.printDirect({printer: 'socket://127.0.0.1:' + port, data: 'job' + i + ';', type: 'RAW', idleTimeout: 200,
+        success: function(jobId) {
+          test.ok(jobId > 0);
+          ++printed;
+        },
+        error: function(err) { test.ifError(err); }
+      });
+    }
+  });
+};
+
+exports.testUppercaseScheme = function(test) {
+  if(skip(test)) return;
+  var printer = require("../"),
+      server;
+  listen(function(socket) {
+    socket.on('data', function(chunk) {
+      test.equal(String(chunk), 'upper');
+      socket.destroy();
+      server.close();
+      test.done();
+    });
+  }, function(listening, port) {
+    server = listening;
+    printer.printDirect({printer: 'SOCKET://127.0.0.1:' + port, data: 'upper', type: 'RAW', idleTimeout: 100,
+      error: function(err) { test.ifError(err); }
+    });
+  });
+};
+
+exports.testRefusedConnection = function(test) {
+  if(skip(test)) return;
+  var printer = require("../");
+  // a port nobody listens on any more
+  listen(null, function(server, port) {
+    server.close(function() {
+      printer.printDirect({printer: 'socket://127.0.0.1:' + port, data: 'refused', type: 'RAW',
+        success: function() {
+          test.ok(false, 'the job should fail');
+          test.done();
+        },
+        error: function(err) {
+          test.ok(/connect/i.test(err.message), err.message);
+          test.done();
+        }
+      });
+    });
+  });
+};
+
+exports.testStalledReader = function(test) {
+  if(skip(test)) return;
+  var printer = require("../"),
+      sockets = [];
+  listen(function(socket) {
+    // never read: the kernel buffers fill up and the job makes no progress
+    socket.pause();
+    sockets.push(socket);
+  }, function(server, port) {
+    var started = Date.now();
+    printer.printDirect({printer: 'socket://127.0.0.1:' + port, data: Buffer.alloc(64 * 1024 * 1024), type: 'RAW', timeout: 300,
+      success: function() {
+        test.ok(false, 'the job should time out');
+        test.done();
+      },
+      error: function(err) {
+        test.ok(/timeout/i.test(err.message), err.message);
+        test.ok(Date.now() - started < 5000);
+        sockets.forEach(function(socket) { socket.destroy(); });
+        server.close();
+        test.done();
+      }
+    });
+  });
+};
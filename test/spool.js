@@ -0,0 +1,152 @@
+var fs = require("fs"),
+    os = require("os"),
+    path = require("path"),
+    child_process = require("child_process");
+
+// the spool is POSIX only
+function skip(test) {
+  if(process.platform === 'win32') {
+    test.done();
+    return true;
+  }
+  return false;
+}
+
+function tempSpool(name) {
+  var file = path.join(os.tmpdir(), 'node-printer-' + name + '-' + process.pid + '.spool');
+  if(fs.existsSync(file)) {
+    fs.unlinkSync(file);
+  }
+  return file;
+}
+
+/** Run this file as a child against a server nobody listens on, so that the jobs stay pending:
+ * libcups reads CUPS_SERVER once, and the lock of the journal is held per process.
+ * The child opens the journal, appends `count` jobs and reports its stats or the error of the open
+ */
+function spool(file, count) {
+  var env = {};
+  Object.keys(process.env).forEach(function(key) { env[key] = process.env[key]; });
+  env.CUPS_SERVER = '127.0.0.1:1';
+  var output = child_process.execFileSync(process.execPath, [__filename, file, String(count || 0)], {env: env});
+  return JSON.parse(output);
+}
+
+// child side of spool()
+function runChild() {
+  var printer = require("../"),
+      jobs = [];
+  try {
+    printer.setSpoolOptions({path: process.argv[2], maxSize: 65536, retryInterval: 600000});
+  } catch(e) {
+    process.stdout.write(JSON.stringify({error: e.message}));
+    process.exit(0);
+  }
+  for(var i = 0; i < Number(process.argv[3]); ++i) {
+    jobs.push(printer.printDirect({printer: 'spool-test', data: 'spooled job ' + i, type: 'RAW', docname: 'spooled', spool: true}));
+  }
+  Promise.all(jobs).then(function(sequences) {
+    var stats = printer.getSpoolStats();
+    stats.sequences = sequences;
+    process.stdout.write(JSON.stringify(stats));
+    process.exit(0);
+  }, function(err) {
+    process.stdout.write(JSON.stringify({error: err.message}));
+    process.exit(0);
+  });
+}
+
+// file header: magic[8], head, sequence. Records: magic, crc, sequence, size, then the payload aligned on 8 bytes
+function readRecords(file) {
+  var buffer = fs.readFileSync(file),
+      records = [],
+      position = buffer.readUInt32LE(8);
+  while(position + 24 <= buffer.length && buffer.readUInt32LE(position) === 0x5253504e) {
+    var size = buffer.readUInt32LE(position + 16);
+    records.push({position: position, sequence: buffer.readUInt32LE(position + 8), size: size, length: (24 + size + 7) & ~7});
+    position = records[records.length - 1].position + records[records.length - 1].length;
+  }
+  return {buffer: buffer, records: records};
+}
+
+exports.testTornRecord = function(test) {
+  if(skip(test)) return;
+  var file = tempSpool('torn');
+  test.equal(spool(file, 3).pending, 3);
+  // the last append did not reach the disk entirely
+  var journal = readRecords(file),
+      last = journal.records[2];
+  fs.truncateSync(file, last.position + 24 + Math.floor(last.size / 2));
+  test.equal(spool(file).pending, 2);
+  // the next job takes the place and the sequence number of the torn one
+  var stats = spool(file, 1);
+  test.equal(stats.pending, 3);
+  test.deepEqual(stats.sequences, [last.sequence]);
+  fs.unlinkSync(file);
+  test.done();
+}
+
+exports.testChecksumMismatch = function(test) {
+  if(skip(test)) return;
+  var file = tempSpool('crc');
+  test.equal(spool(file, 3).pending, 3);
+  var journal = readRecords(file),
+      second = journal.records[1],
+      fd = fs.openSync(file, 'r+'),
+      byte = Buffer.alloc(1);
+  fs.readSync(fd, byte, 0, 1, second.position + 24 + second.size - 1);
+  byte[0] ^= 0xff;
+  fs.writeSync(fd, byte, 0, 1, second.position + 24 + second.size - 1);
+  fs.closeSync(fd);
+  // the records are read up to the first invalid one
+  test.equal(spool(file).pending, 1);
+  fs.unlinkSync(file);
+  test.done();
+}
+
+exports.testStaleRecordsAfterCompaction = function(test) {
+  if(skip(test)) return;
+  var file = tempSpool('compaction');
+  test.equal(spool(file, 3).pending, 3);
+  // as a compaction once the first two jobs are sent: the third record is moved to the start of the file,
+  // the copies of the second and third ones are left after it
+  var journal = readRecords(file),
+      first = journal.records[0],
+      third = journal.records[2],
+      fd = fs.openSync(file, 'r+');
+  test.equal(first.length, third.length);
+  fs.writeSync(fd, journal.buffer, third.position, third.length, first.position);
+  fs.closeSync(fd);
+  test.equal(spool(file).pending, 1);
+
+  // as a reset once all the jobs are sent: the header sequence goes past the records left in place
+  var header = Buffer.alloc(8);
+  header.writeUInt32LE(third.sequence + 1, 0);
+  fd = fs.openSync(file, 'r+');
+  fs.writeSync(fd, header, 0, 8, 16);
+  fs.closeSync(fd);
+  test.equal(spool(file).pending, 0);
+  fs.unlinkSync(file);
+  test.done();
+}
+
+exports.testSecondOpener = function(test) {
+  if(skip(test)) return;
+  var printer = require("../"),
+      file = tempSpool('lock');
+  printer.setSpoolOptions({path: file, maxSize: 65536, retryInterval: 600000});
+  try {
+    test.ok(/used by another process/.test(spool(file).error));
+  } finally {
+    printer.setSpoolOptions({path: null});
+  }
+  test.equal(printer.getSpoolStats().path, null);
+  // released on close
+  test.equal(spool(file).pending, 0);
+  fs.unlinkSync(file);
+  test.done();
+}
+
+if(require.main === module) {
+  runChild();
+}
@@ -0,0 +1,47 @@
+var formatPrometheus = require("../lib/stats").formatPrometheus;
+
+// getStats() result: latencies in milliseconds
+var stats = {
+  latencyBuckets: [1, 10, 100],
+  metrics: {
+    printDirect: {calls: 3, errors: 1, bytes: 2048, latencySum: 25.5, latencyCounts: [1, 1, 0, 1]},
+    'a"b\\c': {calls: 0, errors: 0, bytes: 0, latencySum: 0, latencyCounts: [0, 0, 0, 0]}
+  }
+};
+
+exports.testCounters = function(test) {
+  var lines = formatPrometheus(stats).split('\n');
+  test.notEqual(lines.indexOf('# TYPE node_printer_calls_total counter'), -1);
+  test.notEqual(lines.indexOf('node_printer_calls_total{operation="printDirect"} 3'), -1);
+  test.notEqual(lines.indexOf('node_printer_errors_total{operation="printDirect"} 1'), -1);
+  test.notEqual(lines.indexOf('node_printer_bytes_total{operation="printDirect"} 2048'), -1);
+  test.done();
+};
+
+exports.testHistogram = function(test) {
+  var lines = formatPrometheus(stats).split('\n');
+  test.notEqual(lines.indexOf('# TYPE node_printer_latency_seconds histogram'), -1);
+  // cumulative buckets, bounds in seconds
+  test.notEqual(lines.indexOf('node_printer_latency_seconds_bucket{operation="printDirect",le="0.001"} 1'), -1);
+  test.notEqual(lines.indexOf('node_printer_latency_seconds_bucket{operation="printDirect",le="0.01"} 2'), -1);
+  test.notEqual(lines.indexOf('node_printer_latency_seconds_bucket{operation="printDirect",le="0.1"} 2'), -1);
+  test.notEqual(lines.indexOf('node_printer_latency_seconds_bucket{operation="printDirect",le="+Inf"} 3'), -1);
+  test.notEqual(lines.indexOf('node_printer_latency_seconds_sum{operation="printDirect"} 0.0255'), -1);
+  test.notEqual(lines.indexOf('node_printer_latency_seconds_count{operation="printDirect"} 3'), -1);
+  test.done();
+};
+
+exports.testLabelEscaping = function(test) {
+  var text = formatPrometheus(stats);
+  test.notEqual(text.indexOf('node_printer_calls_total{operation="a\\"b\\\\c"} 0\n'), -1);
+  test.done();
+};
+
+exports.testPrefix = function(test) {
+  var text = formatPrometheus(stats, 'app_printer');
+  test.equal(text.indexOf('node_printer'), -1);
+  test.notEqual(text.indexOf('\napp_printer_calls_total{operation="printDirect"} 3\n'), -1);
+  // the exposition ends with a line feed
+  test.equal(text.charAt(text.length - 1), '\n');
+  test.done();
+};
@@ -0,0 +1,55 @@
+function render(source, language, records) {
+  var printer = require("../");
+  return printer.renderTemplate(printer.compileTemplate(source, {language: language}), records).toString();
+}
+
+exports.testRawValues = function(test) {
+  test.equal(render('A{{x}}B', 'raw', [{x: '^~_"\\\n'}]), 'A^~_"\\\nB');
+  test.equal(render('{{n}};', 'raw', [{n: 12}, {n: 1.5}, {n: null}, {}]), '12;1.5;;;');
+  test.done();
+};
+
+exports.testNumbers = function(test) {
+  test.equal(render('{{n}};', 'raw', [{n: NaN}, {n: Infinity}, {n: -Infinity}]), 'NaN;Infinity;-Infinity;');
+  // integers beyond the range of a 64 bits integer
+  test.equal(render('{{n}};', 'raw', [{n: 1e20}, {n: -1e300}, {n: 9007199254740992}]), '1e+20;-1e+300;9007199254740992;');
+  test.done();
+};
+
+exports.testZplEscaping = function(test) {
+  // ^ ~ _ become field hex escapes, read with ^FH
+  test.equal(render('^FH^FD{{text}}^FS', 'zpl', [{text: 'a^b~c_d'}]), '^FH^FDa_5Eb_7Ec_5Fd^FS');
+  test.equal(render('{{text}}', 'zpl', [{text: '^^'}]), '_5E_5E');
+  // the template itself is not escaped
+  test.equal(render('^XA{{text}}^XZ', 'zpl', [{text: 'plain'}]), '^XAplain^XZ');
+  test.done();
+};
+
+exports.testEplEscaping = function(test) {
+  test.equal(render('A50,50,0,1,1,1,N,"{{text}}"', 'epl', [{text: 'say "hi" \\o/'}]),
+             'A50,50,0,1,1,1,N,"say \\"hi\\" \\\\o/"');
+  // line breaks would end the command
+  test.equal(render('"{{text}}"', 'epl', [{text: 'one\r\ntwo\nthree'}]), '"one  two three"');
+  test.done();
+};
+
+exports.testRepeatedFields = function(test) {
+  var printer = require("../"),
+      template = printer.compileTemplate('{{id}}:{{ name }}:{{id}}|', {language: 'zpl'});
+  test.deepEqual(template.fields, ['id', 'name']);
+  test.equal(printer.renderTemplate(template, [{id: 'a_1', name: 'x'}, {id: 2, name: 'y^'}]).toString(),
+             'a_5F1:x:a_5F1|2:y_5E:2|');
+  test.done();
+};
+
+exports.testThrowingValues = function(test) {
+  var printer = require("../"),
+      template = printer.compileTemplate('{{x}}'),
+      record = {};
+  Object.defineProperty(record, 'x', {get: function() { throw new Error('getter failed'); }});
+  test.throws(function() { printer.renderTemplate(template, [record]); }, /getter failed/);
+  test.throws(function() { printer.renderTemplate(template, [{x: Symbol('s')}]); }, TypeError);
+  // the template is still usable
+  test.equal(printer.renderTemplate(template, [{x: 'ok'}]).toString(), 'ok');
+  test.done();
+};